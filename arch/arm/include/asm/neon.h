@@ -0,0 +1,57 @@
+/*
+ *  linux/arch/arm/include/asm/neon.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+/*
+ * Copies and fills of at least this many bytes are handed to the NEON
+ * implementation when CONFIG_NEON_LARGE_COPY is set.  Smaller ones are
+ * not worth the cost of claiming the NEON unit.
+ */
+#define NEON_COPY_THRESHOLD	1024
+
+#ifndef __ASSEMBLY__
+
+#include <linux/hardirq.h>
+#include <linux/irqflags.h>
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+/*
+ * Claim the NEON/VFP register file for use by the kernel.  The caller
+ * must not be in interrupt context; preemption stays disabled until the
+ * matching kernel_neon_end().  Sections may nest.
+ */
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+
+/*
+ * Kernel mode NEON may be used from the current context.  HWCAP_NEON is
+ * only set once vfp_init() has probed the unit.  Interrupts-off sections
+ * are refused as well, since they include low level PM paths where the
+ * VFP context may be powered down.
+ */
+static inline int kernel_neon_usable(void)
+{
+	return cpu_has_neon() && !in_interrupt() && !irqs_disabled();
+}
+
+#ifdef CONFIG_NEON_LARGE_COPY
+extern bool neon_copy_enabled;
+
+/* The integer-only implementations, bypassing the NEON dispatch */
+extern void *__memcpy_arm(void *, const void *, __kernel_size_t);
+extern void *__memset_arm(void *, int, __kernel_size_t);
+extern void __memzero_arm(void *, __kernel_size_t);
+extern void __copy_page_arm(void *, const void *);
+#endif
+
+#endif /* __ASSEMBLY__ */
+
+#endif /* __ASM_ARM_NEON_H */
@@ -12,6 +12,7 @@
  */
 #define pr_fmt(fmt) "hw perfevents: " fmt
 
+#include <linux/hrtimer.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -67,6 +68,25 @@ struct cpu_hw_events {
 };
 static DEFINE_PER_CPU(struct cpu_hw_events, cpu_hw_events);
 
+/*
+ * Without a usable overflow interrupt, either because the platform gives
+ * none or it can't be requested, or because armpmu_poll= asked for it, the
+ * counters are polled from a per-cpu hrtimer instead. Sampling then works
+ * as if each counter interrupted at the first poll after it overflowed.
+ */
+#define ARMPMU_POLL_INTERVAL_US		1000
+
+static unsigned int armpmu_poll_us;
+static ktime_t armpmu_poll_period;
+static bool armpmu_polled;
+static DEFINE_PER_CPU(struct hrtimer, armpmu_poll_timer);
+
+static int __init armpmu_poll_setup(char *str)
+{
+	return !kstrtouint(str, 10, &armpmu_poll_us);
+}
+__setup("armpmu_poll=", armpmu_poll_setup);
+
 struct arm_pmu {
 	enum arm_perf_pmu_ids id;
 	const char	*name;
@@ -220,10 +240,11 @@ again:
 	new_raw_count &= armpmu->max_period;
 	prev_raw_count &= armpmu->max_period;
 
+	/* A polled counter may have wrapped without anyone noticing */
 	if (overflow)
 		delta = armpmu->max_period - prev_raw_count + new_raw_count + 1;
 	else
-		delta = new_raw_count - prev_raw_count;
+		delta = (new_raw_count - prev_raw_count) & armpmu->max_period;
 
 	local64_add(delta, &event->count);
 	local64_sub(delta, &hwc->period_left);
@@ -231,6 +252,67 @@ again:
 	return new_raw_count;
 }
 
+static enum hrtimer_restart
+armpmu_poll(struct hrtimer *timer)
+{
+	struct cpu_hw_events *cpuc = &__get_cpu_var(cpu_hw_events);
+	struct pt_regs *regs = get_irq_regs();
+	struct perf_sample_data data;
+	int idx, active = 0;
+
+	/* Migrated away from a cpu that went offline */
+	if (timer != &__get_cpu_var(armpmu_poll_timer))
+		return HRTIMER_NORESTART;
+
+	perf_sample_data_init(&data, 0);
+
+	for (idx = 0; idx <= armpmu->num_events; ++idx) {
+		struct perf_event *event = cpuc->events[idx];
+		struct hw_perf_event *hwc;
+
+		if (!test_bit(idx, cpuc->active_mask))
+			continue;
+
+		active = 1;
+		hwc = &event->hw;
+		if (hwc->state & PERF_HES_STOPPED)
+			continue;
+
+		armpmu_event_update(event, hwc, idx, 0);
+		if (local64_read(&hwc->period_left) > 0)
+			continue;
+
+		data.period = event->hw.last_period;
+		if (!armpmu_event_set_period(event, hwc, idx))
+			continue;
+
+		if (regs && perf_event_overflow(event, 0, &data, regs))
+			armpmu->disable(hwc, idx);
+	}
+
+	irq_work_run();
+
+	if (!active)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, armpmu_poll_period);
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Called with interrupts disabled, possibly under the runqueue lock, so
+ * the timer must not wake up the softirq.
+ */
+static void
+armpmu_poll_start(void)
+{
+	struct hrtimer *timer = &__get_cpu_var(armpmu_poll_timer);
+
+	if (!hrtimer_active(timer))
+		__hrtimer_start_range_ns(timer, armpmu_poll_period, 0,
+					 HRTIMER_MODE_REL_PINNED, 0);
+}
+
 static void
 armpmu_read(struct perf_event *event)
 {
@@ -288,6 +370,9 @@ armpmu_start(struct perf_event *event, int flags)
 	 */
 	armpmu_event_set_period(event, hwc, hwc->idx);
 	armpmu->enable(hwc, hwc->idx);
+
+	if (armpmu_polled)
+		armpmu_poll_start();
 }
 
 static void
@@ -388,6 +473,15 @@ static irqreturn_t armpmu_platform_irq(int irq, void *dev)
 	return plat->handle_irq(irq, dev, armpmu->handle_irq);
 }
 
+static int
+armpmu_use_polling(const char *why)
+{
+	pr_info_once("%s, polling counters every %lld us\n", why,
+		     ktime_to_us(armpmu_poll_period));
+	armpmu_polled = true;
+	return 0;
+}
+
 static int
 armpmu_reserve_hardware(void)
 {
@@ -395,24 +489,31 @@ armpmu_reserve_hardware(void)
 	irq_handler_t handle_irq;
 	int i, err = -ENODEV, irq;
 
+	armpmu_polled = false;
+
 	pmu_device = reserve_pmu(ARM_PMU_DEVICE_CPU);
 	if (IS_ERR(pmu_device)) {
+		err = PTR_ERR(pmu_device);
+		pmu_device = NULL;
+		if (err == -ENODEV)
+			return armpmu_use_polling("no PMU device");
 		pr_warning("unable to reserve pmu\n");
-		return PTR_ERR(pmu_device);
+		return err;
 	}
 
 	init_pmu(ARM_PMU_DEVICE_CPU);
 
+	if (armpmu_poll_us)
+		return armpmu_use_polling("armpmu_poll= given");
+
 	plat = dev_get_platdata(&pmu_device->dev);
 	if (plat && plat->handle_irq)
 		handle_irq = armpmu_platform_irq;
 	else
 		handle_irq = armpmu->handle_irq;
 
-	if (pmu_device->num_resources < 1) {
-		pr_err("no irqs for PMUs defined\n");
-		return -ENODEV;
-	}
+	if (pmu_device->num_resources < 1)
+		return armpmu_use_polling("no irqs for PMUs defined");
 
 	for (i = 0; i < pmu_device->num_resources; ++i) {
 		irq = platform_get_irq(pmu_device, i);
@@ -435,11 +536,11 @@ armpmu_reserve_hardware(void)
 			if (irq >= 0)
 				free_irq(irq, NULL);
 		}
-		release_pmu(pmu_device);
-		pmu_device = NULL;
+		/* Keep the PMU device reserved, the counters are still ours */
+		return armpmu_use_polling("no usable PMU irq");
 	}
 
-	return err;
+	return 0;
 }
 
 static void
@@ -447,14 +548,17 @@ armpmu_release_hardware(void)
 {
 	int i, irq;
 
-	for (i = pmu_device->num_resources - 1; i >= 0; --i) {
-		irq = platform_get_irq(pmu_device, i);
-		if (irq >= 0)
-			free_irq(irq, NULL);
+	if (!armpmu_polled) {
+		for (i = pmu_device->num_resources - 1; i >= 0; --i) {
+			irq = platform_get_irq(pmu_device, i);
+			if (irq >= 0)
+				free_irq(irq, NULL);
+		}
 	}
 	armpmu->stop();
 
-	release_pmu(pmu_device);
+	if (pmu_device)
+		release_pmu(pmu_device);
 	pmu_device = NULL;
 }
 
@@ -644,6 +748,7 @@ init_hw_perf_events(void)
 	unsigned long cpuid = read_cpuid_id();
 	unsigned long implementor = (cpuid & 0xFF000000) >> 24;
 	unsigned long part_number = (cpuid & 0xFFF0);
+	int cpu;
 
 	/* ARM Ltd CPUs. */
 	if (0x41 == implementor) {
@@ -685,6 +790,15 @@ init_hw_perf_events(void)
 	if (armpmu) {
 		pr_info("enabled with %s PMU driver, %d counters available\n",
 			armpmu->name, armpmu->num_events);
+
+		armpmu_poll_period = ns_to_ktime((u64)(armpmu_poll_us ?:
+			ARMPMU_POLL_INTERVAL_US) * NSEC_PER_USEC);
+		for_each_possible_cpu(cpu) {
+			struct hrtimer *timer = &per_cpu(armpmu_poll_timer, cpu);
+
+			hrtimer_init(timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+			timer->function = armpmu_poll;
+		}
 	} else {
 		pr_info("no hardware support available\n");
 	}
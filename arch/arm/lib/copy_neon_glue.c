@@ -0,0 +1,129 @@
+/*
+ *  linux/arch/arm/lib/copy_neon_glue.c
+ *
+ *  Size based dispatch of memcpy, memset, __memzero and copy_page to
+ *  NEON bulk loops.  The assembly entry points only branch here for
+ *  requests of at least NEON_COPY_THRESHOLD bytes; everything else, and
+ *  every caller that may not claim the NEON unit, is served by the
+ *  integer implementations.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/string.h>
+
+#include <asm/neon.h>
+#include <asm/page.h>
+
+extern void __memcpy_neon(void *dst, const void *src, size_t n);
+extern void __memset_neon(void *dst, int c, size_t n);
+extern void __copy_page_neon(void *to, const void *from);
+
+bool neon_copy_enabled __read_mostly = true;
+EXPORT_SYMBOL_GPL(neon_copy_enabled);
+core_param(neon_copy, neon_copy_enabled, bool, 0644);
+
+EXPORT_SYMBOL_GPL(__memcpy_arm);
+EXPORT_SYMBOL_GPL(__memset_arm);
+EXPORT_SYMBOL_GPL(__memzero_arm);
+EXPORT_SYMBOL_GPL(__copy_page_arm);
+
+static inline int neon_copy_usable(void)
+{
+	return neon_copy_enabled && kernel_neon_usable();
+}
+
+/*
+ * Split a request into an integer head that aligns the destination to
+ * 16 bytes, a NEON body that is a multiple of 64 bytes and an integer
+ * tail.  n is at least NEON_COPY_THRESHOLD, so the body is never empty.
+ */
+static inline size_t neon_copy_split(void *dest, size_t n, size_t *body)
+{
+	size_t head = -(unsigned long)dest & 15;
+
+	*body = (n - head) & ~63UL;
+	return head;
+}
+
+void *__memcpy_large(void *dest, const void *src, size_t n)
+{
+	size_t head, body;
+
+	if (!neon_copy_usable())
+		return __memcpy_arm(dest, src, n);
+
+	head = neon_copy_split(dest, n, &body);
+	if (head)
+		__memcpy_arm(dest, src, head);
+
+	kernel_neon_begin();
+	__memcpy_neon(dest + head, src + head, body);
+	kernel_neon_end();
+
+	n -= head + body;
+	if (n)
+		__memcpy_arm(dest + head + body, src + head + body, n);
+
+	return dest;
+}
+
+void *__memset_large(void *s, int c, size_t n)
+{
+	size_t head, body;
+
+	if (!neon_copy_usable())
+		return __memset_arm(s, c, n);
+
+	head = neon_copy_split(s, n, &body);
+	if (head)
+		__memset_arm(s, c, head);
+
+	kernel_neon_begin();
+	__memset_neon(s + head, c, body);
+	kernel_neon_end();
+
+	n -= head + body;
+	if (n)
+		__memset_arm(s + head + body, c, n);
+
+	return s;
+}
+
+void __memzero_large(void *s, size_t n)
+{
+	size_t head, body;
+
+	if (!neon_copy_usable()) {
+		__memzero_arm(s, n);
+		return;
+	}
+
+	head = neon_copy_split(s, n, &body);
+	if (head)
+		__memzero_arm(s, head);
+
+	kernel_neon_begin();
+	__memset_neon(s + head, 0, body);
+	kernel_neon_end();
+
+	n -= head + body;
+	if (n)
+		__memzero_arm(s + head + body, n);
+}
+
+void __copy_page_large(void *to, const void *from)
+{
+	if (!neon_copy_usable()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from);
+	kernel_neon_end();
+}
@@ -0,0 +1,227 @@
+/*
+ *  linux/arch/arm/lib/copy_neon_test.c
+ *
+ *  Self-test and bandwidth benchmark for the NEON memcpy, memset and
+ *  copy_page paths.  Every size/alignment combination is checked against
+ *  the integer implementation and timed with the NEON paths enabled and
+ *  disabled.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include <asm/neon.h>
+
+#define BUF_SIZE	(256 * 1024 + 64)
+
+static unsigned int iterations = 64;
+module_param(iterations, uint, 0);
+MODULE_PARM_DESC(iterations, "Number of timed runs per size (default 64)");
+
+static const size_t sizes[] = {
+	64, 512, 1024, 2048, 4096, 16384, 65536, 262144, 0
+};
+
+static const unsigned int aligns[][2] = {
+	{ 0, 0 }, { 0, 1 }, { 1, 0 }, { 4, 4 }, { 8, 3 }, { 16, 16 },
+};
+
+static u8 *src, *dst, *ref;
+
+static void fill_pattern(u8 *p, size_t n, u8 seed)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		p[i] = (u8)(i * 7 + seed);
+}
+
+/* Returns the bandwidth in MiB/s of 'iterations' calls of op */
+static unsigned long measure(void (*op)(size_t, unsigned int, unsigned int),
+			     size_t n, unsigned int da, unsigned int sa)
+{
+	ktime_t start;
+	s64 ns;
+	unsigned int i;
+
+	op(n, da, sa);
+	start = ktime_get();
+	for (i = 0; i < iterations; i++)
+		op(n, da, sa);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	if (ns <= 0)
+		ns = 1;
+
+	return div64_u64((u64)n * iterations * NSEC_PER_SEC, ns) >> 20;
+}
+
+static void op_memcpy(size_t n, unsigned int da, unsigned int sa)
+{
+	memcpy(dst + da, src + sa, n);
+}
+
+static void op_memset(size_t n, unsigned int da, unsigned int sa)
+{
+	memset(dst + da, 0x5a, n);
+}
+
+static void op_memzero(size_t n, unsigned int da, unsigned int sa)
+{
+	memset(dst + da, 0, n);
+}
+
+static void op_copy_page(size_t n, unsigned int da, unsigned int sa)
+{
+	size_t off;
+
+	for (off = 0; off < n; off += PAGE_SIZE)
+		copy_page(dst + off, src + off);
+}
+
+static int check(const char *name, size_t n, unsigned int da,
+		 unsigned int sa)
+{
+	/* Guard bytes around the destination must be left untouched */
+	if (memcmp(dst, ref, BUF_SIZE)) {
+		pr_err("copy_neon_test: %s mismatch, size %zu dst+%u src+%u\n",
+		       name, n, da, sa);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int test_memcpy(size_t n, unsigned int da, unsigned int sa)
+{
+	fill_pattern(dst, BUF_SIZE, 0x11);
+	fill_pattern(ref, BUF_SIZE, 0x11);
+	__memcpy_arm(ref + da, src + sa, n);
+	op_memcpy(n, da, sa);
+	return check("memcpy", n, da, sa);
+}
+
+static int test_memset(size_t n, unsigned int da, unsigned int sa)
+{
+	int err;
+
+	fill_pattern(dst, BUF_SIZE, 0x22);
+	fill_pattern(ref, BUF_SIZE, 0x22);
+	__memset_arm(ref + da, 0x5a, n);
+	op_memset(n, da, sa);
+	err = check("memset", n, da, sa);
+	if (err)
+		return err;
+
+	fill_pattern(dst, BUF_SIZE, 0x33);
+	fill_pattern(ref, BUF_SIZE, 0x33);
+	__memzero_arm(ref + da, n);
+	op_memzero(n, da, sa);
+	return check("memzero", n, da, sa);
+}
+
+static int run_checks(void)
+{
+	unsigned int i, j;
+	int err;
+
+	for (i = 0; sizes[i]; i++) {
+		for (j = 0; j < ARRAY_SIZE(aligns); j++) {
+			err = test_memcpy(sizes[i], aligns[j][0], aligns[j][1]);
+			if (!err)
+				err = test_memset(sizes[i], aligns[j][0],
+						  aligns[j][1]);
+			if (err)
+				return err;
+		}
+		cond_resched();
+	}
+
+	fill_pattern(dst, BUF_SIZE, 0x44);
+	fill_pattern(ref, BUF_SIZE, 0x44);
+	for (i = 0; i + PAGE_SIZE <= BUF_SIZE; i += PAGE_SIZE)
+		__copy_page_arm(ref + i, src + i);
+	op_copy_page(BUF_SIZE & PAGE_MASK, 0, 0);
+	return check("copy_page", BUF_SIZE & PAGE_MASK, 0, 0);
+}
+
+static void bench(const char *name,
+		  void (*op)(size_t, unsigned int, unsigned int))
+{
+	unsigned long neon, arm;
+	unsigned int i, j;
+	bool saved = neon_copy_enabled;
+
+	pr_info("copy_neon_test: %s bandwidth (MiB/s, integer -> NEON)\n",
+		name);
+	for (i = 0; sizes[i]; i++) {
+		for (j = 0; j < ARRAY_SIZE(aligns); j++) {
+			neon_copy_enabled = false;
+			arm = measure(op, sizes[i], aligns[j][0], aligns[j][1]);
+			neon_copy_enabled = true;
+			neon = measure(op, sizes[i], aligns[j][0],
+				       aligns[j][1]);
+			pr_info("  %7zu bytes dst+%-2u src+%-2u: %6lu -> %6lu\n",
+				sizes[i], aligns[j][0], aligns[j][1],
+				arm, neon);
+		}
+		cond_resched();
+	}
+	neon_copy_enabled = saved;
+}
+
+static int __init copy_neon_test_init(void)
+{
+	bool saved = neon_copy_enabled;
+	int err = -ENOMEM;
+
+	if (!cpu_has_neon()) {
+		pr_info("copy_neon_test: no NEON unit, nothing to test\n");
+		return -ENODEV;
+	}
+
+	/* vmalloc memory is page aligned, which copy_page() relies on */
+	src = vmalloc(BUF_SIZE);
+	dst = vmalloc(BUF_SIZE);
+	ref = vmalloc(BUF_SIZE);
+	if (!src || !dst || !ref)
+		goto out;
+
+	fill_pattern(src, BUF_SIZE, 0);
+
+	neon_copy_enabled = true;
+	err = run_checks();
+	neon_copy_enabled = saved;
+	if (err)
+		goto out;
+	pr_info("copy_neon_test: all checks passed\n");
+
+	bench("memcpy", op_memcpy);
+	bench("memset", op_memset);
+	bench("memzero", op_memzero);
+	bench("copy_page", op_copy_page);
+
+out:
+	vfree(ref);
+	vfree(dst);
+	vfree(src);
+	return err;
+}
+
+static void __exit copy_neon_test_exit(void)
+{
+}
+
+module_init(copy_neon_test_init);
+module_exit(copy_neon_test_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("NEON memcpy/memset/copy_page self-test and benchmark");
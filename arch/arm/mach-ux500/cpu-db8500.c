@@ -141,16 +141,24 @@ static struct resource db8500_pmu_resources[] = {
 };
 
 /*
- * The PMU IRQ lines of two cores are wired together into a single interrupt.
- * Bounce the interrupt to the other core if it's not ours.
+ * The PMU IRQ lines of the cores are wired together into a single interrupt.
+ * If it's not ours, pass it on to the next online core, round until it gets
+ * to the core whose counters overflowed. It then stays routed there, which
+ * is where the next overflow most likely comes from too.
  */
 static irqreturn_t db8500_pmu_handler(int irq, void *dev, irq_handler_t handler)
 {
 	irqreturn_t ret = handler(irq, dev);
-	int other = !smp_processor_id();
-
-	if (ret == IRQ_NONE && cpu_online(other))
-		irq_set_affinity(irq, cpumask_of(other));
+	int cpu = smp_processor_id();
+	int next;
+
+	if (ret == IRQ_NONE) {
+		next = cpumask_next(cpu, cpu_online_mask);
+		if (next >= nr_cpu_ids)
+			next = cpumask_first(cpu_online_mask);
+		if (next != cpu)
+			irq_set_affinity(irq, cpumask_of(next));
+	}
 
 	/*
 	 * We should be able to get away with the amount of IRQ_NONEs we give,
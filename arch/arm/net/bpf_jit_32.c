@@ -0,0 +1,760 @@
+/*
+ * Just-In-Time compiler for BPF filters on 32bit ARM
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; version 2 of the License.
+ */
+
+#include <linux/bitops.h>
+#include <linux/compiler.h>
+#include <linux/log2.h>
+#include <linux/moduleloader.h>
+#include <linux/netdevice.h>
+#include <linux/filter.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <asm/cacheflush.h>
+#include <asm/thread_info.h>
+#include <asm/unaligned.h>
+
+#include "bpf_jit_32.h"
+
+/*
+ * Conventions:
+ *  r0-r3, ip : scratch, r0/r1 also carry arguments to the C helpers
+ *  r4 : BPF A accumulator
+ *  r5 : BPF X accumulator
+ *  r6 : pointer to skb (first argument given to the JIT function)
+ *  r7 : skb->data
+ *  r8 : skb_headlen(skb)
+ *  sp .. sp + 63 : BPF_MEMWORDS scratch memory, when used
+ *
+ * The generated code is always A32, a Thumb-2 kernel reaches it through
+ * an interworking blx and gets back with the final pop {..., pc}.
+ */
+#define r_A		ARM_R4
+#define r_X		ARM_R5
+#define r_skb		ARM_R6
+#define r_skb_data	ARM_R7
+#define r_skb_hl	ARM_R8
+
+#define r_scratch	ARM_R3
+#define r_off		ARM_R1
+
+/* the C helpers return the value in the low word, an error in the high one */
+#ifdef __ARMEB__
+#define r_ret_val	ARM_R1
+#define r_ret_err	ARM_R0
+#else
+#define r_ret_val	ARM_R0
+#define r_ret_err	ARM_R1
+#endif
+
+#define SEEN_MEM	(1 << 0)
+#define SEEN_DATA	(1 << 1)
+#define SEEN_X		(1 << 2)
+
+#define SCRATCH_SIZE	(BPF_MEMWORDS * 4)
+#define SAVED_REGS	((1 << r_A) | (1 << r_X) | (1 << r_skb) | \
+			 (1 << r_skb_data) | (1 << r_skb_hl) | (1 << ARM_LR))
+
+int bpf_jit_enable __read_mostly;
+
+struct jit_ctx {
+	const struct sk_filter *skf;
+	unsigned int idx;
+	unsigned int prologue_len;
+	unsigned int epilogue_idx;
+	unsigned int ret0_idx;
+	u32 seen;
+	u32 *offsets;
+	u32 *target;
+};
+
+/*
+ * Slow path helpers, used when the bytes are not in the linear part of the
+ * skb or the offset is negative (SKF_NET_OFF and SKF_LL_OFF relative loads).
+ * They mirror load_pointer() in net/core/filter.c.
+ */
+static const void *jit_load_pointer(const struct sk_buff *skb, int k,
+				    unsigned int size, void *buffer)
+{
+	const u8 *ptr = NULL;
+
+	if (k >= 0)
+		return skb_header_pointer(skb, k, size, buffer);
+
+	if (k >= SKF_NET_OFF)
+		ptr = skb_network_header(skb) + k - SKF_NET_OFF;
+	else if (k >= SKF_LL_OFF)
+		ptr = skb_mac_header(skb) + k - SKF_LL_OFF;
+
+	if (ptr >= skb->head && ptr + size <= skb_tail_pointer(skb))
+		return ptr;
+	return NULL;
+}
+
+static u64 jit_get_skb_b(struct sk_buff *skb, int offset)
+{
+	const u8 *ptr;
+	u8 tmp;
+
+	ptr = jit_load_pointer(skb, offset, 1, &tmp);
+	if (ptr == NULL)
+		return 1ULL << 32;
+	return *ptr;
+}
+
+static u64 jit_get_skb_h(struct sk_buff *skb, int offset)
+{
+	const void *ptr;
+	u16 tmp;
+
+	ptr = jit_load_pointer(skb, offset, 2, &tmp);
+	if (ptr == NULL)
+		return 1ULL << 32;
+	return get_unaligned_be16(ptr);
+}
+
+static u64 jit_get_skb_w(struct sk_buff *skb, int offset)
+{
+	const void *ptr;
+	u32 tmp;
+
+	ptr = jit_load_pointer(skb, offset, 4, &tmp);
+	if (ptr == NULL)
+		return 1ULL << 32;
+	return get_unaligned_be32(ptr);
+}
+
+/* no hardware divider on most ARMv7 cores, use the libgcc one */
+static u32 jit_udiv(u32 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline void _emit(int cond, u32 inst, struct jit_ctx *ctx)
+{
+	/* instructions are always little endian, even on BE8 kernels */
+	if (ctx->target != NULL)
+		ctx->target[ctx->idx] = cpu_to_le32(inst | (cond << 28));
+
+	ctx->idx++;
+}
+
+static inline void emit(u32 inst, struct jit_ctx *ctx)
+{
+	_emit(ARM_COND_AL, inst, ctx);
+}
+
+/*
+ * Encode x as a rotated 8 bit immediate (operand2 of the data processing
+ * instructions), or return -1 if it cannot be expressed that way.
+ */
+static int imm8m(u32 x)
+{
+	u32 rot;
+
+	for (rot = 0; rot < 32; rot += 2) {
+		u32 imm8 = rot ? (x << rot) | (x >> (32 - rot)) : x;
+
+		if (imm8 <= 0xff)
+			return (rot << 7) | imm8;
+	}
+
+	return -1;
+}
+
+static void emit_mov_i(u8 rd, u32 val, struct jit_ctx *ctx)
+{
+	int imm12 = imm8m(val);
+
+	if (imm12 >= 0) {
+		emit(ARM_MOV_I(rd, imm12), ctx);
+		return;
+	}
+
+	imm12 = imm8m(~val);
+	if (imm12 >= 0) {
+		emit(ARM_MVN_I(rd, imm12), ctx);
+		return;
+	}
+
+	emit(ARM_MOVW(rd, val & 0xffff), ctx);
+	if (val > 0xffff)
+		emit(ARM_MOVT(rd, val >> 16), ctx);
+}
+
+/* always two instructions, so that both passes agree on the length */
+static void emit_mov_addr(u8 rd, const void *addr, struct jit_ctx *ctx)
+{
+	u32 val = (u32)addr;
+
+	emit(ARM_MOVW(rd, val & 0xffff), ctx);
+	emit(ARM_MOVT(rd, val >> 16), ctx);
+}
+
+static inline void emit_blx(const void *addr, struct jit_ctx *ctx)
+{
+	emit_mov_addr(ARM_IP, addr, ctx);
+	emit(ARM_BLX_R(ARM_IP), ctx);
+}
+
+/* load a 32 or 16 bit field at base + off */
+static void emit_ldr_field(u8 rd, u8 base, unsigned int off, int size,
+			   struct jit_ctx *ctx)
+{
+	if (size == 4) {
+		if (off < 4096) {
+			emit(ARM_LDR_I(rd, base, off), ctx);
+		} else {
+			emit_mov_i(ARM_IP, off, ctx);
+			emit(ARM_LDR_R(rd, base, ARM_IP), ctx);
+		}
+	} else {
+		if (off < 256) {
+			emit(ARM_LDRH_I(rd, base, off), ctx);
+		} else {
+			emit_mov_i(ARM_IP, off, ctx);
+			emit(ARM_LDRH_R(rd, base, ARM_IP), ctx);
+		}
+	}
+}
+
+/* rd = rd <op> k, with dp_op one of the ARM_INST_DP_* opcodes */
+static void emit_alu_k(u32 dp_op, u8 rd, u32 k, struct jit_ctx *ctx)
+{
+	int imm12 = imm8m(k);
+
+	if (imm12 >= 0) {
+		emit(ARM_DP(dp_op, rd, rd) | ARM_DP_I | imm12, ctx);
+	} else {
+		emit_mov_i(r_scratch, k, ctx);
+		emit(ARM_DP(dp_op, rd, rd) | r_scratch, ctx);
+	}
+}
+
+/* flag setting comparison (cmp or tst) of A against k */
+static void emit_test_k(u32 dp_op, u32 k, struct jit_ctx *ctx)
+{
+	int imm12 = imm8m(k);
+
+	if (imm12 >= 0) {
+		emit(ARM_DP(dp_op, 0, r_A) | ARM_DP_S | ARM_DP_I | imm12, ctx);
+	} else {
+		emit_mov_i(r_scratch, k, ctx);
+		emit(ARM_DP(dp_op, 0, r_A) | ARM_DP_S | r_scratch, ctx);
+	}
+}
+
+/* branch offset from the current instruction to an absolute index */
+static inline u32 b_imm(unsigned int tgt, struct jit_ctx *ctx)
+{
+	if (ctx->target == NULL)
+		return 0;
+	/* the pc is two instructions ahead of the branch */
+	return tgt - (ctx->idx + 2);
+}
+
+/* absolute index of BPF instruction i, offsets[] is relative to the body */
+static inline unsigned int bpf_idx(unsigned int i, struct jit_ctx *ctx)
+{
+	return ctx->prologue_len + ctx->offsets[i];
+}
+
+static inline void emit_err_ret(u8 cond, struct jit_ctx *ctx)
+{
+	_emit(cond, ARM_B(b_imm(ctx->ret0_idx, ctx)), ctx);
+}
+
+/*
+ * Load size bytes at offset r_off into rd, in host byte order.
+ * The inline fast path covers the linear part of the skb, anything else
+ * (including negative offsets) goes through the C helpers, whose failure
+ * makes the filter return 0 like the interpreter does.
+ */
+static void emit_load(int size, u8 rd, bool fast, struct jit_ctx *ctx)
+{
+	const void *helper;
+	unsigned int slow_len;
+
+	switch (size) {
+	case 4:
+		helper = jit_get_skb_w;
+		break;
+	case 2:
+		helper = jit_get_skb_h;
+		break;
+	default:
+		helper = jit_get_skb_b;
+		break;
+	}
+
+	/* mov, movw, movt, blx, cmp, bne [, mov] */
+	slow_len = 6 + (rd != r_ret_val);
+
+	if (fast) {
+		ctx->seen |= SEEN_DATA;
+		/* r_off <= headlen - size, both compared as unsigned */
+		emit(ARM_SUBS_I(r_scratch, r_skb_hl, size), ctx);
+		_emit(ARM_COND_HS, ARM_CMP_R(r_scratch, r_off), ctx);
+		switch (size) {
+		case 4:
+			_emit(ARM_COND_HS, ARM_LDR_R(rd, r_skb_data, r_off), ctx);
+#ifndef __ARMEB__
+			_emit(ARM_COND_HS, ARM_REV(rd, rd), ctx);
+#endif
+			break;
+		case 2:
+			_emit(ARM_COND_HS, ARM_LDRH_R(rd, r_skb_data, r_off), ctx);
+#ifndef __ARMEB__
+			_emit(ARM_COND_HS, ARM_REV16(rd, rd), ctx);
+#endif
+			break;
+		default:
+			_emit(ARM_COND_HS, ARM_LDRB_R(rd, r_skb_data, r_off), ctx);
+			break;
+		}
+		_emit(ARM_COND_HS, ARM_B(slow_len - 1), ctx);
+	}
+
+	emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
+	emit_blx(helper, ctx);
+	emit(ARM_CMP_I(r_ret_err, 0), ctx);
+	emit_err_ret(ARM_COND_NE, ctx);
+	if (rd != r_ret_val)
+		emit(ARM_MOV_R(rd, r_ret_val), ctx);
+}
+
+static void emit_cond_jump(u8 cond, unsigned int i, struct jit_ctx *ctx)
+{
+	const struct sock_filter *inst = &ctx->skf->insns[i];
+
+	if (inst->jt == inst->jf) {
+		if (inst->jt)
+			emit(ARM_B(b_imm(bpf_idx(i + 1 + inst->jt, ctx), ctx)),
+			     ctx);
+		return;
+	}
+
+	/* the ARM condition codes come in pairs, the low bit negates */
+	if (inst->jt == 0) {
+		_emit(cond ^ 1, ARM_B(b_imm(bpf_idx(i + 1 + inst->jf, ctx),
+					    ctx)), ctx);
+		return;
+	}
+
+	_emit(cond, ARM_B(b_imm(bpf_idx(i + 1 + inst->jt, ctx), ctx)), ctx);
+	if (inst->jf)
+		emit(ARM_B(b_imm(bpf_idx(i + 1 + inst->jf, ctx), ctx)), ctx);
+}
+
+static void build_prologue(struct jit_ctx *ctx)
+{
+	emit(ARM_PUSH(SAVED_REGS), ctx);
+	if (ctx->seen & SEEN_MEM)
+		emit(ARM_SUB_I(ARM_SP, ARM_SP, SCRATCH_SIZE), ctx);
+
+	emit(ARM_MOV_R(r_skb, ARM_R0), ctx);
+
+	if (ctx->seen & SEEN_DATA) {
+		emit_ldr_field(r_skb_data, r_skb,
+			       offsetof(struct sk_buff, data), 4, ctx);
+		emit_ldr_field(r_skb_hl, r_skb,
+			       offsetof(struct sk_buff, len), 4, ctx);
+		emit_ldr_field(r_scratch, r_skb,
+			       offsetof(struct sk_buff, data_len), 4, ctx);
+		emit(ARM_SUB_R(r_skb_hl, r_skb_hl, r_scratch), ctx);
+	}
+
+	emit(ARM_MOV_I(r_A, 0), ctx);
+	if (ctx->seen & SEEN_X)
+		emit(ARM_MOV_I(r_X, 0), ctx);
+}
+
+static void build_exit(struct jit_ctx *ctx)
+{
+	if (ctx->seen & SEEN_MEM)
+		emit(ARM_ADD_I(ARM_SP, ARM_SP, SCRATCH_SIZE), ctx);
+	emit(ARM_POP((SAVED_REGS & ~(1 << ARM_LR)) | (1 << ARM_PC)), ctx);
+}
+
+static void build_epilogue(struct jit_ctx *ctx)
+{
+	/* the return value is already in r0 */
+	build_exit(ctx);
+	/* error exit of the packet loads and of the division by X */
+	emit(ARM_MOV_I(ARM_R0, 0), ctx);
+	build_exit(ctx);
+}
+
+static int build_body(struct jit_ctx *ctx)
+{
+	const struct sk_filter *prog = ctx->skf;
+	const struct sock_filter *inst;
+	unsigned int i, off;
+	int size;
+	u32 k;
+
+	for (i = 0; i < prog->len; i++) {
+		inst = &prog->insns[i];
+		k = inst->k;
+
+		if (ctx->target == NULL)
+			ctx->offsets[i] = ctx->idx;
+
+		switch (inst->code) {
+		case BPF_S_LD_IMM:
+			emit_mov_i(r_A, k, ctx);
+			break;
+		case BPF_S_LD_W_LEN:
+			emit_ldr_field(r_A, r_skb, offsetof(struct sk_buff, len),
+				       4, ctx);
+			break;
+		case BPF_S_LD_MEM:
+			ctx->seen |= SEEN_MEM;
+			emit(ARM_LDR_I(r_A, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_LD_W_ABS:
+			size = 4;
+			goto load_abs;
+		case BPF_S_LD_H_ABS:
+			size = 2;
+			goto load_abs;
+		case BPF_S_LD_B_ABS:
+			size = 1;
+load_abs:
+			emit_mov_i(r_off, k, ctx);
+			emit_load(size, r_A, (int)k >= 0, ctx);
+			break;
+		case BPF_S_LD_W_IND:
+			size = 4;
+			goto load_ind;
+		case BPF_S_LD_H_IND:
+			size = 2;
+			goto load_ind;
+		case BPF_S_LD_B_IND:
+			size = 1;
+load_ind:
+			ctx->seen |= SEEN_X;
+			if (k == 0) {
+				emit(ARM_MOV_R(r_off, r_X), ctx);
+			} else if (imm8m(k) >= 0) {
+				emit(ARM_ADD_I(r_off, r_X, imm8m(k)), ctx);
+			} else {
+				emit_mov_i(r_off, k, ctx);
+				emit(ARM_ADD_R(r_off, r_off, r_X), ctx);
+			}
+			emit_load(size, r_A, true, ctx);
+			break;
+		case BPF_S_LDX_IMM:
+			ctx->seen |= SEEN_X;
+			emit_mov_i(r_X, k, ctx);
+			break;
+		case BPF_S_LDX_W_LEN:
+			ctx->seen |= SEEN_X;
+			emit_ldr_field(r_X, r_skb, offsetof(struct sk_buff, len),
+				       4, ctx);
+			break;
+		case BPF_S_LDX_MEM:
+			ctx->seen |= SEEN_X | SEEN_MEM;
+			emit(ARM_LDR_I(r_X, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_LDX_B_MSH:
+			/* X = (*(u8 *)(skb->data + k) & 0xf) << 2 */
+			ctx->seen |= SEEN_X;
+			emit_mov_i(r_off, k, ctx);
+			emit_load(1, ARM_R0, (int)k >= 0, ctx);
+			emit(ARM_AND_I(ARM_R0, ARM_R0, 0x0f), ctx);
+			emit(ARM_LSL_I(r_X, ARM_R0, 2), ctx);
+			break;
+		case BPF_S_ST:
+			ctx->seen |= SEEN_MEM;
+			emit(ARM_STR_I(r_A, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_STX:
+			ctx->seen |= SEEN_X | SEEN_MEM;
+			emit(ARM_STR_I(r_X, ARM_SP, k * 4), ctx);
+			break;
+		case BPF_S_ALU_ADD_K:
+			emit_alu_k(ARM_INST_DP_ADD, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_ADD_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_ADD_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_SUB_K:
+			emit_alu_k(ARM_INST_DP_SUB, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_SUB_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_SUB_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_MUL_K:
+			emit_mov_i(r_scratch, k, ctx);
+			emit(ARM_MUL(r_A, r_scratch, r_A), ctx);
+			break;
+		case BPF_S_ALU_MUL_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_MUL(r_A, r_X, r_A), ctx);
+			break;
+		case BPF_S_ALU_DIV_K:
+			/* k is the reciprocal computed by sk_chk_filter() */
+			emit_mov_i(r_scratch, k, ctx);
+			emit(ARM_UMULL(ARM_R2, r_A, r_scratch, r_A), ctx);
+			break;
+		case BPF_S_ALU_DIV_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_CMP_I(r_X, 0), ctx);
+			emit_err_ret(ARM_COND_EQ, ctx);
+			emit(ARM_MOV_R(ARM_R0, r_A), ctx);
+			emit(ARM_MOV_R(ARM_R1, r_X), ctx);
+			emit_blx(jit_udiv, ctx);
+			emit(ARM_MOV_R(r_A, ARM_R0), ctx);
+			break;
+		case BPF_S_ALU_OR_K:
+			emit_alu_k(ARM_INST_DP_ORR, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_OR_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_ORR_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_AND_K:
+			emit_alu_k(ARM_INST_DP_AND, r_A, k, ctx);
+			break;
+		case BPF_S_ALU_AND_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_AND_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_LSH_K:
+			/* an immediate shift cannot encode 32 and more */
+			if (k == 0)
+				break;
+			if (k < 32) {
+				emit(ARM_LSL_I(r_A, r_A, k), ctx);
+			} else {
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_LSL_R(r_A, r_A, r_scratch), ctx);
+			}
+			break;
+		case BPF_S_ALU_LSH_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_LSL_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_RSH_K:
+			/* "lsr #0" encodes a shift by 32 */
+			if (k == 0)
+				break;
+			if (k < 32) {
+				emit(ARM_LSR_I(r_A, r_A, k), ctx);
+			} else {
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_LSR_R(r_A, r_A, r_scratch), ctx);
+			}
+			break;
+		case BPF_S_ALU_RSH_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_LSR_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_NEG:
+			emit(ARM_RSB_I(r_A, r_A, 0), ctx);
+			break;
+		case BPF_S_JMP_JA:
+			emit(ARM_B(b_imm(bpf_idx(i + 1 + k, ctx), ctx)), ctx);
+			break;
+		case BPF_S_JMP_JEQ_K:
+			emit_test_k(ARM_INST_DP_CMP, k, ctx);
+			emit_cond_jump(ARM_COND_EQ, i, ctx);
+			break;
+		case BPF_S_JMP_JEQ_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_CMP_R(r_A, r_X), ctx);
+			emit_cond_jump(ARM_COND_EQ, i, ctx);
+			break;
+		case BPF_S_JMP_JGT_K:
+			emit_test_k(ARM_INST_DP_CMP, k, ctx);
+			emit_cond_jump(ARM_COND_HI, i, ctx);
+			break;
+		case BPF_S_JMP_JGT_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_CMP_R(r_A, r_X), ctx);
+			emit_cond_jump(ARM_COND_HI, i, ctx);
+			break;
+		case BPF_S_JMP_JGE_K:
+			emit_test_k(ARM_INST_DP_CMP, k, ctx);
+			emit_cond_jump(ARM_COND_HS, i, ctx);
+			break;
+		case BPF_S_JMP_JGE_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_CMP_R(r_A, r_X), ctx);
+			emit_cond_jump(ARM_COND_HS, i, ctx);
+			break;
+		case BPF_S_JMP_JSET_K:
+			emit_test_k(ARM_INST_DP_TST, k, ctx);
+			emit_cond_jump(ARM_COND_NE, i, ctx);
+			break;
+		case BPF_S_JMP_JSET_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_TST_R(r_A, r_X), ctx);
+			emit_cond_jump(ARM_COND_NE, i, ctx);
+			break;
+		case BPF_S_RET_A:
+			emit(ARM_MOV_R(ARM_R0, r_A), ctx);
+			goto ret;
+		case BPF_S_RET_K:
+			if (k == 0 && i != prog->len - 1) {
+				emit(ARM_B(b_imm(ctx->ret0_idx, ctx)), ctx);
+				break;
+			}
+			emit_mov_i(ARM_R0, k, ctx);
+ret:
+			/* the last instruction falls through to the epilogue */
+			if (i != prog->len - 1)
+				emit(ARM_B(b_imm(ctx->epilogue_idx, ctx)), ctx);
+			break;
+		case BPF_S_MISC_TAX:
+			ctx->seen |= SEEN_X;
+			emit(ARM_MOV_R(r_X, r_A), ctx);
+			break;
+		case BPF_S_MISC_TXA:
+			ctx->seen |= SEEN_X;
+			emit(ARM_MOV_R(r_A, r_X), ctx);
+			break;
+		case BPF_S_ANC_PROTOCOL:
+			emit_ldr_field(r_A, r_skb,
+				       offsetof(struct sk_buff, protocol), 2, ctx);
+#ifndef __ARMEB__
+			emit(ARM_REV16(r_A, r_A), ctx);
+#endif
+			break;
+		case BPF_S_ANC_MARK:
+			emit_ldr_field(r_A, r_skb, offsetof(struct sk_buff, mark),
+				       4, ctx);
+			break;
+		case BPF_S_ANC_QUEUE:
+			emit_ldr_field(r_A, r_skb,
+				       offsetof(struct sk_buff, queue_mapping),
+				       2, ctx);
+			break;
+		case BPF_S_ANC_RXHASH:
+			emit_ldr_field(r_A, r_skb, offsetof(struct sk_buff, rxhash),
+				       4, ctx);
+			break;
+		case BPF_S_ANC_IFINDEX:
+		case BPF_S_ANC_HATYPE:
+			emit_ldr_field(r_scratch, r_skb,
+				       offsetof(struct sk_buff, dev), 4, ctx);
+			emit(ARM_CMP_I(r_scratch, 0), ctx);
+			emit_err_ret(ARM_COND_EQ, ctx);
+			if (inst->code == BPF_S_ANC_IFINDEX) {
+				off = offsetof(struct net_device, ifindex);
+				emit_ldr_field(r_A, r_scratch, off, 4, ctx);
+			} else {
+				off = offsetof(struct net_device, type);
+				emit_ldr_field(r_A, r_scratch, off, 2, ctx);
+			}
+			break;
+		case BPF_S_ANC_CPU:
+			/* current_thread_info()->cpu */
+			emit(ARM_LSR_I(r_scratch, ARM_SP, ilog2(THREAD_SIZE)),
+			     ctx);
+			emit(ARM_LSL_I(r_scratch, r_scratch, ilog2(THREAD_SIZE)),
+			     ctx);
+			emit_ldr_field(r_A, r_scratch,
+				       offsetof(struct thread_info, cpu), 4, ctx);
+			break;
+		default:
+			/* PKTTYPE and NLATTR* are left to the interpreter */
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	struct jit_ctx ctx;
+	unsigned int body_len, alloc_size;
+
+	if (!bpf_jit_enable)
+		return;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.skf = fp;
+
+	ctx.offsets = kzalloc(4 * fp->len, GFP_KERNEL);
+	if (ctx.offsets == NULL)
+		return;
+
+	/*
+	 * Fake pass to fill in ctx.seen and the instruction offsets, every
+	 * BPF instruction has the same length in both passes.
+	 */
+	if (build_body(&ctx))
+		goto out;
+	body_len = ctx.idx;
+
+	ctx.idx = 0;
+	build_prologue(&ctx);
+	ctx.prologue_len = ctx.idx;
+	ctx.epilogue_idx = ctx.prologue_len + body_len;
+
+	/*
+	 * The epilogue is two identical exits around the MOV r0, #0 that
+	 * the error branches land on.
+	 */
+	ctx.idx = 0;
+	build_epilogue(&ctx);
+	ctx.ret0_idx = ctx.epilogue_idx + ctx.idx / 2;
+
+	alloc_size = (ctx.epilogue_idx + ctx.idx) * 4;
+	ctx.target = module_alloc(max_t(unsigned int, alloc_size,
+					sizeof(struct work_struct)));
+	if (ctx.target == NULL)
+		goto out;
+
+	ctx.idx = 0;
+	build_prologue(&ctx);
+	build_body(&ctx);
+	build_epilogue(&ctx);
+
+	if (ctx.idx * 4 != alloc_size) {
+		pr_err("bpf_jit_compile proglen=%u != oldproglen=%u\n",
+		       ctx.idx * 4, alloc_size);
+		module_free(NULL, ctx.target);
+		goto out;
+	}
+
+	flush_icache_range((u32)ctx.target, (u32)(ctx.target + ctx.idx));
+
+	if (bpf_jit_enable > 1) {
+		pr_err("flen=%d proglen=%u image=%p\n",
+		       fp->len, alloc_size, ctx.target);
+		print_hex_dump(KERN_ERR, "JIT code: ", DUMP_PREFIX_ADDRESS,
+			       16, 4, ctx.target, alloc_size, false);
+	}
+
+	fp->bpf_func = (void *)ctx.target;
+out:
+	kfree(ctx.offsets);
+}
+
+static void jit_free_defer(struct work_struct *arg)
+{
+	module_free(NULL, arg);
+}
+
+/* run from softirq, we must use a work_struct to call
+ * module_free() from process context
+ */
+void bpf_jit_free(struct sk_filter *fp)
+{
+	if (fp->bpf_func != sk_run_filter) {
+		struct work_struct *work = (struct work_struct *)fp->bpf_func;
+
+		INIT_WORK(work, jit_free_defer);
+		schedule_work(work);
+	}
+}
@@ -0,0 +1,134 @@
+/*
+ * Just-In-Time compiler for BPF filters on 32bit ARM
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; version 2 of the License.
+ */
+
+#ifndef PFILTER_OPCODES_ARM_H
+#define PFILTER_OPCODES_ARM_H
+
+#define ARM_R0	0
+#define ARM_R1	1
+#define ARM_R2	2
+#define ARM_R3	3
+#define ARM_R4	4
+#define ARM_R5	5
+#define ARM_R6	6
+#define ARM_R7	7
+#define ARM_R8	8
+#define ARM_R9	9
+#define ARM_R10	10
+#define ARM_FP	11
+#define ARM_IP	12
+#define ARM_SP	13
+#define ARM_LR	14
+#define ARM_PC	15
+
+#define ARM_COND_EQ		0x0
+#define ARM_COND_NE		0x1
+#define ARM_COND_CS		0x2
+#define ARM_COND_HS		ARM_COND_CS
+#define ARM_COND_CC		0x3
+#define ARM_COND_LO		ARM_COND_CC
+#define ARM_COND_MI		0x4
+#define ARM_COND_PL		0x5
+#define ARM_COND_VS		0x6
+#define ARM_COND_VC		0x7
+#define ARM_COND_HI		0x8
+#define ARM_COND_LS		0x9
+#define ARM_COND_GE		0xa
+#define ARM_COND_LT		0xb
+#define ARM_COND_GT		0xc
+#define ARM_COND_LE		0xd
+#define ARM_COND_AL		0xe
+
+/* register shift types */
+#define SRTYPE_LSL		0
+#define SRTYPE_LSR		1
+#define SRTYPE_ASR		2
+#define SRTYPE_ROR		3
+
+/* data processing opcodes, bits 24:21 */
+#define ARM_INST_DP_AND		0x0
+#define ARM_INST_DP_SUB		0x2
+#define ARM_INST_DP_RSB		0x3
+#define ARM_INST_DP_ADD		0x4
+#define ARM_INST_DP_TST		0x8
+#define ARM_INST_DP_CMP		0xa
+#define ARM_INST_DP_ORR		0xc
+#define ARM_INST_DP_MOV		0xd
+#define ARM_INST_DP_MVN		0xf
+
+#define ARM_DP_S		(1 << 20)	/* set flags */
+#define ARM_DP_I		(1 << 25)	/* immediate operand */
+
+#define ARM_DP(op, rd, rn)	(((op) << 21) | ((rn) << 16) | ((rd) << 12))
+
+/* data processing, register operand */
+#define ARM_AND_R(rd, rn, rm)	(ARM_DP(ARM_INST_DP_AND, rd, rn) | (rm))
+#define ARM_SUB_R(rd, rn, rm)	(ARM_DP(ARM_INST_DP_SUB, rd, rn) | (rm))
+#define ARM_ADD_R(rd, rn, rm)	(ARM_DP(ARM_INST_DP_ADD, rd, rn) | (rm))
+#define ARM_ORR_R(rd, rn, rm)	(ARM_DP(ARM_INST_DP_ORR, rd, rn) | (rm))
+#define ARM_MOV_R(rd, rm)	(ARM_DP(ARM_INST_DP_MOV, rd, 0) | (rm))
+#define ARM_CMP_R(rn, rm)	(ARM_DP(ARM_INST_DP_CMP, 0, rn) | ARM_DP_S | (rm))
+#define ARM_TST_R(rn, rm)	(ARM_DP(ARM_INST_DP_TST, 0, rn) | ARM_DP_S | (rm))
+
+/* data processing, rotated 8 bit immediate (see imm8m()) */
+#define ARM_AND_I(rd, rn, imm)	(ARM_DP(ARM_INST_DP_AND, rd, rn) | ARM_DP_I | (imm))
+#define ARM_SUB_I(rd, rn, imm)	(ARM_DP(ARM_INST_DP_SUB, rd, rn) | ARM_DP_I | (imm))
+#define ARM_SUBS_I(rd, rn, imm)	(ARM_SUB_I(rd, rn, imm) | ARM_DP_S)
+#define ARM_RSB_I(rd, rn, imm)	(ARM_DP(ARM_INST_DP_RSB, rd, rn) | ARM_DP_I | (imm))
+#define ARM_ADD_I(rd, rn, imm)	(ARM_DP(ARM_INST_DP_ADD, rd, rn) | ARM_DP_I | (imm))
+#define ARM_ORR_I(rd, rn, imm)	(ARM_DP(ARM_INST_DP_ORR, rd, rn) | ARM_DP_I | (imm))
+#define ARM_MOV_I(rd, imm)	(ARM_DP(ARM_INST_DP_MOV, rd, 0) | ARM_DP_I | (imm))
+#define ARM_MVN_I(rd, imm)	(ARM_DP(ARM_INST_DP_MVN, rd, 0) | ARM_DP_I | (imm))
+#define ARM_CMP_I(rn, imm)	(ARM_DP(ARM_INST_DP_CMP, 0, rn) | ARM_DP_S | ARM_DP_I | (imm))
+#define ARM_TST_I(rn, imm)	(ARM_DP(ARM_INST_DP_TST, 0, rn) | ARM_DP_S | ARM_DP_I | (imm))
+
+/* shifts, as "mov rd, rm, <type> #imm" and "mov rd, rm, <type> rs" */
+#define ARM_SHIFT_I(rd, rm, type, imm) \
+	(ARM_MOV_R(rd, rm) | (((imm) & 0x1f) << 7) | ((type) << 5))
+#define ARM_SHIFT_R(rd, rm, type, rs) \
+	(ARM_MOV_R(rd, rm) | ((rs) << 8) | ((type) << 5) | (1 << 4))
+#define ARM_LSL_I(rd, rm, imm)	ARM_SHIFT_I(rd, rm, SRTYPE_LSL, imm)
+#define ARM_LSR_I(rd, rm, imm)	ARM_SHIFT_I(rd, rm, SRTYPE_LSR, imm)
+#define ARM_LSL_R(rd, rm, rs)	ARM_SHIFT_R(rd, rm, SRTYPE_LSL, rs)
+#define ARM_LSR_R(rd, rm, rs)	ARM_SHIFT_R(rd, rm, SRTYPE_LSR, rs)
+
+/* multiplies */
+#define ARM_MUL(rd, rm, rs)	(0x00000090 | ((rd) << 16) | ((rs) << 8) | (rm))
+#define ARM_UMULL(rdlo, rdhi, rm, rs) \
+	(0x00800090 | ((rdhi) << 16) | ((rdlo) << 12) | ((rs) << 8) | (rm))
+
+/* 16 bit immediate moves (ARMv6T2 and later) */
+#define ARM_MOVW(rd, imm) \
+	(0x03000000 | (((imm) & 0xf000) << 4) | ((rd) << 12) | ((imm) & 0x0fff))
+#define ARM_MOVT(rd, imm) \
+	(0x03400000 | (((imm) & 0xf000) << 4) | ((rd) << 12) | ((imm) & 0x0fff))
+
+/* loads and stores, immediate offset: 12 bits for words and bytes ... */
+#define ARM_LDR_I(rt, rn, off)	(0x05900000 | ((rn) << 16) | ((rt) << 12) | (off))
+#define ARM_STR_I(rt, rn, off)	(0x05800000 | ((rn) << 16) | ((rt) << 12) | (off))
+#define ARM_LDRB_I(rt, rn, off)	(0x05d00000 | ((rn) << 16) | ((rt) << 12) | (off))
+/* ... 8 bits for halfwords */
+#define ARM_LDRH_I(rt, rn, off)	(0x01d000b0 | ((rn) << 16) | ((rt) << 12) | \
+				 (((off) & 0xf0) << 4) | ((off) & 0x0f))
+
+/* loads, register offset */
+#define ARM_LDR_R(rt, rn, rm)	(0x07900000 | ((rn) << 16) | ((rt) << 12) | (rm))
+#define ARM_LDRB_R(rt, rn, rm)	(0x07d00000 | ((rn) << 16) | ((rt) << 12) | (rm))
+#define ARM_LDRH_R(rt, rn, rm)	(0x019000b0 | ((rn) << 16) | ((rt) << 12) | (rm))
+
+#define ARM_PUSH(reg_set)	(0x092d0000 | (reg_set))
+#define ARM_POP(reg_set)	(0x08bd0000 | (reg_set))
+
+#define ARM_B(imm24)		(0x0a000000 | ((imm24) & 0x00ffffff))
+#define ARM_BLX_R(rm)		(0x012fff30 | (rm))
+
+/* byte reversal (ARMv6 and later) */
+#define ARM_REV(rd, rm)		(0x06bf0f30 | ((rd) << 12) | (rm))
+#define ARM_REV16(rd, rm)	(0x06bf0fb0 | ((rd) << 12) | (rm))
+
+#endif /* PFILTER_OPCODES_ARM_H */
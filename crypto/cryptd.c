@@ -27,11 +27,18 @@
 #include <linux/kernel.h>
 #include <linux/list.h>
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <linux/scatterlist.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
 
 #define CRYPTD_MAX_CPU_QLEN 100
+#define CRYPTD_MAX_BATCH 16
+
+static unsigned int cryptd_batch = 8;
+module_param_named(batch, cryptd_batch, uint, 0644);
+MODULE_PARM_DESC(batch, "Maximum number of requests for the same tfm "
+			"processed per worker run (1 disables batching)");
 
 struct cryptd_cpu_queue {
 	struct crypto_queue queue;
@@ -128,34 +135,75 @@ static int cryptd_enqueue_request(struct cryptd_queue *queue,
 	return err;
 }
 
-/* Called in workqueue context, do one real cryption work (via
- * req->complete) and reschedule itself if there are more work to
- * do. */
+/*
+ * Dequeue up to max requests that share the tfm of the request at the
+ * head of the queue.  Backlogged requests that get moved into the queue
+ * on the way are returned in backlog[] so that they can be notified once
+ * we no longer run with softirqs disabled.  Must be called with bottom
+ * halves and preemption disabled.
+ */
+static unsigned int cryptd_dequeue_batch(struct crypto_queue *queue,
+					 struct crypto_async_request **reqs,
+					 struct crypto_async_request **backlog,
+					 unsigned int *nbacklog,
+					 unsigned int max)
+{
+	struct crypto_async_request *req, *bl;
+	struct crypto_tfm *tfm = NULL;
+	unsigned int n = 0;
+
+	*nbacklog = 0;
+	while (n < max && queue->qlen) {
+		req = list_entry(queue->list.next,
+				 struct crypto_async_request, list);
+		if (tfm && req->tfm != tfm)
+			break;
+
+		bl = crypto_get_backlog(queue);
+		req = crypto_dequeue_request(queue);
+		if (!req)
+			break;
+
+		if (bl)
+			backlog[(*nbacklog)++] = bl;
+		reqs[n++] = req;
+		tfm = req->tfm;
+	}
+
+	return n;
+}
+
+/* Called in workqueue context, do the real cryption work (via
+ * req->complete) for a batch of requests on the same tfm and
+ * reschedule itself if there are more work to do. */
 static void cryptd_queue_worker(struct work_struct *work)
 {
 	struct cryptd_cpu_queue *cpu_queue;
-	struct crypto_async_request *req, *backlog;
+	struct crypto_async_request *reqs[CRYPTD_MAX_BATCH];
+	struct crypto_async_request *backlog[CRYPTD_MAX_BATCH];
+	unsigned int i, n, nbacklog;
 
 	cpu_queue = container_of(work, struct cryptd_cpu_queue, work);
 	/*
-	 * Only handle one request at a time to avoid hogging crypto workqueue.
+	 * Consecutive requests for the same tfm are handled back-to-back so
+	 * that the expanded key and cipher state stay hot, but the batch is
+	 * bounded to avoid hogging the crypto workqueue.
 	 * preempt_disable/enable is used to prevent being preempted by
 	 * cryptd_enqueue_request(). local_bh_disable/enable is used to prevent
 	 * cryptd_enqueue_request() being accessed from software interrupts.
 	 */
 	local_bh_disable();
 	preempt_disable();
-	backlog = crypto_get_backlog(&cpu_queue->queue);
-	req = crypto_dequeue_request(&cpu_queue->queue);
+	n = cryptd_dequeue_batch(&cpu_queue->queue, reqs, backlog, &nbacklog,
+				 clamp_t(unsigned int, cryptd_batch, 1,
+					 CRYPTD_MAX_BATCH));
 	preempt_enable();
 	local_bh_enable();
 
-	if (!req)
-		return;
-
-	if (backlog)
-		backlog->complete(backlog, -EINPROGRESS);
-	req->complete(req, 0);
+	for (i = 0; i < nbacklog; i++)
+		backlog[i]->complete(backlog[i], -EINPROGRESS);
+	for (i = 0; i < n; i++)
+		reqs[i]->complete(reqs[i], 0);
 
 	if (cpu_queue->queue.qlen)
 		queue_work(kcrypto_wq, &cpu_queue->work);
@@ -28,6 +28,7 @@
 #include <linux/gfp.h>
 #include <linux/module.h>
 #include <linux/scatterlist.h>
+#include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/moduleparam.h>
 #include <linux/jiffies.h>
@@ -52,6 +53,12 @@
  */
 static unsigned int sec;
 
+/*
+ * Number of requests kept in flight by the multibuffer speed tests
+ */
+#define TCRYPT_MAX_MB	64
+static unsigned int num_mb = 8;
+
 static char *alg = NULL;
 static u32 type;
 static u32 mask;
@@ -719,6 +726,238 @@ out:
 	crypto_free_ahash(tfm);
 }
 
+struct test_mb_acipher_data {
+	struct scatterlist sg;
+	struct ablkcipher_request *req;
+	struct tcrypt_result result;
+	char *buf;
+};
+
+static inline int do_one_acipher_op(struct ablkcipher_request *req, int ret)
+{
+	if (ret == -EINPROGRESS || ret == -EBUSY) {
+		struct tcrypt_result *tr = req->base.data;
+
+		ret = wait_for_completion_interruptible(&tr->completion);
+		if (!ret)
+			ret = tr->err;
+		INIT_COMPLETION(tr->completion);
+	}
+	return ret;
+}
+
+/*
+ * Submit num_mb requests before waiting for any of them, so that an
+ * asynchronous implementation sees a full queue it can batch from.
+ */
+static int do_mb_acipher_op(struct test_mb_acipher_data *data, int enc,
+			    unsigned int num_mb)
+{
+	int rc[TCRYPT_MAX_MB];
+	int i, ret = 0;
+
+	for (i = 0; i < num_mb; i++) {
+		if (enc == ENCRYPT)
+			rc[i] = crypto_ablkcipher_encrypt(data[i].req);
+		else
+			rc[i] = crypto_ablkcipher_decrypt(data[i].req);
+	}
+
+	for (i = 0; i < num_mb; i++) {
+		rc[i] = do_one_acipher_op(data[i].req, rc[i]);
+		if (rc[i]) {
+			printk(KERN_ERR "concurrent request %d error %d\n",
+			       i, rc[i]);
+			ret = rc[i];
+		}
+	}
+
+	return ret;
+}
+
+static int test_mb_acipher_jiffies(struct test_mb_acipher_data *data,
+				   int enc, int blen, int sec,
+				   unsigned int num_mb)
+{
+	unsigned long start, end;
+	int bcount;
+	int ret;
+
+	for (start = jiffies, end = start + sec * HZ, bcount = 0;
+	     time_before(jiffies, end); bcount++) {
+		ret = do_mb_acipher_op(data, enc, num_mb);
+		if (ret)
+			return ret;
+	}
+
+	pr_cont("%d operations in %d seconds (%ld bytes)\n",
+		bcount * num_mb, sec, (long)bcount * blen * num_mb);
+	return 0;
+}
+
+static int test_mb_acipher_cycles(struct test_mb_acipher_data *data,
+				  int enc, int blen, unsigned int num_mb)
+{
+	unsigned long cycles = 0;
+	int ret = 0;
+	int i;
+
+	/* Warm-up run. */
+	for (i = 0; i < 4; i++) {
+		ret = do_mb_acipher_op(data, enc, num_mb);
+		if (ret)
+			goto out;
+	}
+
+	/* The real thing. */
+	for (i = 0; i < 8; i++) {
+		cycles_t start, end;
+
+		start = get_cycles();
+		ret = do_mb_acipher_op(data, enc, num_mb);
+		end = get_cycles();
+
+		if (ret)
+			goto out;
+
+		cycles += end - start;
+	}
+
+out:
+	if (ret == 0)
+		pr_cont("1 operation in %lu cycles (%d bytes)\n",
+			(cycles + 4) / (8 * num_mb), blen);
+
+	return ret;
+}
+
+static void test_mb_acipher_speed(const char *algo, int enc, unsigned int sec,
+				  struct cipher_speed_template *template,
+				  unsigned int tcount, u8 *keysize)
+{
+	struct test_mb_acipher_data *data;
+	struct crypto_ablkcipher *tfm;
+	unsigned int i, j, iv_len;
+	const char *key;
+	const char *e;
+	char iv[128];
+	u32 *b_size;
+	int ret;
+
+	if (enc == ENCRYPT)
+		e = "encryption";
+	else
+		e = "decryption";
+
+	if (!num_mb || num_mb > TCRYPT_MAX_MB) {
+		pr_err("invalid num_mb %u\n", num_mb);
+		return;
+	}
+
+	data = kcalloc(num_mb, sizeof(*data), GFP_KERNEL);
+	if (!data)
+		return;
+
+	tfm = crypto_alloc_ablkcipher(algo, 0, 0);
+	if (IS_ERR(tfm)) {
+		pr_err("failed to load transform for %s: %ld\n",
+		       algo, PTR_ERR(tfm));
+		goto out_free_data;
+	}
+
+	printk(KERN_INFO "\ntesting speed of multibuffer %s (%s) %s\n", algo,
+	       crypto_tfm_alg_driver_name(crypto_ablkcipher_tfm(tfm)), e);
+
+	for (i = 0; i < num_mb; i++) {
+		data[i].buf = kmalloc(PAGE_SIZE * TVMEMSIZE, GFP_KERNEL);
+		data[i].req = ablkcipher_request_alloc(tfm, GFP_KERNEL);
+		if (!data[i].buf || !data[i].req) {
+			pr_err("request allocation failure\n");
+			goto out_free_req;
+		}
+
+		init_completion(&data[i].result.completion);
+		ablkcipher_request_set_callback(data[i].req,
+						CRYPTO_TFM_REQ_MAY_BACKLOG,
+						tcrypt_complete,
+						&data[i].result);
+	}
+
+	i = 0;
+	do {
+		b_size = block_sizes;
+		do {
+			if (*b_size > TVMEMSIZE * PAGE_SIZE) {
+				pr_err("template (%u) too big for "
+				       "buffer (%lu)\n", *b_size,
+				       TVMEMSIZE * PAGE_SIZE);
+				goto out_free_req;
+			}
+
+			pr_info("test %u (%d bit key, %d byte blocks, "
+				"%u in flight): ", i, *keysize * 8, *b_size,
+				num_mb);
+
+			/* set key, plain text and IV */
+			memset(tvmem[0], 0xff, PAGE_SIZE);
+			key = tvmem[0];
+			for (j = 0; j < tcount; j++) {
+				if (template[j].klen == *keysize) {
+					key = template[j].key;
+					break;
+				}
+			}
+
+			crypto_ablkcipher_clear_flags(tfm, ~0);
+			ret = crypto_ablkcipher_setkey(tfm, key, *keysize);
+			if (ret) {
+				pr_err("setkey() failed flags=%x\n",
+				       crypto_ablkcipher_get_flags(tfm));
+				goto out_free_req;
+			}
+
+			iv_len = crypto_ablkcipher_ivsize(tfm);
+			if (iv_len)
+				memset(&iv, 0xff, iv_len);
+
+			for (j = 0; j < num_mb; j++) {
+				memset(data[j].buf, 0xff, *b_size);
+				sg_init_one(&data[j].sg, data[j].buf, *b_size);
+				ablkcipher_request_set_crypt(data[j].req,
+							     &data[j].sg,
+							     &data[j].sg,
+							     *b_size, iv);
+			}
+
+			if (sec)
+				ret = test_mb_acipher_jiffies(data, enc,
+							      *b_size, sec,
+							      num_mb);
+			else
+				ret = test_mb_acipher_cycles(data, enc,
+							     *b_size, num_mb);
+
+			if (ret) {
+				pr_err("%s() failed flags=%x\n", e,
+				       crypto_ablkcipher_get_flags(tfm));
+				break;
+			}
+			b_size++;
+			i++;
+		} while (*b_size);
+		keysize++;
+	} while (*keysize);
+
+out_free_req:
+	for (i = 0; i < num_mb; i++) {
+		ablkcipher_request_free(data[i].req);
+		kfree(data[i].buf);
+	}
+	crypto_free_ablkcipher(tfm);
+out_free_data:
+	kfree(data);
+}
+
 static void test_available(void)
 {
 	char **name = check;
@@ -1231,6 +1470,40 @@ static int do_test(int m)
 	case 499:
 		break;
 
+	case 500:
+		/* fall through */
+
+	case 501:
+		test_mb_acipher_speed("cbc(aes)", ENCRYPT, sec, NULL, 0,
+				      speed_template_16_24_32);
+		test_mb_acipher_speed("cbc(aes)", DECRYPT, sec, NULL, 0,
+				      speed_template_16_24_32);
+		if (mode > 500 && mode < 600) break;
+
+	case 502:
+		test_mb_acipher_speed("cryptd(cbc(aes))", ENCRYPT, sec, NULL, 0,
+				      speed_template_16_24_32);
+		test_mb_acipher_speed("cryptd(cbc(aes))", DECRYPT, sec, NULL, 0,
+				      speed_template_16_24_32);
+		if (mode > 500 && mode < 600) break;
+
+	case 503:
+		test_mb_acipher_speed("ctr(aes)", ENCRYPT, sec, NULL, 0,
+				      speed_template_16_24_32);
+		test_mb_acipher_speed("cryptd(ctr(aes))", ENCRYPT, sec, NULL, 0,
+				      speed_template_16_24_32);
+		if (mode > 500 && mode < 600) break;
+
+	case 504:
+		test_mb_acipher_speed("xts(aes)", ENCRYPT, sec, NULL, 0,
+				      speed_template_32_48_64);
+		test_mb_acipher_speed("cryptd(xts(aes))", ENCRYPT, sec, NULL, 0,
+				      speed_template_32_48_64);
+		if (mode > 500 && mode < 600) break;
+
+	case 599:
+		break;
+
 	case 1000:
 		test_available();
 		break;
@@ -1299,6 +1572,9 @@ module_param(mode, int, 0);
 module_param(sec, uint, 0);
 MODULE_PARM_DESC(sec, "Length in seconds of speed tests "
 		      "(defaults to zero which uses CPU cycles instead)");
+module_param(num_mb, uint, 0000);
+MODULE_PARM_DESC(num_mb, "Number of concurrent requests to be used in "
+			 "multibuffer speed tests (defaults to 8)");
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Quick & dirty crypto testing module");
@@ -0,0 +1,397 @@
+/*
+ * drivers/cpufreq/cpufreq_sched.c
+ *
+ * This software is licensed under the terms of the GNU General Public
+ * License version 2, as published by the Free Software Foundation, and
+ * may be copied, distributed, and modified under those terms.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * A governor driven by the scheduler: instead of sampling idle time from
+ * a timer, it is told about utilization changes from enqueue, dequeue
+ * and the tick, and picks the frequency that fits the per-entity load
+ * tracking utilization of the busiest cpu of the policy with some
+ * headroom. Frequency changes are rate limited by the transition
+ * latency of the driver.
+ */
+
+#include <linux/cpu.h>
+#include <linux/cpumask.h>
+#include <linux/cpufreq.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/rwsem.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+/*
+ * Rate limit is this many times the transition latency of the driver,
+ * but never less than MIN_RATE_LIMIT_US.
+ */
+#define LATENCY_MULTIPLIER	50
+#define MIN_RATE_LIMIT_US	500
+
+static int active_count;
+
+struct cpufreq_sched_cpuinfo {
+	struct update_util_data update_util;
+	struct cpufreq_policy *policy;
+	/* the fields below are only used in the entry of policy->cpu */
+	raw_spinlock_t lock; /* protects last_update and next_freq */
+	u64 last_update;
+	unsigned int next_freq;
+	u64 rate_limit_ns;
+	struct rw_semaphore enable_sem;
+	int governor_enabled;
+};
+
+static DEFINE_PER_CPU(struct cpufreq_sched_cpuinfo, cpuinfo);
+
+/* realtime thread handles frequency changes, kicked from irq_work */
+static struct task_struct *speedchange_task;
+static struct irq_work speedchange_irq_work;
+static cpumask_t speedchange_cpumask;
+static spinlock_t speedchange_cpumask_lock;
+static struct mutex gov_lock;
+
+/* Minimum time between frequency changes, 0 derives it from the driver */
+static unsigned int rate_limit_us;
+
+/* Utilization of the busiest cpu is scaled by 1 + headroom/100 */
+#define DEFAULT_HEADROOM 25
+static unsigned int headroom = DEFAULT_HEADROOM;
+
+static u64 policy_rate_limit_ns(struct cpufreq_policy *policy)
+{
+	unsigned int us = rate_limit_us;
+
+	if (!us)
+		us = max_t(unsigned int, MIN_RATE_LIMIT_US,
+			   policy->cpuinfo.transition_latency / NSEC_PER_USEC *
+			   LATENCY_MULTIPLIER);
+	return (u64)us * NSEC_PER_USEC;
+}
+
+/*
+ * The frequency at which the busiest cpu of @policy would be busy
+ * 1 / (1 + headroom/100) of the time.
+ *
+ * The utilization is not frequency invariant: it is the fraction of time
+ * the cpu was busy at the frequency it has been running at, so it is
+ * scaled from policy->cur rather than from the maximum frequency.
+ */
+static unsigned int choose_freq(struct cpufreq_policy *policy)
+{
+	unsigned int cur_freq = policy->cur;
+	unsigned long util = 0;
+	unsigned int j;
+	u64 freq;
+
+	for_each_cpu(j, policy->cpus)
+		util = max(util, sched_get_cpu_util(j));
+
+	freq = cur_freq + cur_freq / 100 * headroom;
+	freq = (freq * util) >> SCHED_POWER_SHIFT;
+
+	return clamp_t(unsigned int, freq, policy->min, policy->max);
+}
+
+static void cpufreq_sched_update_util(struct update_util_data *data,
+				      int cpu, u64 time)
+{
+	struct cpufreq_sched_cpuinfo *pcpu =
+		container_of(data, struct cpufreq_sched_cpuinfo, update_util);
+	struct cpufreq_policy *policy = pcpu->policy;
+	struct cpufreq_sched_cpuinfo *ppol = &per_cpu(cpuinfo, policy->cpu);
+	unsigned int freq;
+	int kick = 0;
+
+	raw_spin_lock(&ppol->lock);
+
+	if (time - ppol->last_update < ppol->rate_limit_ns)
+		goto out;
+
+	freq = choose_freq(policy);
+	if (freq != ppol->next_freq) {
+		ppol->next_freq = freq;
+		ppol->last_update = time;
+		kick = 1;
+	}
+
+out:
+	raw_spin_unlock(&ppol->lock);
+
+	if (kick) {
+		spin_lock(&speedchange_cpumask_lock);
+		cpumask_set_cpu(policy->cpu, &speedchange_cpumask);
+		spin_unlock(&speedchange_cpumask_lock);
+		/* wake_up_process() would take a runqueue lock, defer it */
+		irq_work_queue(&speedchange_irq_work);
+	}
+}
+
+static void cpufreq_sched_irq_work(struct irq_work *work)
+{
+	wake_up_process(speedchange_task);
+}
+
+static int cpufreq_sched_speedchange_task(void *data)
+{
+	unsigned int cpu;
+	cpumask_t tmp_mask;
+	unsigned long flags;
+	struct cpufreq_sched_cpuinfo *pcpu;
+
+	while (1) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+
+		if (cpumask_empty(&speedchange_cpumask)) {
+			spin_unlock_irqrestore(&speedchange_cpumask_lock,
+					       flags);
+			schedule();
+
+			if (kthread_should_stop())
+				break;
+
+			spin_lock_irqsave(&speedchange_cpumask_lock, flags);
+		}
+
+		set_current_state(TASK_RUNNING);
+		tmp_mask = speedchange_cpumask;
+		cpumask_clear(&speedchange_cpumask);
+		spin_unlock_irqrestore(&speedchange_cpumask_lock, flags);
+
+		for_each_cpu(cpu, &tmp_mask) {
+			unsigned int freq;
+
+			pcpu = &per_cpu(cpuinfo, cpu);
+			if (!down_read_trylock(&pcpu->enable_sem))
+				continue;
+			if (!pcpu->governor_enabled) {
+				up_read(&pcpu->enable_sem);
+				continue;
+			}
+
+			freq = ACCESS_ONCE(pcpu->next_freq);
+			if (freq != pcpu->policy->cur)
+				__cpufreq_driver_target(pcpu->policy, freq,
+							CPUFREQ_RELATION_L);
+
+			up_read(&pcpu->enable_sem);
+		}
+	}
+
+	return 0;
+}
+
+static ssize_t show_rate_limit_us(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct kobject *kobj,
+				   struct attribute *attr, const char *buf,
+				   size_t count)
+{
+	int ret;
+	unsigned long val;
+	unsigned int cpu;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	rate_limit_us = val;
+
+	mutex_lock(&gov_lock);
+	for_each_online_cpu(cpu) {
+		struct cpufreq_sched_cpuinfo *pcpu = &per_cpu(cpuinfo, cpu);
+		unsigned long flags;
+
+		down_read(&pcpu->enable_sem);
+		if (pcpu->governor_enabled && pcpu->policy->cpu == cpu) {
+			raw_spin_lock_irqsave(&pcpu->lock, flags);
+			pcpu->rate_limit_ns = policy_rate_limit_ns(pcpu->policy);
+			raw_spin_unlock_irqrestore(&pcpu->lock, flags);
+		}
+		up_read(&pcpu->enable_sem);
+	}
+	mutex_unlock(&gov_lock);
+
+	return count;
+}
+
+static struct global_attr rate_limit_us_attr = __ATTR(rate_limit_us, 0644,
+		show_rate_limit_us, store_rate_limit_us);
+
+static ssize_t show_headroom(struct kobject *kobj,
+			     struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", headroom);
+}
+
+static ssize_t store_headroom(struct kobject *kobj,
+			      struct attribute *attr, const char *buf,
+			      size_t count)
+{
+	int ret;
+	unsigned long val;
+
+	ret = strict_strtoul(buf, 0, &val);
+	if (ret < 0)
+		return ret;
+	if (val > 100)
+		return -EINVAL;
+	headroom = val;
+	return count;
+}
+
+static struct global_attr headroom_attr = __ATTR(headroom, 0644,
+		show_headroom, store_headroom);
+
+static struct attribute *sched_attributes[] = {
+	&rate_limit_us_attr.attr,
+	&headroom_attr.attr,
+	NULL,
+};
+
+static struct attribute_group sched_attr_group = {
+	.attrs = sched_attributes,
+	.name = "sched",
+};
+
+static int cpufreq_governor_sched(struct cpufreq_policy *policy,
+		unsigned int event)
+{
+	int rc;
+	unsigned int j;
+	struct cpufreq_sched_cpuinfo *pcpu;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		mutex_lock(&gov_lock);
+
+		pcpu = &per_cpu(cpuinfo, policy->cpu);
+		down_write(&pcpu->enable_sem);
+		pcpu->last_update = 0;
+		pcpu->next_freq = policy->cur;
+		pcpu->rate_limit_ns = policy_rate_limit_ns(policy);
+		pcpu->governor_enabled = 1;
+		up_write(&pcpu->enable_sem);
+
+		for_each_cpu(j, policy->cpus) {
+			pcpu = &per_cpu(cpuinfo, j);
+			pcpu->policy = policy;
+			cpufreq_set_update_util_data(j, &pcpu->update_util);
+		}
+
+		/* Create sysfs entries only once */
+		if (++active_count > 1) {
+			mutex_unlock(&gov_lock);
+			return 0;
+		}
+
+		rc = sysfs_create_group(cpufreq_global_kobject,
+				&sched_attr_group);
+		mutex_unlock(&gov_lock);
+		return rc;
+
+	case CPUFREQ_GOV_STOP:
+		mutex_lock(&gov_lock);
+		for_each_cpu(j, policy->cpus)
+			cpufreq_set_update_util_data(j, NULL);
+		/* No scheduler callback is running past this point */
+		synchronize_sched();
+
+		pcpu = &per_cpu(cpuinfo, policy->cpu);
+		down_write(&pcpu->enable_sem);
+		pcpu->governor_enabled = 0;
+		up_write(&pcpu->enable_sem);
+
+		if (--active_count > 0) {
+			mutex_unlock(&gov_lock);
+			return 0;
+		}
+
+		sysfs_remove_group(cpufreq_global_kobject,
+				&sched_attr_group);
+		mutex_unlock(&gov_lock);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		if (policy->max < policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->max, CPUFREQ_RELATION_H);
+		else if (policy->min > policy->cur)
+			__cpufreq_driver_target(policy,
+					policy->min, CPUFREQ_RELATION_L);
+		break;
+	}
+	return 0;
+}
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+static
+#endif
+struct cpufreq_governor cpufreq_gov_sched = {
+	.name = "sched",
+	.governor = cpufreq_governor_sched,
+	.max_transition_latency = 10000000,
+	.owner = THIS_MODULE,
+};
+
+static int __init cpufreq_sched_init(void)
+{
+	unsigned int i;
+	struct cpufreq_sched_cpuinfo *pcpu;
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO-1 };
+
+	for_each_possible_cpu(i) {
+		pcpu = &per_cpu(cpuinfo, i);
+		pcpu->update_util.func = cpufreq_sched_update_util;
+		raw_spin_lock_init(&pcpu->lock);
+		init_rwsem(&pcpu->enable_sem);
+	}
+
+	spin_lock_init(&speedchange_cpumask_lock);
+	mutex_init(&gov_lock);
+	init_irq_work(&speedchange_irq_work, cpufreq_sched_irq_work);
+	speedchange_task =
+		kthread_create(cpufreq_sched_speedchange_task, NULL,
+			       "cfsched");
+	if (IS_ERR(speedchange_task))
+		return PTR_ERR(speedchange_task);
+
+	sched_setscheduler_nocheck(speedchange_task, SCHED_FIFO, &param);
+	get_task_struct(speedchange_task);
+
+	/* NB: wake up so the thread does not look hung to the freezer */
+	wake_up_process(speedchange_task);
+
+	return cpufreq_register_governor(&cpufreq_gov_sched);
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHED
+fs_initcall(cpufreq_sched_init);
+#else
+module_init(cpufreq_sched_init);
+#endif
+
+static void __exit cpufreq_sched_exit(void)
+{
+	cpufreq_unregister_governor(&cpufreq_gov_sched);
+	irq_work_sync(&speedchange_irq_work);
+	kthread_stop(speedchange_task);
+	put_task_struct(speedchange_task);
+}
+
+module_exit(cpufreq_sched_exit);
+
+MODULE_DESCRIPTION("'cpufreq_sched' - A cpufreq governor driven by "
+	"scheduler utilization updates");
+MODULE_LICENSE("GPL");
@@ -2489,6 +2489,7 @@ int ext4_mb_init(struct super_block *sb, int needs_recovery)
 		for (j = 0; j < PREALLOC_TB_SIZE; j++)
 			INIT_LIST_HEAD(&lg->lg_prealloc_list[j]);
 		spin_lock_init(&lg->lg_prealloc_lock);
+		lg->lg_cpu = i;
 	}
 
 	if (sbi->s_proc)
@@ -2844,13 +2845,34 @@ out_err:
 static void ext4_mb_normalize_group_request(struct ext4_allocation_context *ac)
 {
 	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
 	struct ext4_locality_group *lg = ac->ac_lg;
+	ext4_group_t group, spread;
 
 	BUG_ON(lg == NULL);
 	if (EXT4_SB(sb)->s_stripe)
 		ac->ac_g_ex.fe_len = EXT4_SB(sb)->s_stripe;
 	else
 		ac->ac_g_ex.fe_len = EXT4_SB(sb)->s_mb_group_prealloc;
+
+	/*
+	 * Look for each cpu's new pa in its own block group of the goal's
+	 * flex group. Small files written from several cpus then don't all
+	 * take the same group lock and dirty the same bitmap block when
+	 * their blocks are marked used.
+	 */
+	spread = sbi->s_log_groups_per_flex ?
+		1 << sbi->s_log_groups_per_flex : 1;
+	if (spread > 1) {
+		group = ac->ac_g_ex.fe_group;
+		group = (group & ~(spread - 1)) +
+			((group + lg->lg_cpu) & (spread - 1));
+		if (group != ac->ac_g_ex.fe_group &&
+		    group < ext4_get_groups_count(sb)) {
+			ac->ac_g_ex.fe_group = group;
+			ac->ac_g_ex.fe_start = 0;
+		}
+	}
 	mb_debug(1, "#%u: goal %u blocks for locality group\n",
 		current->pid, ac->ac_g_ex.fe_len);
 }
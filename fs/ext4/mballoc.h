@@ -160,6 +160,8 @@ struct ext4_locality_group {
 	/* list of preallocations */
 	struct list_head	lg_prealloc_list[PREALLOC_TB_SIZE];
 	spinlock_t		lg_prealloc_lock;
+	/* cpu this group belongs to, spreads new pas over block groups */
+	unsigned int		lg_cpu;
 };
 
 struct ext4_allocation_context {
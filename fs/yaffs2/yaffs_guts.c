@@ -2883,7 +2883,7 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
  * The idea is to help clear out space in a more spread-out manner.
  * Dunno if it really does anything useful.
  */
-static int yaffs_check_gc(struct yaffs_dev *dev, int background)
+static int yaffs_check_gc_once(struct yaffs_dev *dev, int background)
 {
 	int aggressive = 0;
 	int gc_ok = YAFFS_OK;
@@ -2922,6 +2922,14 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 			    && erased_chunks > (dev->n_free_chunks / 4))
 				break;
 
+			/* A background collector is keeping blocks in reserve,
+			 * leave passive gc to it.
+			 */
+			if (!background && dev->param.bg_gc_reserve &&
+			    dev->n_erased_blocks >=
+			    min_erased + dev->param.bg_gc_reserve)
+				break;
+
 			if (dev->gc_skip > 20)
 				dev->gc_skip = 20;
 			if (erased_chunks < dev->n_free_chunks / 2 ||
@@ -2974,6 +2982,34 @@ static int yaffs_check_gc(struct yaffs_dev *dev, int background)
 	return aggressive ? gc_ok : YAFFS_OK;
 }
 
+/*
+ * Wrapper that accounts the time and work done by gc to whoever caused it,
+ * so foreground write stalls can be told apart from background collection.
+ */
+static int yaffs_check_gc(struct yaffs_dev *dev, int background)
+{
+	u32 blocks = dev->n_gc_blocks;
+	u32 copies = dev->n_gc_copies;
+	u64 start = Y_CLOCK_US();
+	int ret;
+
+	ret = yaffs_check_gc_once(dev, background);
+
+	if (blocks == dev->n_gc_blocks && copies == dev->n_gc_copies)
+		return ret;
+
+	if (background) {
+		dev->bg_gc_blocks += dev->n_gc_blocks - blocks;
+		dev->bg_gc_copies += dev->n_gc_copies - copies;
+		dev->bg_gc_us += Y_CLOCK_US() - start;
+	} else {
+		dev->fg_gc_blocks += dev->n_gc_blocks - blocks;
+		dev->fg_gc_copies += dev->n_gc_copies - copies;
+		dev->fg_gc_us += Y_CLOCK_US() - start;
+	}
+	return ret;
+}
+
 /*
  * yaffs_bg_gc()
  * Garbage collects. Intended to be called from a background thread.
@@ -4922,10 +4958,10 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	dev->n_deleted_files = 0;
 	dev->n_bg_deletions = 0;
 	dev->n_unlinked_files = 0;
-	dev->n_ecc_fixed = 0;
-	dev->n_ecc_unfixed = 0;
-	dev->n_tags_ecc_fixed = 0;
-	dev->n_tags_ecc_unfixed = 0;
+	atomic_set(&dev->n_ecc_fixed, 0);
+	atomic_set(&dev->n_ecc_unfixed, 0);
+	atomic_set(&dev->n_tags_ecc_fixed, 0);
+	atomic_set(&dev->n_tags_ecc_unfixed, 0);
 	dev->n_erase_failures = 0;
 	dev->n_erased_blocks = 0;
 	dev->gc_disable = 0;
@@ -574,6 +574,13 @@ struct yaffs_param {
 	int auto_unicode;
 #endif
 	int always_check_erased;	/* Force chunk erased check always on */
+
+	int scan_threads;	/* yaffs2: threads prefetching tags during a mount scan, 0 to scan serially */
+
+	int bg_gc_reserve;	/* Erased blocks kept free by a background gc thread.
+				 * When non-zero, foreground writes skip passive gc
+				 * while that many blocks above the minimum are erased.
+				 */
 };
 
 struct yaffs_dev {
@@ -726,15 +733,24 @@ struct yaffs_dev {
 	u32 bg_gcs;
 	u32 n_retired_writes;
 	u32 n_retired_blocks;
-	u32 n_ecc_fixed;
-	u32 n_ecc_unfixed;
-	u32 n_tags_ecc_fixed;
-	u32 n_tags_ecc_unfixed;
+	/* Counted by the tags readers, the scan prefetch threads among them */
+	atomic_t n_ecc_fixed;
+	atomic_t n_ecc_unfixed;
+	atomic_t n_tags_ecc_fixed;
+	atomic_t n_tags_ecc_unfixed;
 	u32 n_deletions;
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
 
+	/* Garbage collection cost, split by who paid for it */
+	u32 fg_gc_blocks;
+	u32 fg_gc_copies;
+	u64 fg_gc_us;
+	u32 bg_gc_blocks;
+	u32 bg_gc_copies;
+	u64 bg_gc_us;
+
 };
 
 /* The CheckpointDevice structure holds the device information that changes at runtime and
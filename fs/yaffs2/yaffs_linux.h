@@ -33,6 +33,17 @@ struct yaffs_linux_context {
 
 	struct task_struct *readdir_process;
 	unsigned mount_id;
+
+	unsigned mount_ms;	/* Time taken by yaffs_guts_initialise() */
+
+	/* Idle checkpointing by the background thread */
+	u32 bg_checkpt_activity;
+	unsigned long bg_checkpt_idle_since;
+
+	/* Background garbage collection */
+	struct task_struct *gc_thread;
+	unsigned long fg_last_active;	/* jiffies a foreground caller last took the lock */
+	int gc_waiting;			/* gc thread sleeps until there is garbage */
 };
 
 #define yaffs_dev_to_lc(dev) ((struct yaffs_linux_context *)((dev)->os_context))
@@ -38,6 +38,19 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 	else
 		result = yaffs_tags_compat_rd(dev,
 					      realigned_chunk, buffer, tags);
+
+	yaffs_rd_chunk_tags_check(dev, nand_chunk, tags);
+
+	return result;
+}
+
+/*
+ * Error handling for a tags read. Split out so that reads issued by the
+ * scan prefetch threads can be accounted for by the scanning thread.
+ */
+void yaffs_rd_chunk_tags_check(struct yaffs_dev *dev, int nand_chunk,
+			       struct yaffs_ext_tags *tags)
+{
 	if (tags && tags->ecc_result > YAFFS_ECC_RESULT_NO_ERROR) {
 
 		struct yaffs_block_info *bi;
@@ -46,8 +59,6 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 					  dev->param.chunks_per_block);
 		yaffs_handle_chunk_error(dev, bi);
 	}
-
-	return result;
 }
 
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
@@ -117,9 +117,9 @@ static void yaffs_get_tags_from_spare(struct yaffs_dev *dev,
 
 	result = yaffs_check_tags_ecc(tags_ptr);
 	if (result > 0)
-		dev->n_tags_ecc_fixed++;
+		atomic_inc(&dev->n_tags_ecc_fixed);
 	else if (result < 0)
-		dev->n_tags_ecc_unfixed++;
+		atomic_inc(&dev->n_tags_ecc_unfixed);
 }
 
 static void yaffs_spare_init(struct yaffs_spare *spare)
@@ -178,24 +178,24 @@ static int yaffs_rd_chunk_nand(struct yaffs_dev *dev,
 				yaffs_trace(YAFFS_TRACE_ERROR,
 					"**>>yaffs ecc error fix performed on chunk %d:0",
 					nand_chunk);
-				dev->n_ecc_fixed++;
+				atomic_inc(&dev->n_ecc_fixed);
 			} else if (ecc_result1 < 0) {
 				yaffs_trace(YAFFS_TRACE_ERROR,
 					"**>>yaffs ecc error unfixed on chunk %d:0",
 					nand_chunk);
-				dev->n_ecc_unfixed++;
+				atomic_inc(&dev->n_ecc_unfixed);
 			}
 
 			if (ecc_result2 > 0) {
 				yaffs_trace(YAFFS_TRACE_ERROR,
 					"**>>yaffs ecc error fix performed on chunk %d:1",
 					nand_chunk);
-				dev->n_ecc_fixed++;
+				atomic_inc(&dev->n_ecc_fixed);
 			} else if (ecc_result2 < 0) {
 				yaffs_trace(YAFFS_TRACE_ERROR,
 					"**>>yaffs ecc error unfixed on chunk %d:1",
 					nand_chunk);
-				dev->n_ecc_unfixed++;
+				atomic_inc(&dev->n_ecc_unfixed);
 			}
 
 			if (ecc_result1 || ecc_result2) {
@@ -85,6 +85,7 @@ static uint32_t YCALCBLOCKS(uint64_t partition_size, uint32_t block_size)
 #include "yaffs_trace.h"
 #include "yaffs_guts.h"
 #include "yaffs_attribs.h"
+#include "yaffs_yaffs2.h"
 
 #include "yaffs_linux.h"
 
@@ -97,6 +98,11 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_scan_threads;
+unsigned int yaffs_bg_checkpt_idle = 60;
+unsigned int yaffs_gc_thread = 1;
+unsigned int yaffs_gc_idle_ms = 500;
+unsigned int yaffs_gc_reserve = 4;
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -104,6 +110,11 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_scan_threads, uint, 0644);
+module_param(yaffs_bg_checkpt_idle, uint, 0644);
+module_param(yaffs_gc_thread, uint, 0644);
+module_param(yaffs_gc_idle_ms, uint, 0644);
+module_param(yaffs_gc_reserve, uint, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -121,17 +132,54 @@ static unsigned yaffs_gc_control_callback(struct yaffs_dev *dev)
 	return yaffs_gc_control;
 }
 
+/*
+ * True when the erased block pool has dropped into the reserve that the
+ * background gc thread is meant to keep topped up.
+ */
+static int yaffs_gc_reserve_low(struct yaffs_dev *dev)
+{
+	int min_erased = dev->param.n_reserved_blocks +
+	    yaffs_calc_checkpt_blocks_required(dev) + 1;
+
+	return dev->n_erased_blocks < min_erased + dev->param.bg_gc_reserve;
+}
+
+static unsigned yaffs_bg_gc_urgency(struct yaffs_dev *dev);
+
 static void yaffs_gross_lock(struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking %p", current);
-	mutex_lock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	mutex_lock(&(context->gross_lock));
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked %p", current);
+
+	if (current != context->bg_thread && current != context->gc_thread)
+		context->fg_last_active = jiffies;
+
+	/*
+	 * Foreground writes leave passive gc to the gc thread only while
+	 * yaffs_bg_enable lets it collect, which may change at any time.
+	 */
+	if (context->gc_thread)
+		dev->param.bg_gc_reserve = yaffs_bg_enable ? yaffs_gc_reserve : 0;
 }
 
 static void yaffs_gross_unlock(struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	struct task_struct *gc_thread = context->gc_thread;
+
+	if (gc_thread && current != gc_thread && !dev->is_checkpointed &&
+	    (yaffs_gc_reserve_low(dev) ||
+	     (context->gc_waiting && yaffs_bg_enable &&
+	      yaffs_bg_gc_urgency(dev)))) {
+		context->gc_waiting = 0;
+		wake_up_process(gc_thread);
+	}
+
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking %p", current);
-	mutex_unlock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	mutex_unlock(&(context->gross_lock));
 }
 
 static void yaffs_fill_inode_from_obj(struct inode *inode,
@@ -1615,6 +1663,40 @@ void yaffs_background_waker(unsigned long data)
 	wake_up_process((struct task_struct *)data);
 }
 
+/*
+ * Write a checkpoint once the device has seen no NAND writes or erasures
+ * for yaffs_bg_checkpt_idle seconds, so that a checkpoint is usually
+ * available if the next mount follows an unclean shutdown.
+ */
+static void yaffs_bg_checkpt(struct yaffs_dev *dev, unsigned long now)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	u32 activity = dev->n_page_writes + dev->n_erasures;
+
+	if (activity != context->bg_checkpt_activity) {
+		context->bg_checkpt_activity = activity;
+		context->bg_checkpt_idle_since = now;
+		return;
+	}
+
+	if (!yaffs_bg_checkpt_idle || !yaffs_auto_checkpoint ||
+	    dev->is_checkpointed || dev->read_only ||
+	    dev->param.skip_checkpt_wr || yaffs_bg_gc_urgency(dev) ||
+	    time_before(now, context->bg_checkpt_idle_since +
+			yaffs_bg_checkpt_idle * HZ))
+		return;
+
+	yaffs_trace(YAFFS_TRACE_BACKGROUND | YAFFS_TRACE_CHECKPOINT,
+		"yaffs_background: idle checkpoint");
+
+	yaffs_flush_super(context->super, 1);
+	context->super->s_dirt = 0;
+
+	/* Don't count the checkpoint itself as activity */
+	context->bg_checkpt_activity = dev->n_page_writes + dev->n_erasures;
+	context->bg_checkpt_idle_since = now;
+}
+
 static int yaffs_bg_thread_fn(void *data)
 {
 	struct yaffs_dev *dev = (struct yaffs_dev *)data;
@@ -1631,6 +1713,9 @@ static int yaffs_bg_thread_fn(void *data)
 	yaffs_trace(YAFFS_TRACE_BACKGROUND,
 		"yaffs_background starting for dev %p", (void *)dev);
 
+	context->bg_checkpt_activity = dev->n_page_writes + dev->n_erasures;
+	context->bg_checkpt_idle_since = now;
+
 	set_freezable();
 	while (context->bg_running) {
 		yaffs_trace(YAFFS_TRACE_BACKGROUND, "yaffs_background");
@@ -1650,8 +1735,11 @@ static int yaffs_bg_thread_fn(void *data)
 			next_dir_update = now + HZ;
 		}
 
+		if (yaffs_bg_enable)
+			yaffs_bg_checkpt(dev, now);
+
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
-			if (!dev->is_checkpointed) {
+			if (!dev->is_checkpointed && !context->gc_thread) {
 				urgency = yaffs_bg_gc_urgency(dev);
 				gc_result = yaffs_bg_gc(dev, urgency);
 				if (urgency > 1)
@@ -1689,6 +1777,126 @@ static int yaffs_bg_thread_fn(void *data)
 	return 0;
 }
 
+/*
+ * yaffs gc thread.
+ * Keeps param.bg_gc_reserve erased blocks above the gc minimum so that
+ * foreground writes rarely have to collect inline, and collects more
+ * aggressively once no foreground caller has taken the lock for
+ * yaffs_gc_idle_ms. Each pass collects one block under the gross lock
+ * so that a foreground caller never waits for more than one block copy.
+ * With nothing to collect it sleeps until yaffs_gross_unlock() finds the
+ * reserve low or garbage to collect.
+ */
+static int yaffs_gc_thread_fn(void *data)
+{
+	struct yaffs_dev *dev = (struct yaffs_dev *)data;
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	unsigned long idle_jiffies;
+	unsigned long idle_at;
+	long timeout;
+	unsigned urgency;
+	u32 gc_work;
+	int progress;
+	int enough;
+	int idle;
+	int low;
+
+	yaffs_trace(YAFFS_TRACE_BACKGROUND,
+		"yaffs_gc starting for dev %p", (void *)dev);
+
+	set_freezable();
+	while (!kthread_should_stop()) {
+		if (try_to_freeze())
+			continue;
+
+		idle_jiffies = msecs_to_jiffies(yaffs_gc_idle_ms);
+		progress = 0;
+		enough = 1;
+
+		yaffs_gross_lock(dev);
+		context->gc_waiting = 0;
+
+		idle_at = context->fg_last_active + idle_jiffies;
+		idle = time_after_eq(jiffies, idle_at);
+		low = yaffs_gc_reserve_low(dev);
+		urgency = yaffs_bg_gc_urgency(dev);
+
+		if (yaffs_bg_enable && !dev->is_checkpointed &&
+		    (low || (idle && urgency))) {
+			gc_work = dev->n_gc_blocks + dev->n_gc_copies;
+			enough = yaffs_bg_gc(dev, urgency);
+			progress = (gc_work != dev->n_gc_blocks + dev->n_gc_copies);
+			low = yaffs_gc_reserve_low(dev);
+		}
+
+		if (progress && low) {
+			timeout = 1;
+		} else if (progress && idle && !enough) {
+			timeout = 0;
+		} else if (yaffs_bg_enable && !idle && urgency) {
+			timeout = max_t(long, idle_at - jiffies, 1);
+		} else {
+			timeout = MAX_SCHEDULE_TIMEOUT;
+			context->gc_waiting = 1;
+		}
+
+		/* Before unlocking, so that a wake up after it is not lost */
+		if (timeout)
+			set_current_state(TASK_INTERRUPTIBLE);
+
+		yaffs_gross_unlock(dev);
+
+		if (!timeout) {
+			cond_resched();
+			continue;
+		}
+
+		if (!kthread_should_stop())
+			schedule_timeout(timeout);
+		__set_current_state(TASK_RUNNING);
+	}
+
+	return 0;
+}
+
+static void yaffs_gc_start(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	struct task_struct *thread;
+
+	if (!yaffs_gc_thread || !dev->param.is_yaffs2)
+		return;
+
+	context->fg_last_active = jiffies;
+
+	/* The thread checks gc_thread in yaffs_gross_lock(), set it first */
+	thread = kthread_create(yaffs_gc_thread_fn, (void *)dev, "yaffs-gc-%d",
+				context->mount_id);
+	if (IS_ERR(thread))
+		return;
+
+	dev->param.bg_gc_reserve = yaffs_bg_enable ? yaffs_gc_reserve : 0;
+	context->gc_thread = thread;
+	wake_up_process(thread);
+}
+
+static void yaffs_gc_stop(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *context = yaffs_dev_to_lc(dev);
+	struct task_struct *thread = context->gc_thread;
+
+	if (!thread)
+		return;
+
+	/* Clear under the lock so yaffs_gross_unlock() can't wake a dead thread */
+	yaffs_gross_lock(dev);
+	dev->param.bg_gc_reserve = 0;
+	context->gc_thread = NULL;
+	yaffs_gross_unlock(dev);
+
+	kthread_stop(thread);
+}
+
 static int yaffs_bg_start(struct yaffs_dev *dev)
 {
 	int retval = 0;
@@ -1707,7 +1915,8 @@ static int yaffs_bg_start(struct yaffs_dev *dev)
 		retval = PTR_ERR(context->bg_thread);
 		context->bg_thread = NULL;
 		context->bg_running = 0;
-	}
+	} else
+		yaffs_gc_start(dev);
 	return retval;
 }
 
@@ -1715,6 +1924,8 @@ static void yaffs_bg_stop(struct yaffs_dev *dev)
 {
 	struct yaffs_linux_context *ctxt = yaffs_dev_to_lc(dev);
 
+	yaffs_gc_stop(dev);
+
 	ctxt->bg_running = 0;
 
 	if (ctxt->bg_thread) {
@@ -2026,6 +2237,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	struct yaffs_options options;
 
 	unsigned mount_id;
+	unsigned long mount_start;
 	int found;
 	struct yaffs_linux_context *context_iterator;
 	struct list_head *l;
@@ -2297,6 +2509,8 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->skip_checkpt_rd = options.skip_checkpoint_read;
 	param->skip_checkpt_wr = options.skip_checkpoint_write;
 
+	param->scan_threads = yaffs_scan_threads;
+
 	mutex_lock(&yaffs_context_lock);
 	/* Get a mount id */
 	found = 0;
@@ -2324,7 +2538,9 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 
 	yaffs_gross_lock(dev);
 
+	mount_start = jiffies;
 	err = yaffs_guts_initialise(dev);
+	context->mount_ms = jiffies_to_msecs(jiffies - mount_start);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_read_super: guts initialised %s",
@@ -2442,6 +2658,10 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 			param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased... %d\n",
 			param->always_check_erased);
+	buf += sprintf(buf, "scan_threads.......... %d\n",
+			param->scan_threads);
+	buf += sprintf(buf, "bg_gc_reserve......... %d\n",
+			param->bg_gc_reserve);
 
 	return buf;
 }
@@ -2457,6 +2677,9 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	    sprintf(buf, "n_erased_blocks....... %d\n", dev->n_erased_blocks);
 	buf +=
 	    sprintf(buf, "blocks_in_checkpt..... %d\n", dev->blocks_in_checkpt);
+	buf += sprintf(buf, "is_checkpointed....... %d\n", dev->is_checkpointed);
+	buf += sprintf(buf, "mount_ms.............. %u\n",
+			yaffs_dev_to_lc(dev)->mount_ms);
 	buf += sprintf(buf, "\n");
 	buf += sprintf(buf, "n_tnodes.............. %d\n", dev->n_tnodes);
 	buf += sprintf(buf, "n_obj................. %d\n", dev->n_obj);
@@ -2474,17 +2697,26 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
+	buf += sprintf(buf, "fg_gc_blocks.......... %u\n", dev->fg_gc_blocks);
+	buf += sprintf(buf, "fg_gc_copies.......... %u\n", dev->fg_gc_copies);
+	buf += sprintf(buf, "fg_gc_us.............. %llu\n",
+			(unsigned long long)dev->fg_gc_us);
+	buf += sprintf(buf, "bg_gc_blocks.......... %u\n", dev->bg_gc_blocks);
+	buf += sprintf(buf, "bg_gc_copies.......... %u\n", dev->bg_gc_copies);
+	buf += sprintf(buf, "bg_gc_us.............. %llu\n",
+			(unsigned long long)dev->bg_gc_us);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
 	buf +=
 	    sprintf(buf, "n_retired_blocks...... %u\n", dev->n_retired_blocks);
-	buf += sprintf(buf, "n_ecc_fixed........... %u\n", dev->n_ecc_fixed);
-	buf += sprintf(buf, "n_ecc_unfixed......... %u\n", dev->n_ecc_unfixed);
-	buf +=
-	    sprintf(buf, "n_tags_ecc_fixed...... %u\n", dev->n_tags_ecc_fixed);
-	buf +=
-	    sprintf(buf, "n_tags_ecc_unfixed.... %u\n",
-		    dev->n_tags_ecc_unfixed);
+	buf += sprintf(buf, "n_ecc_fixed........... %u\n",
+			atomic_read(&dev->n_ecc_fixed));
+	buf += sprintf(buf, "n_ecc_unfixed......... %u\n",
+			atomic_read(&dev->n_ecc_unfixed));
+	buf += sprintf(buf, "n_tags_ecc_fixed...... %u\n",
+			atomic_read(&dev->n_tags_ecc_fixed));
+	buf += sprintf(buf, "n_tags_ecc_unfixed.... %u\n",
+			atomic_read(&dev->n_tags_ecc_unfixed));
 	buf += sprintf(buf, "cache_hits............ %u\n", dev->cache_hits);
 	buf +=
 	    sprintf(buf, "n_deleted_files....... %u\n", dev->n_deleted_files);
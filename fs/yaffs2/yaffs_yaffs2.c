@@ -954,6 +954,182 @@ static int yaffs2_ybicmp(const void *a, const void *b)
 		return aseq - bseq;
 }
 
+/*
+ * Tags prefetch for the backwards scan.
+ *
+ * The scan itself has to handle blocks strictly in descending sequence
+ * order: shadowing, shrink headers and duplicate object headers are all
+ * resolved by which copy is seen first.  Reading and unpacking the tags
+ * of every chunk does not depend on that order, and dominates mount time
+ * on large partitions, so it is handed to a few worker threads.
+ *
+ * The workers claim blocks in scan order and read all of their tags
+ * into a ring of per-block slots.  Slot (pos % n_slots) holds scan
+ * position pos; it is released for pos + n_slots once the scanning
+ * thread is done with it.  Accounting and error handling for the reads
+ * is left to the scanning thread.
+ */
+#define YAFFS_MAX_SCAN_THREADS		8
+#define YAFFS_SCAN_SLOTS_PER_THREAD	4
+
+struct yaffs_scan_slot {
+	int pos;
+	int ready;
+	struct yaffs_ext_tags *tags;
+};
+
+struct yaffs_scan_prefetch {
+	struct yaffs_dev *dev;
+	struct yaffs_block_index *block_index;
+	int n_to_scan;
+	atomic_t next_pos;
+	int stop;
+	wait_queue_head_t wait;
+	int n_slots;
+	struct yaffs_scan_slot *slots;
+	int n_threads;
+	struct task_struct *threads[YAFFS_MAX_SCAN_THREADS];
+};
+
+static int yaffs2_scan_prefetch_fn(void *data)
+{
+	struct yaffs_scan_prefetch *pf = data;
+	struct yaffs_dev *dev = pf->dev;
+	struct yaffs_scan_slot *slot;
+	int pos, blk, c;
+
+	while (!pf->stop) {
+		pos = atomic_inc_return(&pf->next_pos) - 1;
+		if (pos >= pf->n_to_scan)
+			break;
+
+		slot = &pf->slots[pos % pf->n_slots];
+		wait_event(pf->wait, slot->pos == pos || pf->stop);
+		if (pf->stop)
+			break;
+
+		blk = pf->block_index[pf->n_to_scan - 1 - pos].block;
+		for (c = 0; c < dev->param.chunks_per_block; c++)
+			dev->param.read_chunk_tags_fn(dev,
+				blk * dev->param.chunks_per_block + c -
+				dev->chunk_offset, NULL, &slot->tags[c]);
+
+		smp_wmb();
+		slot->ready = 1;
+		wake_up_all(&pf->wait);
+	}
+
+	/* Hang around until yaffs2_scan_prefetch_stop() reaps us */
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_UNINTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+static void yaffs2_scan_prefetch_stop(struct yaffs_scan_prefetch *pf)
+{
+	int i;
+
+	pf->stop = 1;
+	wake_up_all(&pf->wait);
+
+	for (i = 0; i < pf->n_threads; i++)
+		kthread_stop(pf->threads[i]);
+
+	for (i = 0; i < pf->n_slots; i++)
+		kfree(pf->slots[i].tags);
+	kfree(pf->slots);
+	kfree(pf);
+}
+
+static struct yaffs_scan_prefetch *
+yaffs2_scan_prefetch_start(struct yaffs_dev *dev,
+			   struct yaffs_block_index *block_index,
+			   int n_to_scan)
+{
+	struct yaffs_scan_prefetch *pf;
+	struct task_struct *t;
+	int n_threads = dev->param.scan_threads;
+	int i;
+
+	if (n_threads <= 0 || dev->param.inband_tags ||
+	    !dev->param.read_chunk_tags_fn)
+		return NULL;
+	if (n_threads > YAFFS_MAX_SCAN_THREADS)
+		n_threads = YAFFS_MAX_SCAN_THREADS;
+	if (n_to_scan < n_threads * YAFFS_SCAN_SLOTS_PER_THREAD)
+		return NULL;
+
+	pf = kzalloc(sizeof(*pf), GFP_NOFS);
+	if (!pf)
+		return NULL;
+
+	pf->dev = dev;
+	pf->block_index = block_index;
+	pf->n_to_scan = n_to_scan;
+	atomic_set(&pf->next_pos, 0);
+	init_waitqueue_head(&pf->wait);
+
+	pf->n_slots = n_threads * YAFFS_SCAN_SLOTS_PER_THREAD;
+	pf->slots = kcalloc(pf->n_slots, sizeof(*pf->slots), GFP_NOFS);
+	if (!pf->slots)
+		goto fail;
+
+	for (i = 0; i < pf->n_slots; i++) {
+		pf->slots[i].pos = i;
+		pf->slots[i].tags =
+		    kmalloc(dev->param.chunks_per_block *
+			    sizeof(struct yaffs_ext_tags), GFP_NOFS);
+		if (!pf->slots[i].tags)
+			goto fail;
+	}
+
+	for (i = 0; i < n_threads; i++) {
+		t = kthread_run(yaffs2_scan_prefetch_fn, pf, "yaffs-scan-%d",
+				i);
+		if (IS_ERR(t))
+			break;
+		pf->threads[pf->n_threads++] = t;
+	}
+	if (!pf->n_threads)
+		goto fail;
+
+	yaffs_trace(YAFFS_TRACE_SCAN,
+		"yaffs2_scan_backwards prefetching tags with %d threads",
+		pf->n_threads);
+
+	return pf;
+
+fail:
+	yaffs2_scan_prefetch_stop(pf);
+	return NULL;
+}
+
+static struct yaffs_ext_tags *
+yaffs2_scan_prefetch_get(struct yaffs_scan_prefetch *pf, int pos)
+{
+	struct yaffs_scan_slot *slot = &pf->slots[pos % pf->n_slots];
+
+	wait_event(pf->wait, slot->pos == pos && slot->ready);
+	smp_rmb();
+
+	return slot->tags;
+}
+
+static void yaffs2_scan_prefetch_put(struct yaffs_scan_prefetch *pf, int pos)
+{
+	struct yaffs_scan_slot *slot = &pf->slots[pos % pf->n_slots];
+
+	slot->ready = 0;
+	smp_wmb();
+	slot->pos = pos + pf->n_slots;
+	wake_up_all(&pf->wait);
+}
+
 int yaffs2_scan_backwards(struct yaffs_dev *dev)
 {
 	struct yaffs_ext_tags tags;
@@ -987,6 +1163,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	struct yaffs_block_index *block_index = NULL;
 	int alt_block_index = 0;
 
+	struct yaffs_scan_prefetch *prefetch;
+	struct yaffs_ext_tags *prefetched;
+
 	yaffs_trace(YAFFS_TRACE_SCAN,
 		"yaffs2_scan_backwards starts  intstartblk %d intendblk %d...",
 		dev->internal_start_block, dev->internal_end_block);
@@ -1086,6 +1265,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 	end_iter = n_to_scan - 1;
 	yaffs_trace(YAFFS_TRACE_SCAN_DEBUG, "%d blocks to scan", n_to_scan);
 
+	prefetch = yaffs2_scan_prefetch_start(dev, block_index, n_to_scan);
+	prefetched = NULL;
+
 	/* For each block.... backwards */
 	for (block_iter = end_iter; !alloc_failed && block_iter >= start_iter;
 	     block_iter--) {
@@ -1096,6 +1278,10 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 		/* get the block to scan in the correct order */
 		blk = block_index[block_iter].block;
 
+		if (prefetch)
+			prefetched = yaffs2_scan_prefetch_get(prefetch,
+						end_iter - block_iter);
+
 		bi = yaffs_get_block_info(dev, blk);
 
 		state = bi->block_state;
@@ -1114,8 +1300,14 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 			chunk = blk * dev->param.chunks_per_block + c;
 
-			result = yaffs_rd_chunk_tags_nand(dev, chunk, NULL,
-							  &tags);
+			if (prefetched) {
+				tags = prefetched[c];
+				dev->n_page_reads++;
+				yaffs_rd_chunk_tags_check(dev, chunk, &tags);
+			} else {
+				result = yaffs_rd_chunk_tags_nand(dev, chunk,
+								  NULL, &tags);
+			}
 
 			/* Let's have a good look at this chunk... */
 
@@ -1557,6 +1749,10 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		}		/* End of scanning for each chunk */
 
+		if (prefetch)
+			yaffs2_scan_prefetch_put(prefetch,
+						 end_iter - block_iter);
+
 		if (state == YAFFS_BLOCK_STATE_NEEDS_SCANNING) {
 			/* If we got this far while scanning, then the block is fully allocated. */
 			state = YAFFS_BLOCK_STATE_FULL;
@@ -1573,6 +1769,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	}
 
+	if (prefetch)
+		yaffs2_scan_prefetch_stop(prefetch);
+
 	yaffs_skip_rest_of_block(dev);
 
 	if (alt_block_index)
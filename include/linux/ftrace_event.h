@@ -169,6 +169,7 @@ enum {
 	TRACE_EVENT_FL_FILTERED_BIT,
 	TRACE_EVENT_FL_RECORDED_CMD_BIT,
 	TRACE_EVENT_FL_CAP_ANY_BIT,
+	TRACE_EVENT_FL_HIST_BIT,
 };
 
 enum {
@@ -176,8 +177,11 @@ enum {
 	TRACE_EVENT_FL_FILTERED		= (1 << TRACE_EVENT_FL_FILTERED_BIT),
 	TRACE_EVENT_FL_RECORDED_CMD	= (1 << TRACE_EVENT_FL_RECORDED_CMD_BIT),
 	TRACE_EVENT_FL_CAP_ANY		= (1 << TRACE_EVENT_FL_CAP_ANY_BIT),
+	TRACE_EVENT_FL_HIST		= (1 << TRACE_EVENT_FL_HIST_BIT),
 };
 
+struct event_hist;
+
 struct ftrace_event_call {
 	struct list_head	list;
 	struct ftrace_event_class *class;
@@ -188,12 +192,17 @@ struct ftrace_event_call {
 	struct event_filter	*filter;
 	void			*mod;
 	void			*data;
+#ifdef CONFIG_EVENT_HIST
+	struct event_hist	*hist;
+#endif
 
 	/*
 	 * 32 bit flags:
 	 *   bit 1:		enabled
 	 *   bit 2:		filter_active
 	 *   bit 3:		enabled cmd record
+	 *   bit 4:		allow any user to use (perf)
+	 *   bit 5:		histogram attached
 	 *
 	 * Changes to flags must hold the event_mutex.
 	 *
@@ -231,6 +240,22 @@ extern int filter_current_check_discard(struct ring_buffer *buffer,
 					void *rec,
 					struct ring_buffer_event *event);
 
+#ifdef CONFIG_EVENT_HIST
+extern void event_hist_missed(struct ftrace_event_call *call);
+#endif
+
+/*
+ * A histogram is fed from the record in the ring buffer; a probe whose
+ * reserve failed calls this so that the lost hit is counted as dropped.
+ */
+static inline void trace_event_reserve_failed(struct ftrace_event_call *call)
+{
+#ifdef CONFIG_EVENT_HIST
+	if (unlikely(call->flags & TRACE_EVENT_FL_HIST))
+		event_hist_missed(call);
+#endif
+}
+
 enum {
 	FILTER_OTHER = 0,
 	FILTER_STATIC_STRING,
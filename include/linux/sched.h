@@ -41,6 +41,8 @@
 #define SCHED_IDLE		5
 /* Can be ORed in to make sure the process is reverted back to SCHED_NORMAL on fork */
 #define SCHED_RESET_ON_FORK     0x40000000
+/* Can be ORed in to have a SCHED_NORMAL task woken on idle cpus and preempt promptly */
+#define SCHED_LATENCY_SENSITIVE 0x20000000
 
 #ifdef __KERNEL__
 
@@ -141,7 +143,22 @@ extern unsigned long nr_uninterruptible(void);
 extern unsigned long nr_iowait(void);
 extern unsigned long nr_iowait_cpu(int cpu);
 extern unsigned long this_cpu_load(void);
+extern unsigned long sched_get_cpu_util(int cpu);
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * A frequency governor that follows the scheduler instead of sampling
+ * idle time installs one of these per cpu. ->func is called with the
+ * runqueue lock of @cpu held and interrupts disabled, from enqueue,
+ * dequeue and the tick; it must not sleep nor take the runqueue lock.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, int cpu, u64 time);
+};
+
+extern void cpufreq_set_update_util_data(int cpu,
+					 struct update_util_data *data);
+#endif
 
 extern void calc_global_load(unsigned long ticks);
 
@@ -1096,6 +1113,7 @@ struct sched_class {
 
 #ifdef CONFIG_SMP
 	int  (*select_task_rq)(struct task_struct *p, int sd_flag, int flags);
+	void (*migrate_task_rq)(struct task_struct *p, int next_cpu);
 
 	void (*pre_schedule) (struct rq *this_rq, struct task_struct *task);
 	void (*post_schedule) (struct rq *this_rq);
@@ -1166,6 +1184,20 @@ struct sched_statistics {
 };
 #endif
 
+struct sched_avg {
+	/*
+	 * These sums represent an infinite geometric series and so are bound
+	 * above by 1024/(1-y).  Thus we only need a u32 to store them for all
+	 * choices of y < 1-2^(-32)*1024.
+	 */
+	u32			runnable_avg_sum, runnable_avg_period;
+	u32			running_avg_sum;
+	u64			last_runnable_update;
+	s64			decay_count;
+	unsigned long		load_avg_contrib;
+	unsigned long		util_avg_contrib;
+};
+
 struct sched_entity {
 	struct load_weight	load;		/* for load-balancing */
 	struct rb_node		run_node;
@@ -1190,6 +1222,9 @@ struct sched_entity {
 	/* rq "owned" by this entity/group: */
 	struct cfs_rq		*my_q;
 #endif
+
+	/* Per-entity load tracking */
+	struct sched_avg	avg;
 };
 
 struct sched_rt_entity {
@@ -1307,6 +1342,8 @@ struct task_struct {
 	/* Revert to default priority/policy when forking */
 	unsigned sched_reset_on_fork:1;
 	unsigned sched_contributes_to_load:1;
+	/* Prefer idle cpus and wakeup preemption, see SCHED_LATENCY_SENSITIVE */
+	unsigned sched_latency_sensitive:1;
 
 	pid_t pid;
 	pid_t tgid;
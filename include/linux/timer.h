@@ -16,6 +16,7 @@ struct timer_list {
 	 */
 	struct list_head entry;
 	unsigned long expires;
+	unsigned long soft_expires;
 	struct tvec_base *base;
 
 	void (*function)(unsigned long);
@@ -229,6 +230,11 @@ extern void set_timer_slack(struct timer_list *time, int slack_hz);
  */
 extern unsigned long get_next_timer_interrupt(unsigned long now);
 
+/*
+ * Pull timers whose slack has begun into a wakeup from NO_HZ idle:
+ */
+extern void coalesce_timers(void);
+
 /*
  * Timer-statistics info:
  */
@@ -237,9 +243,13 @@ extern unsigned long get_next_timer_interrupt(unsigned long now);
 extern int timer_stats_active;
 
 #define TIMER_STATS_FLAG_DEFERRABLE	0x1
+#define TIMER_STATS_FLAG_COALESCED	0x2
 
 extern void init_timer_stats(void);
 
+extern void timer_stats_idle_wakeup(void);
+extern void timer_stats_idle_wakeup_end(void);
+
 extern void timer_stats_update_stats(void *timer, pid_t pid, void *startf,
 				     void *timerf, char *comm,
 				     unsigned int timer_flag);
@@ -263,6 +273,14 @@ static inline void init_timer_stats(void)
 {
 }
 
+static inline void timer_stats_idle_wakeup(void)
+{
+}
+
+static inline void timer_stats_idle_wakeup_end(void)
+{
+}
+
 static inline void timer_stats_timer_set_start_info(struct timer_list *timer)
 {
 }
@@ -12,6 +12,7 @@
 #include <linux/threads.h>
 #include <asm/atomic.h>
 
+struct cpumask;
 struct workqueue_struct;
 
 struct work_struct;
@@ -54,9 +55,14 @@ enum {
 	WORK_NR_COLORS		= (1 << WORK_STRUCT_COLOR_BITS) - 1,
 	WORK_NO_COLOR		= WORK_NR_COLORS,
 
-	/* special cpu IDs */
+	/*
+	 * Special cpu IDs.  Unbound work is served by a handful of
+	 * worker pools, each confined to a cpumask, whose IDs follow
+	 * WORK_CPU_UNBOUND, which is also the ID of the default pool.
+	 */
+	WORK_NR_UNBOUND_POOLS	= 8,
 	WORK_CPU_UNBOUND	= NR_CPUS,
-	WORK_CPU_NONE		= NR_CPUS + 1,
+	WORK_CPU_NONE		= NR_CPUS + WORK_NR_UNBOUND_POOLS,
 	WORK_CPU_LAST		= WORK_CPU_NONE,
 
 	/*
@@ -80,6 +86,9 @@ struct work_struct {
 	atomic_long_t data;
 	struct list_head entry;
 	work_func_t func;
+#ifdef CONFIG_WORKQUEUE_TRACER
+	u64 queued_at;
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map lockdep_map;
 #endif
@@ -254,9 +263,10 @@ enum {
 	WQ_MEM_RECLAIM		= 1 << 3, /* may be used for memory reclaim */
 	WQ_HIGHPRI		= 1 << 4, /* high priority */
 	WQ_CPU_INTENSIVE	= 1 << 5, /* cpu instensive workqueue */
+	WQ_SYSFS		= 1 << 6, /* visible in /sys/bus/workqueue */
 
-	WQ_DYING		= 1 << 6, /* internal: workqueue is dying */
-	WQ_RESCUER		= 1 << 7, /* internal: workqueue has rescuer */
+	WQ_DYING		= 1 << 7, /* internal: workqueue is dying */
+	WQ_RESCUER		= 1 << 8, /* internal: workqueue has rescuer */
 
 	WQ_MAX_ACTIVE		= 512,	  /* I like 512, better ideas? */
 	WQ_MAX_UNBOUND_PER_CPU	= 4,	  /* 4 * #cpus for unbound wq */
@@ -381,6 +391,8 @@ extern bool cancel_delayed_work_sync(struct delayed_work *dwork);
 
 extern void workqueue_set_max_active(struct workqueue_struct *wq,
 				     int max_active);
+extern int workqueue_set_unbound_cpumask(struct workqueue_struct *wq,
+					 const struct cpumask *cpumask);
 extern bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq);
 extern unsigned int work_cpu(struct work_struct *work);
 extern unsigned int work_busy(struct work_struct *work);
@@ -54,6 +54,12 @@ struct inet_peer {
 			u32				pmtu_orig;
 			u32				pmtu_learned;
 			struct inetpeer_addr_base	redirect_learned;
+			/* TCP Fast Open client cache, see tcp_fastopen.c */
+			u16				tcp_fastopen_mss;
+			u16				tcp_fastopen_syn_loss;
+			unsigned long			tcp_fastopen_syn_loss_ts;
+			s8				tcp_fastopen_cookie_len;
+			u8				tcp_fastopen_cookie[16];
 		};
 		struct rcu_head         rcu;
 	};
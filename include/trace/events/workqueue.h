@@ -7,6 +7,8 @@
 #include <linux/tracepoint.h>
 #include <linux/workqueue.h>
 
+struct cpu_workqueue_struct;
+
 DECLARE_EVENT_CLASS(workqueue_work,
 
 	TP_PROTO(struct work_struct *work),
@@ -115,6 +117,52 @@ DEFINE_EVENT(workqueue_work, workqueue_execute_end,
 	TP_ARGS(work)
 );
 
+/**
+ * workqueue_execute_done - called when a work is done executing
+ * @cwq:	pointer to struct cpu_workqueue_struct
+ * @function:	the work function that ran
+ * @latency:	nsecs between queueing the work and starting it
+ * @runtime:	nsecs the work function took
+ * @blocked:	it ran without sleeping while other works were waiting
+ *		on a concurrency managed gcwq
+ *
+ * Only available with CONFIG_WORKQUEUE_TRACER, which timestamps works.
+ * The work may already be freed, so it is not passed.
+ */
+#ifdef CONFIG_WORKQUEUE_TRACER
+TRACE_EVENT(workqueue_execute_done,
+
+	TP_PROTO(struct cpu_workqueue_struct *cwq, work_func_t function,
+		 u64 latency, u64 runtime, bool blocked),
+
+	TP_ARGS(cwq, function, latency, runtime, blocked),
+
+	TP_STRUCT__entry(
+		__field( void *,	function)
+		__field( void *,	workqueue)
+		__field( unsigned int,	cpu	)
+		__field( u64,		latency	)
+		__field( u64,		runtime	)
+		__field( bool,		blocked	)
+	),
+
+	TP_fast_assign(
+		__entry->function	= function;
+		__entry->workqueue	= cwq->wq;
+		__entry->cpu		= cwq->gcwq->cpu;
+		__entry->latency	= latency;
+		__entry->runtime	= runtime;
+		__entry->blocked	= blocked;
+	),
+
+	TP_printk("function=%pf workqueue=%p cpu=%u latency=%llu runtime=%llu%s",
+		  __entry->function, __entry->workqueue, __entry->cpu,
+		  (unsigned long long)__entry->latency,
+		  (unsigned long long)__entry->runtime,
+		  __entry->blocked ? " blocked" : "")
+);
+#endif
+
 #endif /*  _TRACE_WORKQUEUE_H */
 
 /* This part must be outside protection */
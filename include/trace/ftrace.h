@@ -432,8 +432,10 @@ static inline notrace int ftrace_get_offsets_##call(			\
  *				  event_<call>->event.type,
  *				  sizeof(*entry) + __data_size,
  *				  irq_flags, pc);
- *	if (!event)
+ *	if (!event) {
+ *		trace_event_reserve_failed(event_call);
  *		return;
+ *	}
  *	entry	= ring_buffer_event_data(event);
  *
  *	{ <assign>; }  <-- Here we assign the entries by the __field and
@@ -536,8 +538,10 @@ ftrace_raw_event_##call(void *__data, proto)				\
 				 event_call->event.type,		\
 				 sizeof(*entry) + __data_size,		\
 				 irq_flags, pc);			\
-	if (!event)							\
+	if (!event) {							\
+		trace_event_reserve_failed(event_call);			\
 		return;							\
+	}								\
 	entry	= ring_buffer_event_data(event);			\
 									\
 	tstruct								\
@@ -793,13 +793,19 @@ static inline void timer_stats_hrtimer_clear_start_info(struct hrtimer *timer)
 #endif
 }
 
-static inline void timer_stats_account_hrtimer(struct hrtimer *timer)
+static inline void timer_stats_account_hrtimer(struct hrtimer *timer,
+					       ktime_t now)
 {
 #ifdef CONFIG_TIMER_STATS
+	unsigned int flag = 0;
+
 	if (likely(!timer_stats_active))
 		return;
+	/* Run before its hard expiry: it rode along on another wakeup */
+	if (now.tv64 < hrtimer_get_expires_tv64(timer))
+		flag |= TIMER_STATS_FLAG_COALESCED;
 	timer_stats_update_stats(timer, timer->start_pid, timer->start_site,
-				 timer->function, timer->start_comm, 0);
+				 timer->function, timer->start_comm, flag);
 #endif
 }
 
@@ -1225,7 +1231,7 @@ static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
 
 	debug_deactivate(timer);
 	__remove_hrtimer(timer, base, HRTIMER_STATE_CALLBACK, 0);
-	timer_stats_account_hrtimer(timer);
+	timer_stats_account_hrtimer(timer, *now);
 	fn = timer->function;
 
 	/*
@@ -1483,8 +1489,12 @@ void hrtimer_run_queues(void)
 			struct hrtimer *timer;
 
 			timer = container_of(node, struct hrtimer, node);
-			if (base->softirq_time.tv64 <=
-					hrtimer_get_expires_tv64(timer))
+			/*
+			 * Like hrtimer_interrupt(), run the timers whose
+			 * range has begun so they share this tick.
+			 */
+			if (base->softirq_time.tv64 <
+					hrtimer_get_softexpires_tv64(timer))
 				break;
 
 			__run_hrtimer(timer, &base->softirq_time);
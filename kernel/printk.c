@@ -41,6 +41,7 @@
 #include <linux/cpu.h>
 #include <linux/notifier.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
 #include <trace/stm.h>
 
 #include <asm/uaccess.h>
@@ -151,6 +152,19 @@ EXPORT_SYMBOL(console_set_on_cmdline);
 /* Flag: console code may call schedule() */
 static int console_may_schedule;
 
+/*
+ * Work printk() leaves for the next tick on its CPU, which cannot be
+ * done from printk() because it may be called with runqueue locks held.
+ */
+#define PRINTK_PENDING_WAKEUP	0x01	/* wake up syslog readers */
+#define PRINTK_PENDING_OUTPUT	0x02	/* kick the printk kthread */
+
+static DEFINE_PER_CPU(int, printk_pending);
+
+/* Drives the consoles for printk(), see vprintk() */
+static struct task_struct *printk_kthread;
+static int printk_kthread_need_flush;
+
 #ifdef CONFIG_PRINTK
 
 static char __log_buf[__LOG_BUF_LEN];
@@ -933,7 +947,6 @@ static const char recursion_bug_msg [] =
 		KERN_CRIT "BUG: recent printk recursion!\n";
 static int recursion_bug;
 static int new_text_line = 1;
-static char printk_buf[1024];
 
 int printk_delay_msec __read_mostly;
 
@@ -949,60 +962,107 @@ static inline void printk_delay(void)
 	}
 }
 
-asmlinkage int vprintk(const char *fmt, va_list args)
-{
-	int printed_len = 0;
-	int current_log_level = default_message_loglevel;
-	unsigned long flags;
-	int this_cpu;
-	char *p;
-	size_t plen;
-	char special;
+/*
+ * printk() does not take logbuf_lock to store a message. It formats into
+ * a per-cpu buffer and puts the result into a lockless ring of records;
+ * whoever gets logbuf_lock without waiting then moves the records over
+ * into log_buf. Consoles are driven by the printk kthread, except while
+ * oopsing, before the kthread runs and with printk.synchronous=1, when
+ * printk() calls them directly as it always did.
+ *
+ * Producers reserve space by advancing ring_head with cmpxchg(), fill in
+ * their record and mark it committed. There is a single consumer, under
+ * logbuf_lock, which takes committed records in order from ring_tail and
+ * zeroes them before the space can be reserved again.
+ */
+#define LOG_LINE_MAX		1024
+#define PRINTK_RING_SIZE	(1 << CONFIG_PRINTK_RING_SHIFT)
+#define PRINTK_RING_MASK	(PRINTK_RING_SIZE - 1)
+
+#define PREC_COMMITTED		0x1	/* record is complete */
+#define PREC_PAD		0x2	/* filler up to the end of the ring */
+
+struct printk_rec {
+	unsigned int	size;		/* of the whole record, aligned */
+	unsigned int	flags;
+	u64		ts_nsec;	/* cpu_clock() at printk() time */
+	char		text[0];	/* NUL terminated */
+};
 
-	boot_delay_msec();
-	printk_delay();
+static char printk_ring[PRINTK_RING_SIZE] __aligned(sizeof(u64));
+static unsigned long ring_head;	/* next byte to reserve */
+static unsigned long ring_tail;	/* next byte to consume, logbuf_lock */
+static atomic_t ring_dropped = ATOMIC_INIT(0);
 
-	preempt_disable();
-	/* This stops the holder of console_sem just where we want him */
-	raw_local_irq_save(flags);
-	this_cpu = smp_processor_id();
+/* Formatting buffers: one for NMIs, one for everything else */
+static DEFINE_PER_CPU(char [2][LOG_LINE_MAX], printk_buf);
+static DEFINE_PER_CPU(int, printk_buf_busy);
 
-	/*
-	 * Ouch, printk recursed into itself!
-	 */
-	if (unlikely(printk_cpu == this_cpu)) {
-		/*
-		 * If a crash is occurring during printk() on this CPU,
-		 * then try to get the crash message out but make sure
-		 * we can't deadlock. Otherwise just return to avoid the
-		 * recursion and return - but flag the recursion so that
-		 * it can be printed at the next appropriate moment:
-		 */
-		if (!oops_in_progress) {
-			recursion_bug = 1;
-			goto out_restore_irqs;
-		}
-		zap_locks();
-	}
+static int printk_sync;
+module_param_named(synchronous, printk_sync, bool, S_IRUGO | S_IWUSR);
 
-	lockdep_off();
-	spin_lock(&logbuf_lock);
-	printk_cpu = this_cpu;
+static inline struct printk_rec *ring_rec(unsigned long pos)
+{
+	return (struct printk_rec *)&printk_ring[pos & PRINTK_RING_MASK];
+}
 
-	if (recursion_bug) {
-		recursion_bug = 0;
-		strcpy(printk_buf, recursion_bug_msg);
-		printed_len = strlen(recursion_bug_msg);
+/* Returns NULL if the ring is full */
+static struct printk_rec *log_ring_reserve(size_t text_len)
+{
+	unsigned long head, tail;
+	unsigned int size, pad;
+	struct printk_rec *rec;
+
+	size = ALIGN(sizeof(*rec) + text_len + 1, sizeof(u64));
+	do {
+		head = ACCESS_ONCE(ring_head);
+		tail = ACCESS_ONCE(ring_tail);
+		pad = 0;
+		/* records are contiguous, skip what is left at the end */
+		if ((head & PRINTK_RING_MASK) + size > PRINTK_RING_SIZE)
+			pad = PRINTK_RING_SIZE - (head & PRINTK_RING_MASK);
+		if (head + pad + size - tail > PRINTK_RING_SIZE)
+			return NULL;
+	} while (cmpxchg(&ring_head, head, head + pad + size) != head);
+
+	if (pad) {
+		rec = ring_rec(head);
+		rec->size = pad;
+		smp_wmb();
+		rec->flags = PREC_COMMITTED | PREC_PAD;
 	}
-	/* Emit the output into the temporary buffer */
-	printed_len += vscnprintf(printk_buf + printed_len,
-				  sizeof(printk_buf) - printed_len, fmt, args);
 
-#ifdef	CONFIG_PRINTK_LL
-	printascii(printk_buf);
-#endif
+	rec = ring_rec(head + pad);
+	rec->size = size;
+	return rec;
+}
+
+static void log_ring_commit(struct printk_rec *rec)
+{
+	smp_wmb();
+	rec->flags = PREC_COMMITTED;
+}
+
+/* Is there a committed record for the consumer? Racy, just a hint */
+static int log_ring_pending(void)
+{
+	unsigned long tail = ACCESS_ONCE(ring_tail);
+
+	return tail != ACCESS_ONCE(ring_head) &&
+		(ACCESS_ONCE(ring_rec(tail)->flags) & PREC_COMMITTED);
+}
 
-	p = printk_buf;
+/*
+ * Copy one message into log_buf, adding the log level prefix and the
+ * time stamp at the start of each line as needed.
+ * The logbuf_lock must be held.
+ */
+static void log_store(const char *msg, u64 ts_nsec)
+{
+	int current_log_level = default_message_loglevel;
+	const char *p = msg;
+	size_t plen;
+	char special;
 
 	/* Read log level and handle special printk prefix */
 	plen = log_prefix(p, &current_log_level, &special);
@@ -1024,7 +1084,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	}
 
 	/* Send printk buffer to MIPI STM trace hardware too if enable */
-	stm_dup_printk(printk_buf, printed_len);
+	stm_dup_printk((char *)msg, strlen(msg));
 
 	/*
 	 * Copy the output into log_buf. If the caller didn't provide
@@ -1039,8 +1099,7 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 				int i;
 
 				for (i = 0; i < plen; i++)
-					emit_log_char(printk_buf[i]);
-				printed_len += plen;
+					emit_log_char(msg[i]);
 			} else {
 				/* Add log prefix */
 				emit_log_char('<');
@@ -1064,17 +1123,16 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 				emit_log_char_RAMbuf(tbuf, 3);
 			}
 #endif
-				printed_len += 3;
 			}
 
 			if (printk_time) {
-				/* Add the current time stamp */
+				/* Add the time stamp taken by printk() */
 				char tbuf[50], *tp;
 				unsigned tlen;
 				unsigned long long t;
 				unsigned long nanosec_rem;
 
-				t = cpu_clock(printk_cpu);
+				t = ts_nsec;
 				nanosec_rem = do_div(t, 1000000000);
 				tlen = sprintf(tbuf, "[%5lu.%06lu] ",
 						(unsigned long) t,
@@ -1085,7 +1143,6 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 #ifdef CONFIG_SAMSUNG_LOG_BUF				
 				emit_log_char_RAMbuf(tbuf, tlen);
 #endif
-				printed_len += tlen;
 			}
 
 			if (!*p)
@@ -1098,8 +1155,156 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	}
 
 #ifdef CONFIG_SAMSUNG_LOG_BUF
-	emit_log_char_RAMbuf(printk_buf, strlen(printk_buf));
+	emit_log_char_RAMbuf((char *)msg, strlen(msg));
 #endif
+}
+
+/*
+ * Move all committed records from the ring into log_buf.
+ * The logbuf_lock must be held, with interrupts disabled.
+ */
+static void log_ring_drain(void)
+{
+	unsigned int old_cpu = printk_cpu;
+	struct printk_rec *rec;
+	unsigned int flags, size;
+	int dropped;
+
+	/* printk() from in here only queues its message */
+	printk_cpu = smp_processor_id();
+
+	while (ring_tail != ACCESS_ONCE(ring_head)) {
+		rec = ring_rec(ring_tail);
+		flags = ACCESS_ONCE(rec->flags);
+		if (!(flags & PREC_COMMITTED))
+			break;
+		smp_rmb();
+		size = rec->size;
+		if (!(flags & PREC_PAD))
+			log_store(rec->text, rec->ts_nsec);
+		/* a reserved record must not look committed before it is */
+		memset(rec, 0, size);
+		smp_mb();
+		ring_tail += size;
+	}
+
+	dropped = atomic_xchg(&ring_dropped, 0);
+	if (unlikely(dropped)) {
+		char msg[64];
+
+		snprintf(msg, sizeof(msg),
+			 KERN_WARNING "printk: %d messages dropped\n", dropped);
+		log_store(msg, cpu_clock(printk_cpu));
+	}
+
+	printk_cpu = old_cpu;
+}
+
+/*
+ * Drain the ring if nobody holds logbuf_lock. If somebody does, it
+ * looks at the ring again after unlocking and sees our record.
+ */
+static void log_ring_trydrain(void)
+{
+	smp_mb();
+	while (spin_trylock(&logbuf_lock)) {
+		log_ring_drain();
+		spin_unlock(&logbuf_lock);
+		smp_mb();
+		if (!log_ring_pending())
+			break;
+	}
+}
+
+/*
+ * Print to the consoles from printk() itself? When oopsing we want the
+ * messages out now, and until the printk kthread runs nobody else would.
+ */
+static inline int printk_sync_console(void)
+{
+	return oops_in_progress || printk_sync || !printk_kthread ||
+		system_state != SYSTEM_RUNNING;
+}
+
+asmlinkage int vprintk(const char *fmt, va_list args)
+{
+	int printed_len = 0;
+	struct printk_rec *rec;
+	unsigned long flags;
+	int this_cpu, ctx;
+	int *buf_busy;
+	char *buf;
+
+	boot_delay_msec();
+	printk_delay();
+
+	preempt_disable();
+	/* This stops the holder of console_sem just where we want him */
+	raw_local_irq_save(flags);
+	this_cpu = smp_processor_id();
+
+	/*
+	 * Ouch, printk recursed into itself!
+	 */
+	ctx = in_nmi() ? 1 : 0;
+	buf_busy = &__get_cpu_var(printk_buf_busy);
+	if (unlikely(*buf_busy & (1 << ctx))) {
+		recursion_bug = 1;
+		goto out_restore_irqs;
+	}
+	*buf_busy |= 1 << ctx;
+	buf = __get_cpu_var(printk_buf)[ctx];
+
+	if (recursion_bug) {
+		recursion_bug = 0;
+		strcpy(buf, recursion_bug_msg);
+		printed_len = strlen(recursion_bug_msg);
+	}
+	/* Emit the output into the temporary buffer */
+	printed_len += vscnprintf(buf + printed_len,
+				  LOG_LINE_MAX - printed_len, fmt, args);
+
+#ifdef	CONFIG_PRINTK_LL
+	printascii(buf);
+#endif
+
+	rec = log_ring_reserve(printed_len);
+	if (!rec && printk_cpu != this_cpu) {
+		/* full, make room if that can be done without waiting */
+		log_ring_trydrain();
+		rec = log_ring_reserve(printed_len);
+	}
+	if (rec) {
+		rec->ts_nsec = cpu_clock(this_cpu);
+		memcpy(rec->text, buf, printed_len + 1);
+		log_ring_commit(rec);
+	} else {
+		atomic_inc(&ring_dropped);
+	}
+	*buf_busy &= ~(1 << ctx);
+
+	if (unlikely(printk_cpu == this_cpu)) {
+		/*
+		 * printk() from within log_buf handling on this CPU: the
+		 * record is picked up when that is done. If a crash is
+		 * occurring, try to get the message out but make sure
+		 * we can't deadlock.
+		 */
+		if (!oops_in_progress)
+			goto out_restore_irqs;
+		zap_locks();
+	}
+
+	if (!printk_sync_console()) {
+		log_ring_trydrain();
+		__this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
+		goto out_restore_irqs;
+	}
+
+	lockdep_off();
+	spin_lock(&logbuf_lock);
+	printk_cpu = this_cpu;
+	log_ring_drain();
 
 	/*
 	 * Try to acquire and then immediately release the
@@ -1130,6 +1335,10 @@ static void call_console_drivers(unsigned start, unsigned end)
 {
 }
 
+static void log_ring_drain(void)
+{
+}
+
 #endif
 
 static int __add_preferred_console(char *name, int idx, char *options,
@@ -1358,13 +1567,17 @@ int is_console_locked(void)
 	return console_locked;
 }
 
-static DEFINE_PER_CPU(int, printk_pending);
-
 void printk_tick(void)
 {
 	if (__this_cpu_read(printk_pending)) {
-		__this_cpu_write(printk_pending, 0);
-		wake_up_interruptible(&log_wait);
+		int pending = __this_cpu_xchg(printk_pending, 0);
+
+		if (pending & PRINTK_PENDING_OUTPUT && printk_kthread) {
+			printk_kthread_need_flush = 1;
+			wake_up_process(printk_kthread);
+		}
+		if (pending & PRINTK_PENDING_WAKEUP)
+			wake_up_interruptible(&log_wait);
 	}
 }
 
@@ -1378,7 +1591,7 @@ int printk_needs_cpu(int cpu)
 void wake_up_klogd(void)
 {
 	if (waitqueue_active(&log_wait))
-		this_cpu_write(printk_pending, 1);
+		this_cpu_or(printk_pending, PRINTK_PENDING_WAKEUP);
 }
 
 /**
@@ -1410,6 +1623,7 @@ void console_unlock(void)
 
 	for ( ; ; ) {
 		spin_lock_irqsave(&logbuf_lock, flags);
+		log_ring_drain();
 		wake_klogd |= log_start - log_end;
 		if (con_start == log_end)
 			break;			/* Nothing to print */
@@ -1736,6 +1950,41 @@ int unregister_console(struct console *console)
 }
 EXPORT_SYMBOL(unregister_console);
 
+#ifdef CONFIG_PRINTK
+/*
+ * Print what printk() queued, from process context where waiting for
+ * console_sem and for slow consoles hurts nobody.
+ */
+static int printk_kthread_func(void *data)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!xchg(&printk_kthread_need_flush, 0)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static void __init printk_kthread_start(void)
+{
+	struct task_struct *p;
+
+	p = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(p)) {
+		pr_warn("printk: cannot start printk kthread, "
+			"printing synchronously\n");
+		return;
+	}
+	printk_kthread = p;
+}
+#endif
+
 static int __init printk_late_init(void)
 {
 	struct console *con;
@@ -1748,6 +1997,9 @@ static int __init printk_late_init(void)
 		}
 	}
 	hotcpu_notifier(console_cpu_notify, 0);
+#ifdef CONFIG_PRINTK
+	printk_kthread_start();
+#endif
 	return 0;
 }
 late_initcall(printk_late_init);
@@ -1869,6 +2121,7 @@ void kmsg_dump(enum kmsg_dump_reason reason)
 	   there's not a lot we can do about that. The new messages
 	   will overwrite the start of what we dump. */
 	spin_lock_irqsave(&logbuf_lock, flags);
+	log_ring_drain();
 	end = log_end & LOG_BUF_MASK;
 	chars = logged_chars;
 	spin_unlock_irqrestore(&logbuf_lock, flags);
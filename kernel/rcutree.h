@@ -298,6 +298,25 @@ struct rcu_data {
 	unsigned long n_rp_need_fqs;
 	unsigned long n_rp_need_nothing;
 
+#ifdef CONFIG_RCU_NOCB_CPU
+	/* 6) Callback offloading to the rcuo kthreads (rcu_nocbs=). */
+	struct rcu_head *nocb_head;	/* CBs waiting for kthread. */
+	struct rcu_head **nocb_tail;
+	long nocb_q_count;		/* # CBs waiting for kthread. */
+	u64 nocb_first_queued;		/* local_clock() when oldest queued. */
+	raw_spinlock_t nocb_lock;	/* Protects the above four. */
+	wait_queue_head_t nocb_wq;	/* For kthread to wait for CBs. */
+	struct task_struct *nocb_kthread;
+	struct rcu_state *nocb_rsp;	/* Flavor, for the kthread. */
+	unsigned long n_nocb_batches;	/* Batches invoked by kthread. */
+	unsigned long n_nocb_invoked;	/* CBs invoked by kthread. */
+	long nocb_batch_max;		/* Largest batch. */
+	u64 nocb_latency_total;		/* Sum of oldest CB's queue-to-invoke */
+	u64 nocb_latency_max;		/*  time over batches, in ns. */
+	u64 nocb_run_total;		/* Sum of batch invocation times, */
+	u64 nocb_run_max;		/*  in ns. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
+
 	int cpu;
 };
 
@@ -466,5 +485,8 @@ static void rcu_yield(void (*f)(unsigned long), unsigned long arg);
 #endif /* #ifdef CONFIG_RCU_BOOST */
 static void rcu_cpu_kthread_setrt(int cpu, int to_rt);
 static void __cpuinit rcu_prepare_kthreads(int cpu);
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *head);
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
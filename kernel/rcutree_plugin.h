@@ -639,7 +639,7 @@ static void rcu_preempt_do_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state);
+	__call_rcu(head, func, &rcu_preempt_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -2008,3 +2008,196 @@ static void rcu_needs_cpu_flush(void)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback invocation from the CPUs given to the rcu_nocbs=
+ * boot parameter to one "rcuo" kthread per CPU and flavor, rcuos/N for
+ * rcu_sched, rcuob/N for rcu_bh and rcuop/N for rcu_preempt.  call_rcu()
+ * on such a CPU just appends the callback to the kthread's list.  The
+ * kthread takes the whole list, waits for a grace period by way of an
+ * ordinary callback queued on whatever CPU it runs on, and invokes the
+ * list.  The offloaded CPU thus neither invokes callbacks nor keeps
+ * them queued, which is also good for dyntick-idle.  On the other hand,
+ * a callback queued there waits for up to two grace periods.
+ *
+ * The kthreads start out affine to the CPUs that are not offloaded, if
+ * there are any, and can be moved and reprioritized from userspace.
+ */
+static cpumask_var_t rcu_nocb_mask;
+static bool have_rcu_nocb_mask;
+
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static bool is_nocb_cpu(int cpu)
+{
+	return have_rcu_nocb_mask && cpumask_test_cpu(cpu, rcu_nocb_mask);
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	raw_spin_lock_init(&rdp->nocb_lock);
+	init_waitqueue_head(&rdp->nocb_wq);
+	rdp->nocb_rsp = rsp;
+}
+
+/*
+ * Hand the callback to this CPU's rcuo kthread if the CPU is offloaded.
+ * Called with interrupts disabled.  Before the kthreads are spawned,
+ * callbacks wait on the list.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *head)
+{
+	bool was_empty;
+
+	if (!is_nocb_cpu(rdp->cpu))
+		return false;
+
+	raw_spin_lock(&rdp->nocb_lock);
+	was_empty = !rdp->nocb_head;
+	if (was_empty)
+		rdp->nocb_first_queued = local_clock();
+	*rdp->nocb_tail = head;
+	rdp->nocb_tail = &head->next;
+	rdp->nocb_q_count++;
+	raw_spin_unlock(&rdp->nocb_lock);
+
+	if (was_empty)
+		wake_up(&rdp->nocb_wq);
+	return true;
+}
+
+/*
+ * Wait for a grace period of the kthread's flavor.  The callback is
+ * queued on the current CPU without offloading, lest rcuo kthreads
+ * wait on each other.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_synchronize rcu;
+
+	init_rcu_head_on_stack(&rcu.head);
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rdp->nocb_rsp, false);
+	wait_for_completion(&rcu.completion);
+	destroy_rcu_head_on_stack(&rcu.head);
+}
+
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_data *rdp = arg;
+	struct rcu_head *list, *next;
+	u64 queued, start, end;
+	long count;
+
+	for (;;) {
+		wait_event_interruptible(rdp->nocb_wq,
+					 ACCESS_ONCE(rdp->nocb_head));
+
+		raw_spin_lock_irq(&rdp->nocb_lock);
+		list = rdp->nocb_head;
+		rdp->nocb_head = NULL;
+		rdp->nocb_tail = &rdp->nocb_head;
+		count = rdp->nocb_q_count;
+		rdp->nocb_q_count = 0;
+		queued = rdp->nocb_first_queued;
+		raw_spin_unlock_irq(&rdp->nocb_lock);
+		if (!list)
+			continue;
+
+		rcu_nocb_wait_gp(rdp);
+
+		/* Callbacks expect to run with bottom halves disabled. */
+		start = local_clock();
+		while (list) {
+			next = list->next;
+			prefetch(next);
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			__rcu_reclaim(list);
+			local_bh_enable();
+			list = next;
+			cond_resched();
+		}
+		end = local_clock();
+
+		rdp->n_nocb_batches++;
+		rdp->n_nocb_invoked += count;
+		rdp->nocb_batch_max = max(rdp->nocb_batch_max, count);
+		rdp->nocb_latency_total += start - queued;
+		rdp->nocb_latency_max = max(rdp->nocb_latency_max,
+					    start - queued);
+		rdp->nocb_run_total += end - start;
+		rdp->nocb_run_max = max(rdp->nocb_run_max, end - start);
+	}
+	return 0;
+}
+
+static void __init rcu_spawn_nocb_kthreads_rsp(struct rcu_state *rsp,
+					       const struct cpumask *affinity)
+{
+	struct rcu_data *rdp;
+	struct task_struct *t;
+	int cpu;
+
+	for_each_cpu_and(cpu, rcu_nocb_mask, cpu_possible_mask) {
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		/* rsp->name is "rcu_sched_state" and so on. */
+		t = kthread_create(rcu_nocb_kthread, rdp, "rcuo%c/%d",
+				   rsp->name[4], cpu);
+		if (WARN_ON_ONCE(IS_ERR(t)))
+			continue;
+		if (!cpumask_empty(affinity))
+			set_cpus_allowed_ptr(t, affinity);
+		rdp->nocb_kthread = t;
+		wake_up_process(t);
+	}
+}
+
+static int __init rcu_spawn_nocb_kthreads(void)
+{
+	cpumask_var_t affinity;
+	char buf[64];
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&affinity, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_andnot(affinity, cpu_possible_mask, rcu_nocb_mask);
+
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	pr_info("\tOffloading RCU callbacks from CPUs: %s.\n", buf);
+	rcu_spawn_nocb_kthreads_rsp(&rcu_sched_state, affinity);
+	rcu_spawn_nocb_kthreads_rsp(&rcu_bh_state, affinity);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads_rsp(&rcu_preempt_state, affinity);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+
+	free_cpumask_var(affinity);
+	return 0;
+}
+early_initcall(rcu_spawn_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp,
+						  struct rcu_state *rsp)
+{
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *head)
+{
+	return false;
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -274,6 +274,68 @@ static int rcu_boost_trace_create_file(struct dentry *rcudir)
 
 #endif /* #else #ifdef CONFIG_RCU_BOOST */
 
+#ifdef CONFIG_RCU_NOCB_CPU
+
+static void print_one_rcu_nocb(struct seq_file *m, struct rcu_data *rdp)
+{
+	unsigned long nb = rdp->n_nocb_batches;
+
+	if (!rdp->nocb_kthread)
+		return;
+	seq_printf(m, "%3d%c q=%ld nb=%lu ci=%lu bm=%ld",
+		   rdp->cpu, cpu_is_offline(rdp->cpu) ? '!' : ' ',
+		   ACCESS_ONCE(rdp->nocb_q_count), nb, rdp->n_nocb_invoked,
+		   rdp->nocb_batch_max);
+	seq_printf(m, " lat=%llu/%llu run=%llu/%llu\n",
+		   nb ? div_u64(div_u64(rdp->nocb_latency_total, nb),
+				NSEC_PER_USEC) : 0,
+		   div_u64(rdp->nocb_latency_max, NSEC_PER_USEC),
+		   nb ? div_u64(div_u64(rdp->nocb_run_total, nb),
+				NSEC_PER_USEC) : 0,
+		   div_u64(rdp->nocb_run_max, NSEC_PER_USEC));
+}
+
+static int show_rcu_nocb(struct seq_file *m, void *unused)
+{
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	seq_puts(m, "rcu_preempt:\n");
+	PRINT_RCU_DATA(rcu_preempt_data, print_one_rcu_nocb, m);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	seq_puts(m, "rcu_sched:\n");
+	PRINT_RCU_DATA(rcu_sched_data, print_one_rcu_nocb, m);
+	seq_puts(m, "rcu_bh:\n");
+	PRINT_RCU_DATA(rcu_bh_data, print_one_rcu_nocb, m);
+	return 0;
+}
+
+static int rcu_nocb_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, show_rcu_nocb, NULL);
+}
+
+static const struct file_operations rcu_nocb_fops = {
+	.owner = THIS_MODULE,
+	.open = rcu_nocb_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int rcu_nocb_trace_create_file(struct dentry *rcudir)
+{
+	return !debugfs_create_file("rcuoffload", 0444, rcudir, NULL,
+				    &rcu_nocb_fops);
+}
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static int rcu_nocb_trace_create_file(struct dentry *rcudir)
+{
+	return 0;  /* There cannot be an error if we didn't create it! */
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
+
 static void print_one_rcu_state(struct seq_file *m, struct rcu_state *rsp)
 {
 	unsigned long gpnum;
@@ -477,6 +539,9 @@ static int __init rcutree_trace_init(void)
 	if (rcu_boost_trace_create_file(rcudir))
 		goto free_out;
 
+	if (rcu_nocb_trace_create_file(rcudir))
+		goto free_out;
+
 	retval = debugfs_create_file("rcugp", 0444, rcudir, NULL, &rcugp_fops);
 	if (!retval)
 		goto free_out;
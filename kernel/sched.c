@@ -261,6 +261,8 @@ struct task_group {
 	/* runqueue "owned" by this group on each cpu */
 	struct cfs_rq **cfs_rq;
 	unsigned long shares;
+	/* tasks of the group are treated as SCHED_LATENCY_SENSITIVE */
+	int latency_sensitive;
 
 	atomic_t load_weight;
 #endif
@@ -339,6 +341,23 @@ struct cfs_rq {
 	unsigned int nr_spread_over;
 #endif
 
+	/*
+	 * Per-entity load tracking: runnable_load_avg is the sum of the
+	 * load_avg_contrib of the entities queued on this cfs_rq,
+	 * blocked_load_avg that of the entities that went to sleep from it,
+	 * still decaying. util_runnable_avg and util_blocked_avg are the same
+	 * sums of util_avg_contrib, the share of time the entities ran.
+	 *
+	 * decay_counter counts the decay periods applied to the blocked sums,
+	 * so a waking entity can catch up its own contribution;
+	 * removed_load/removed_util collect contributions of blocked entities
+	 * that migrated away, to be subtracted under our rq->lock.
+	 */
+	unsigned long runnable_load_avg, blocked_load_avg;
+	unsigned long util_runnable_avg, util_blocked_avg;
+	atomic64_t decay_counter, removed_load, removed_util;
+	u64 last_decay;
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	struct rq *rq;	/* cpu runqueue to which this cfs_rq is attached */
 
@@ -506,6 +525,9 @@ struct rq {
 	u64 clock;
 	u64 clock_task;
 
+	/* Decayed fraction of time this cpu was not idle */
+	struct sched_avg avg;
+
 	atomic_t nr_iowait;
 
 #ifdef CONFIG_SMP
@@ -2030,6 +2052,40 @@ static void update_rq_clock_task(struct rq *rq, s64 delta)
 
 #endif /* CONFIG_IRQ_TIME_ACCOUNTING */
 
+static void idle_enter_fair(struct rq *rq);
+static void idle_exit_fair(struct rq *rq);
+
+#ifdef CONFIG_CPU_FREQ
+static DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_set_update_util_data - install a utilization update callback
+ * @cpu: the cpu to install it for
+ * @data: the callback, or NULL to remove it
+ *
+ * Callers removing a callback must wait for synchronize_sched() before
+ * freeing @data or unloading the code ->func points to.
+ */
+void cpufreq_set_update_util_data(int cpu, struct update_util_data *data)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_set_update_util_data);
+
+/* The utilization of @rq may have changed, tell the governor */
+static inline void cpufreq_update_util(struct rq *rq)
+{
+	struct update_util_data *data;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (data)
+		data->func(data, cpu_of(rq), rq->clock);
+}
+#else
+static inline void cpufreq_update_util(struct rq *rq) { }
+#endif
+
 #include "sched_idletask.c"
 #include "sched_fair.c"
 #include "sched_rt.c"
@@ -2223,6 +2279,8 @@ void set_task_cpu(struct task_struct *p, unsigned int new_cpu)
 	trace_sched_migrate_task(p, new_cpu);
 
 	if (task_cpu(p) != new_cpu) {
+		if (p->sched_class->migrate_task_rq)
+			p->sched_class->migrate_task_rq(p, new_cpu);
 		p->se.nr_migrations++;
 		perf_sw_event(PERF_COUNT_SW_CPU_MIGRATIONS, 1, 1, NULL, 0);
 	}
@@ -2844,6 +2902,7 @@ static void __sched_fork(struct task_struct *p)
 	p->se.nr_migrations		= 0;
 	p->se.vruntime			= 0;
 	INIT_LIST_HEAD(&p->se.group_node);
+	memset(&p->se.avg, 0, sizeof(p->se.avg));
 
 #ifdef CONFIG_SCHEDSTATS
 	memset(&p->se.statistics, 0, sizeof(p->se.statistics));
@@ -2887,6 +2946,8 @@ void sched_fork(struct task_struct *p)
 			set_load_weight(p);
 		}
 
+		p->sched_latency_sensitive = 0;
+
 		/*
 		 * We don't need the reset flag anymore after the fork. It has
 		 * fulfilled its duty:
@@ -4109,7 +4170,9 @@ void scheduler_tick(void)
 	raw_spin_lock(&rq->lock);
 	update_rq_clock(rq);
 	update_cpu_load_active(rq);
+	update_rq_runnable_avg(rq, curr != rq->idle);
 	curr->sched_class->task_tick(rq, curr, 0);
+	cpufreq_update_util(rq);
 	raw_spin_unlock(&rq->lock);
 
 	perf_event_task_tick();
@@ -5167,7 +5230,7 @@ static int __sched_setscheduler(struct task_struct *p, int policy,
 	unsigned long flags;
 	const struct sched_class *prev_class;
 	struct rq *rq;
-	int reset_on_fork;
+	int reset_on_fork, latency_sensitive;
 
 	/* may grab non-irq protected spin_locks */
 	BUG_ON(in_interrupt());
@@ -5175,10 +5238,12 @@ recheck:
 	/* double check policy once rq lock held */
 	if (policy < 0) {
 		reset_on_fork = p->sched_reset_on_fork;
+		latency_sensitive = p->sched_latency_sensitive;
 		policy = oldpolicy = p->policy;
 	} else {
 		reset_on_fork = !!(policy & SCHED_RESET_ON_FORK);
-		policy &= ~SCHED_RESET_ON_FORK;
+		latency_sensitive = !!(policy & SCHED_LATENCY_SENSITIVE);
+		policy &= ~(SCHED_RESET_ON_FORK | SCHED_LATENCY_SENSITIVE);
 
 		if (policy != SCHED_FIFO && policy != SCHED_RR &&
 				policy != SCHED_NORMAL && policy != SCHED_BATCH &&
@@ -5232,6 +5297,10 @@ recheck:
 		/* Normal users shall not reset the sched_reset_on_fork flag */
 		if (p->sched_reset_on_fork && !reset_on_fork)
 			return -EPERM;
+
+		/* Normal users may clear the latency hint but not set it */
+		if (latency_sensitive && !p->sched_latency_sensitive)
+			return -EPERM;
 	}
 
 	if (user) {
@@ -5261,7 +5330,8 @@ recheck:
 	 * If not changing anything there's no need to proceed further:
 	 */
 	if (unlikely(policy == p->policy && (!rt_policy(policy) ||
-			param->sched_priority == p->rt_priority))) {
+			param->sched_priority == p->rt_priority) &&
+			latency_sensitive == p->sched_latency_sensitive)) {
 
 		__task_rq_unlock(rq);
 		raw_spin_unlock_irqrestore(&p->pi_lock, flags);
@@ -5297,6 +5367,7 @@ recheck:
 		p->sched_class->put_prev_task(rq, p);
 
 	p->sched_reset_on_fork = reset_on_fork;
+	p->sched_latency_sensitive = latency_sensitive;
 
 	oldprio = p->prio;
 	prev_class = p->sched_class;
@@ -5414,7 +5485,9 @@ SYSCALL_DEFINE1(sched_getscheduler, pid_t, pid)
 		retval = security_task_getscheduler(p);
 		if (!retval)
 			retval = p->policy
-				| (p->sched_reset_on_fork ? SCHED_RESET_ON_FORK : 0);
+				| (p->sched_reset_on_fork ? SCHED_RESET_ON_FORK : 0)
+				| (p->sched_latency_sensitive ?
+				   SCHED_LATENCY_SENSITIVE : 0);
 	}
 	rcu_read_unlock();
 	return retval;
@@ -8038,6 +8111,10 @@ static void init_cfs_rq(struct cfs_rq *cfs_rq, struct rq *rq)
 #ifndef CONFIG_64BIT
 	cfs_rq->min_vruntime_copy = cfs_rq->min_vruntime;
 #endif
+	/* a blocked entity's decay_count is never 0, see sched_fair.c */
+	atomic64_set(&cfs_rq->decay_counter, 1);
+	atomic64_set(&cfs_rq->removed_load, 0);
+	atomic64_set(&cfs_rq->removed_util, 0);
 }
 
 static void init_rt_rq(struct rt_rq *rt_rq, struct rq *rq)
@@ -9152,6 +9229,27 @@ static u64 cpu_shares_read_u64(struct cgroup *cgrp, struct cftype *cft)
 
 	return (u64) scale_load_down(tg->shares);
 }
+
+static int cpu_latency_sensitive_write_u64(struct cgroup *cgrp,
+					   struct cftype *cft, u64 val)
+{
+	struct task_group *tg = cgroup_tg(cgrp);
+
+	/* it would apply to every task on the system */
+	if (tg == &root_task_group)
+		return -EINVAL;
+	if (val > 1)
+		return -EINVAL;
+
+	tg->latency_sensitive = val;
+	return 0;
+}
+
+static u64 cpu_latency_sensitive_read_u64(struct cgroup *cgrp,
+					  struct cftype *cft)
+{
+	return cgroup_tg(cgrp)->latency_sensitive;
+}
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
 #ifdef CONFIG_RT_GROUP_SCHED
@@ -9185,6 +9283,11 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "latency_sensitive",
+		.read_u64 = cpu_latency_sensitive_read_u64,
+		.write_u64 = cpu_latency_sensitive_write_u64,
+	},
 #endif
 #ifdef CONFIG_RT_GROUP_SCHED
 	{
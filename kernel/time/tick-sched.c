@@ -283,6 +283,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	 */
 	ts->inidle = 1;
 
+	timer_stats_idle_wakeup_end();
 	now = tick_nohz_start_idle(cpu, ts);
 
 	/*
@@ -505,6 +506,7 @@ void tick_nohz_restart_sched_tick(void)
 	ktime_t now;
 
 	local_irq_disable();
+	timer_stats_idle_wakeup_end();
 	if (ts->idle_active || (ts->inidle && ts->tick_stopped))
 		now = ktime_get();
 
@@ -683,11 +685,14 @@ static inline void tick_check_nohz(int cpu)
 	if (!ts->idle_active && !ts->tick_stopped)
 		return;
 	now = ktime_get();
+	if (ts->idle_active && ts->tick_stopped)
+		timer_stats_idle_wakeup();
 	if (ts->idle_active)
 		tick_nohz_stop_idle(cpu, now);
 	if (ts->tick_stopped) {
 		tick_nohz_update_jiffies(now);
 		tick_nohz_kick_tick(cpu, now);
+		coalesce_timers();
 	}
 }
 
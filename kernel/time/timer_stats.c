@@ -31,6 +31,10 @@
  * Display the information collected so far:
  * # cat /proc/timer_stats
  *
+ * On NO_HZ kernels the wakeups from idle are counted as well, and each is
+ * charged to the timer that was due, if any. Timers that ran early within
+ * their slack because the cpu was awake anyway are counted as coalesced.
+ *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
@@ -42,6 +46,7 @@
 #include <linux/sched.h>
 #include <linux/seq_file.h>
 #include <linux/kallsyms.h>
+#include <linux/tick.h>
 
 #include <asm/uaccess.h>
 
@@ -70,6 +75,13 @@ struct entry {
 	unsigned long		count;
 	unsigned int		timer_flag;
 
+	/*
+	 * Of those, wakeups from idle it caused and
+	 * expiries it shared with another wakeup:
+	 */
+	unsigned long		wakeups;
+	unsigned long		coalesced;
+
 	/*
 	 * We save the command-line string to preserve
 	 * this information past task exit:
@@ -118,6 +130,13 @@ static struct entry entries[MAX_ENTRIES];
 
 static atomic_t overflow_count;
 
+/*
+ * Wakeups from NO_HZ idle, and whether the current one is still
+ * waiting for the timer it is charged to:
+ */
+static DEFINE_PER_CPU(unsigned long, tstats_wakeups);
+static DEFINE_PER_CPU(int, tstats_wakeup_pending);
+
 /*
  * The entries are in a hash-table, for fast lookup:
  */
@@ -137,6 +156,10 @@ static struct entry *tstat_hash_table[TSTAT_HASH_SIZE] __read_mostly;
 
 static void reset_entries(void)
 {
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		per_cpu(tstats_wakeups, cpu) = 0;
 	nr_entries = 0;
 	memset(entries, 0, sizeof(entries));
 	memset(tstat_hash_table, 0, sizeof(tstat_hash_table));
@@ -204,6 +227,8 @@ static struct entry *tstat_lookup(struct entry *entry, char *comm)
 	if (curr) {
 		*curr = *entry;
 		curr->count = 0;
+		curr->wakeups = 0;
+		curr->coalesced = 0;
 		curr->next = NULL;
 		memcpy(curr->comm, comm, TASK_COMM_LEN);
 
@@ -220,6 +245,19 @@ static struct entry *tstat_lookup(struct entry *entry, char *comm)
 	return curr;
 }
 
+/*
+ * The tick only carries the wakeups for the timer wheel, leave them
+ * to the timer that was due:
+ */
+static inline int is_tick_timer(void *timer)
+{
+#ifdef CONFIG_NO_HZ
+	return timer == &tick_get_tick_sched(smp_processor_id())->sched_timer;
+#else
+	return 0;
+#endif
+}
+
 /**
  * timer_stats_update_stats - Update the statistics for a timer.
  * @timer:	pointer to either a timer_list or a hrtimer
@@ -227,9 +265,12 @@ static struct entry *tstat_lookup(struct entry *entry, char *comm)
  * @startf:	pointer to the function which did the timer setup
  * @timerf:	pointer to the timer callback function of the timer
  * @comm:	name of the process which set up the timer
+ * @timer_flag:	TIMER_STATS_FLAG_*
  *
  * When the timer is already registered, then the event counter is
  * incremented. Otherwise the timer is registered in a free slot.
+ * The first timer to expire after a wakeup from idle, other than the
+ * tick and coalesced ones, is charged with the wakeup.
  */
 void timer_stats_update_stats(void *timer, pid_t pid, void *startf,
 			      void *timerf, char *comm,
@@ -251,22 +292,54 @@ void timer_stats_update_stats(void *timer, pid_t pid, void *startf,
 	input.start_func = startf;
 	input.expire_func = timerf;
 	input.pid = pid;
-	input.timer_flag = timer_flag;
+	input.timer_flag = timer_flag & TIMER_STATS_FLAG_DEFERRABLE;
 
 	raw_spin_lock_irqsave(lock, flags);
 	if (!timer_stats_active)
 		goto out_unlock;
 
 	entry = tstat_lookup(&input, comm);
-	if (likely(entry))
+	if (likely(entry)) {
 		entry->count++;
-	else
+		if (timer_flag & TIMER_STATS_FLAG_COALESCED) {
+			entry->coalesced++;
+		} else if (__get_cpu_var(tstats_wakeup_pending) &&
+			   !is_tick_timer(timer)) {
+			__get_cpu_var(tstats_wakeup_pending) = 0;
+			entry->wakeups++;
+		}
+	} else
 		atomic_inc(&overflow_count);
 
  out_unlock:
 	raw_spin_unlock_irqrestore(lock, flags);
 }
 
+/**
+ * timer_stats_idle_wakeup - Count a wakeup from NO_HZ idle.
+ *
+ * Called from irq_enter() when the cpu leaves idle with the tick stopped.
+ */
+void timer_stats_idle_wakeup(void)
+{
+	if (likely(!timer_stats_active))
+		return;
+
+	__get_cpu_var(tstats_wakeups)++;
+	__get_cpu_var(tstats_wakeup_pending) = 1;
+}
+
+/**
+ * timer_stats_idle_wakeup_end - The wakeup from idle is over.
+ *
+ * Called when the cpu goes back to idle or starts running tasks. A wakeup
+ * no timer was charged with by then came from an interrupt or an IPI.
+ */
+void timer_stats_idle_wakeup_end(void)
+{
+	__get_cpu_var(tstats_wakeup_pending) = 0;
+}
+
 static void print_name_offset(struct seq_file *m, unsigned long addr)
 {
 	char symname[KSYM_NAME_LEN];
@@ -279,12 +352,13 @@ static void print_name_offset(struct seq_file *m, unsigned long addr)
 
 static int tstats_show(struct seq_file *m, void *v)
 {
+	unsigned long wakeups = 0, charged = 0;
 	struct timespec period;
 	struct entry *entry;
 	unsigned long ms;
 	long events = 0;
 	ktime_t time;
-	int i;
+	int i, cpu;
 
 	mutex_lock(&show_mutex);
 	/*
@@ -298,7 +372,7 @@ static int tstats_show(struct seq_file *m, void *v)
 	period = ktime_to_timespec(time);
 	ms = period.tv_nsec / 1000000;
 
-	seq_puts(m, "Timer Stats Version: v0.2\n");
+	seq_puts(m, "Timer Stats Version: v0.3\n");
 	seq_printf(m, "Sample period: %ld.%03ld s\n", period.tv_sec, ms);
 	if (atomic_read(&overflow_count))
 		seq_printf(m, "Overflow: %d entries\n",
@@ -333,6 +407,36 @@ static int tstats_show(struct seq_file *m, void *v)
 	else
 		seq_printf(m, "%ld total events\n", events);
 
+	for_each_possible_cpu(cpu)
+		wakeups += per_cpu(tstats_wakeups, cpu);
+	if (!wakeups)
+		goto out;
+
+	if (period.tv_sec)
+		seq_printf(m, "%lu wakeups from idle, %lu.%03lu wakeups/sec\n",
+			   wakeups, wakeups * 1000 / ms,
+			   (wakeups * 1000000 / ms) % 1000);
+	else
+		seq_printf(m, "%lu wakeups from idle\n", wakeups);
+
+	for (i = 0; i < nr_entries; i++) {
+		entry = entries + i;
+		if (!entry->wakeups && !entry->coalesced)
+			continue;
+
+		seq_printf(m, " %4luW %4luC, %5d %-16s ", entry->wakeups,
+			   entry->coalesced, entry->pid, entry->comm);
+		print_name_offset(m, (unsigned long)entry->start_func);
+		seq_puts(m, " (");
+		print_name_offset(m, (unsigned long)entry->expire_func);
+		seq_puts(m, ")\n");
+
+		charged += entry->wakeups;
+	}
+	if (wakeups > charged)
+		seq_printf(m, " %4luW other (interrupts, IPIs)\n",
+			   wakeups - charged);
+out:
 	mutex_unlock(&show_mutex);
 
 	return 0;
@@ -78,6 +78,7 @@ struct tvec_base {
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
+	struct list_head coalesced;
 	struct tvec_root tv1;
 	struct tvec tv2;
 	struct tvec tv3;
@@ -387,7 +388,7 @@ void __timer_stats_timer_set_start_info(struct timer_list *timer, void *addr)
 	timer->start_pid = current->pid;
 }
 
-static void timer_stats_account_timer(struct timer_list *timer)
+static void timer_stats_account_timer(struct timer_list *timer, int coalesced)
 {
 	unsigned int flag = 0;
 
@@ -395,13 +396,16 @@ static void timer_stats_account_timer(struct timer_list *timer)
 		return;
 	if (unlikely(tbase_get_deferrable(timer->base)))
 		flag |= TIMER_STATS_FLAG_DEFERRABLE;
+	if (coalesced)
+		flag |= TIMER_STATS_FLAG_COALESCED;
 
 	timer_stats_update_stats(timer, timer->start_pid, timer->start_site,
 				 timer->function, timer->start_comm, flag);
 }
 
 #else
-static void timer_stats_account_timer(struct timer_list *timer) {}
+static void timer_stats_account_timer(struct timer_list *timer,
+				      int coalesced) {}
 #endif
 
 #ifdef CONFIG_DEBUG_OBJECTS_TIMERS
@@ -659,7 +663,7 @@ static struct tvec_base *lock_timer_base(struct timer_list *timer,
 
 static inline int
 __mod_timer(struct timer_list *timer, unsigned long expires,
-						bool pending_only, int pinned)
+	    unsigned long soft_expires, bool pending_only, int pinned)
 {
 	struct tvec_base *base, *new_base;
 	unsigned long flags;
@@ -710,6 +714,7 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	}
 
 	timer->expires = expires;
+	timer->soft_expires = soft_expires;
 	if (time_before(timer->expires, base->next_timer) &&
 	    !tbase_get_deferrable(timer->base))
 		base->next_timer = timer->expires;
@@ -733,7 +738,7 @@ out_unlock:
  */
 int mod_timer_pending(struct timer_list *timer, unsigned long expires)
 {
-	return __mod_timer(timer, expires, true, TIMER_NOT_PINNED);
+	return __mod_timer(timer, expires, expires, true, TIMER_NOT_PINNED);
 }
 EXPORT_SYMBOL(mod_timer_pending);
 
@@ -794,17 +799,26 @@ unsigned long apply_slack(struct timer_list *timer, unsigned long expires)
  */
 int mod_timer(struct timer_list *timer, unsigned long expires)
 {
+	unsigned long soft_expires = expires;
+
 	expires = apply_slack(timer, expires);
 
 	/*
 	 * This is a common optimization triggered by the
 	 * networking code - if the timer is re-modified
-	 * to be the same thing then just return:
+	 * to be the same thing then just return. Not if the
+	 * slack begins later than it did though: the timer
+	 * may already be on the coalesced list, and only
+	 * __mod_timer() takes it off there again.
 	 */
-	if (timer_pending(timer) && timer->expires == expires)
+	if (timer_pending(timer) && timer->expires == expires &&
+	    !time_after(soft_expires, timer->soft_expires)) {
+		timer->soft_expires = soft_expires;
 		return 1;
+	}
 
-	return __mod_timer(timer, expires, false, TIMER_NOT_PINNED);
+	return __mod_timer(timer, expires, soft_expires, false,
+			   TIMER_NOT_PINNED);
 }
 EXPORT_SYMBOL(mod_timer);
 
@@ -826,7 +840,7 @@ int mod_timer_pinned(struct timer_list *timer, unsigned long expires)
 	if (timer->expires == expires && timer_pending(timer))
 		return 1;
 
-	return __mod_timer(timer, expires, false, TIMER_PINNED);
+	return __mod_timer(timer, expires, expires, false, TIMER_PINNED);
 }
 EXPORT_SYMBOL(mod_timer_pinned);
 
@@ -868,6 +882,7 @@ void add_timer_on(struct timer_list *timer, int cpu)
 	spin_lock_irqsave(&base->lock, flags);
 	timer_set_base(timer, base);
 	debug_activate(timer, timer->expires);
+	timer->soft_expires = timer->expires;
 	if (time_before(timer->expires, base->next_timer) &&
 	    !tbase_get_deferrable(timer->base))
 		base->next_timer = timer->expires;
@@ -1082,21 +1097,52 @@ static void call_timer_fn(struct timer_list *timer, void (*fn)(unsigned long),
 
 #define INDEX(N) ((base->timer_jiffies >> (TVR_BITS + (N) * TVN_BITS)) & TVN_MASK)
 
+/*
+ * Run the timers on @head, which has been taken off the wheel.
+ * Called and returns with base->lock held, drops it around the
+ * callbacks.
+ */
+static void run_timer_list(struct tvec_base *base, struct list_head *head,
+			   int coalesced)
+{
+	struct timer_list *timer;
+
+	while (!list_empty(head)) {
+		void (*fn)(unsigned long);
+		unsigned long data;
+
+		timer = list_first_entry(head, struct timer_list,entry);
+		fn = timer->function;
+		data = timer->data;
+
+		timer_stats_account_timer(timer, coalesced);
+
+		base->running_timer = timer;
+		detach_timer(timer, 1);
+
+		spin_unlock_irq(&base->lock);
+		call_timer_fn(timer, fn, data);
+		spin_lock_irq(&base->lock);
+	}
+}
+
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
  *
  * This function cascades all vectors and executes all expired timer
- * vectors.
+ * vectors, and the timers coalesce_timers() pulled into this wakeup.
  */
 static inline void __run_timers(struct tvec_base *base)
 {
-	struct timer_list *timer;
+	struct list_head work_list;
 
 	spin_lock_irq(&base->lock);
+	if (!list_empty(&base->coalesced)) {
+		list_replace_init(&base->coalesced, &work_list);
+		run_timer_list(base, &work_list, 1);
+	}
 	while (time_after_eq(jiffies, base->timer_jiffies)) {
-		struct list_head work_list;
-		struct list_head *head = &work_list;
 		int index = base->timer_jiffies & TVR_MASK;
 
 		/*
@@ -1109,23 +1155,7 @@ static inline void __run_timers(struct tvec_base *base)
 			cascade(base, &base->tv5, INDEX(3));
 		++base->timer_jiffies;
 		list_replace_init(base->tv1.vec + index, &work_list);
-		while (!list_empty(head)) {
-			void (*fn)(unsigned long);
-			unsigned long data;
-
-			timer = list_first_entry(head, struct timer_list,entry);
-			fn = timer->function;
-			data = timer->data;
-
-			timer_stats_account_timer(timer);
-
-			base->running_timer = timer;
-			detach_timer(timer, 1);
-
-			spin_unlock_irq(&base->lock);
-			call_timer_fn(timer, fn, data);
-			spin_lock_irq(&base->lock);
-		}
+		run_timer_list(base, &work_list, 0);
 	}
 	base->running_timer = NULL;
 	spin_unlock_irq(&base->lock);
@@ -1277,6 +1307,57 @@ unsigned long get_next_timer_interrupt(unsigned long now)
 
 	return cmp_next_hrtimer_event(now, expires);
 }
+
+/*
+ * How many jiffies ahead coalesce_timers() looks. A timer further out
+ * than that whose slack has already begun is rare, and the slots are
+ * walked with interrupts off.
+ */
+#define COALESCE_SLOTS	(TVR_SIZE / 4)
+
+/**
+ * coalesce_timers - run timers with slack in a wakeup from NO_HZ idle
+ *
+ * mod_timer() may put a timer anywhere between the time asked for and
+ * that time plus the slack, so the earliest expiry of the wheel (which
+ * is what the cpu sleeps until) already is the latest one common to all
+ * timers whose slack covers it. When the cpu is woken up for anything
+ * else - an hrtimer, an interrupt - the timers due in the next jiffies
+ * whose slack has begun are run in this wakeup instead of in one of
+ * their own: they are moved to the coalesced list and the timer softirq
+ * is raised, which runs them on irq_exit().
+ *
+ * Called from irq_enter() with interrupts disabled, after jiffies have
+ * been brought up to date.
+ */
+void coalesce_timers(void)
+{
+	struct tvec_base *base = __this_cpu_read(tvec_bases);
+	unsigned long now = jiffies, j;
+	struct timer_list *timer, *tmp;
+	int found = 0;
+
+	spin_lock(&base->lock);
+	for (j = now + 1; j - now <= COALESCE_SLOTS; j++) {
+		/* Slots beyond a full round of tv1 hold later timers */
+		if (j - base->timer_jiffies >= TVR_SIZE)
+			break;
+		list_for_each_entry_safe(timer, tmp,
+					 base->tv1.vec + (j & TVR_MASK), entry) {
+			if (time_before(now, timer->soft_expires))
+				continue;
+			if (timer->expires == base->next_timer &&
+			    !tbase_get_deferrable(timer->base))
+				base->next_timer = base->timer_jiffies;
+			list_move_tail(&timer->entry, &base->coalesced);
+			found = 1;
+		}
+	}
+	spin_unlock(&base->lock);
+
+	if (found)
+		raise_softirq_irqoff(TIMER_SOFTIRQ);
+}
 #endif
 
 /*
@@ -1310,7 +1391,8 @@ static void run_timer_softirq(struct softirq_action *h)
 
 	hrtimer_run_pending();
 
-	if (time_after_eq(jiffies, base->timer_jiffies))
+	if (time_after_eq(jiffies, base->timer_jiffies) ||
+	    !list_empty(&base->coalesced))
 		__run_timers(base);
 }
 
@@ -1468,7 +1550,7 @@ signed long __sched schedule_timeout(signed long timeout)
 	expire = timeout + jiffies;
 
 	setup_timer_on_stack(&timer, process_timeout, (unsigned long)current);
-	__mod_timer(&timer, expire, false, TIMER_NOT_PINNED);
+	__mod_timer(&timer, expire, expire, false, TIMER_NOT_PINNED);
 	schedule();
 	del_singleshot_timer_sync(&timer);
 
@@ -1643,6 +1725,7 @@ static int __cpuinit init_timers_cpu(int cpu)
 	}
 	for (j = 0; j < TVR_SIZE; j++)
 		INIT_LIST_HEAD(base->tv1.vec + j);
+	INIT_LIST_HEAD(&base->coalesced);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
@@ -1683,6 +1766,7 @@ static void __cpuinit migrate_timers(int cpu)
 
 	BUG_ON(old_base->running_timer);
 
+	migrate_timer_list(new_base, &old_base->coalesced);
 	for (i = 0; i < TVR_SIZE; i++)
 		migrate_timer_list(new_base, old_base->tv1.vec + i);
 	for (i = 0; i < TVN_SIZE; i++) {
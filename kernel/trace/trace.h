@@ -754,15 +754,43 @@ extern int apply_subsystem_event_filter(struct event_subsystem *system,
 extern void print_subsystem_event_filter(struct event_subsystem *system,
 					 struct trace_seq *s);
 extern int filter_assign_type(const char *type);
+extern struct ftrace_event_field *
+trace_find_event_field(struct ftrace_event_call *call, char *name);
+extern int create_event_filter(struct ftrace_event_call *call,
+			       char *filter_str, struct event_filter **filterp);
+extern void free_event_filter(struct event_filter *filter);
 
 struct list_head *
 trace_get_fields(struct ftrace_event_call *event_call);
 
+#ifdef CONFIG_EVENT_HIST
+extern int trace_event_hist_reg(struct ftrace_event_call *call, int on);
+extern const struct file_operations event_hist_fops;
+extern void event_hist_record(struct ftrace_event_call *call, void *rec);
+extern void event_hist_destroy(struct ftrace_event_call *call);
+#else
+static inline void
+event_hist_record(struct ftrace_event_call *call, void *rec) { }
+static inline void event_hist_destroy(struct ftrace_event_call *call) { }
+#endif
+
 static inline int
 filter_check_discard(struct ftrace_event_call *call, void *rec,
 		     struct ring_buffer *buffer,
 		     struct ring_buffer_event *event)
 {
+	/*
+	 * An event that is only registered for its histogram is counted
+	 * and dropped, it never reaches the reader of the ring buffer.
+	 */
+	if (unlikely(call->flags & TRACE_EVENT_FL_HIST)) {
+		event_hist_record(call, rec);
+		if (!(call->flags & TRACE_EVENT_FL_ENABLED)) {
+			ring_buffer_discard_commit(buffer, event);
+			return 1;
+		}
+	}
+
 	if (unlikely(call->flags & TRACE_EVENT_FL_FILTERED) &&
 	    !filter_match_preds(call->filter, rec)) {
 		ring_buffer_discard_commit(buffer, event);
@@ -210,7 +210,9 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 				tracing_stop_cmdline_record();
 				call->flags &= ~TRACE_EVENT_FL_RECORDED_CMD;
 			}
-			call->class->reg(call, TRACE_REG_UNREGISTER);
+			/* a histogram keeps the probe registered */
+			if (!(call->flags & TRACE_EVENT_FL_HIST))
+				call->class->reg(call, TRACE_REG_UNREGISTER);
 		}
 		break;
 	case 1:
@@ -219,7 +221,8 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 				tracing_start_cmdline_record();
 				call->flags |= TRACE_EVENT_FL_RECORDED_CMD;
 			}
-			ret = call->class->reg(call, TRACE_REG_REGISTER);
+			if (!(call->flags & TRACE_EVENT_FL_HIST))
+				ret = call->class->reg(call, TRACE_REG_REGISTER);
 			if (ret) {
 				tracing_stop_cmdline_record();
 				pr_info("event trace: Could not enable event "
@@ -234,6 +237,32 @@ static int ftrace_event_enable_disable(struct ftrace_event_call *call,
 	return ret;
 }
 
+#ifdef CONFIG_EVENT_HIST
+/*
+ * Register the probe of call for a histogram, independently of whether
+ * the event is enabled for tracing. Must be called with event_mutex held.
+ */
+int trace_event_hist_reg(struct ftrace_event_call *call, int on)
+{
+	int ret = 0;
+
+	if (on) {
+		if (call->flags & TRACE_EVENT_FL_HIST)
+			return 0;
+		if (!(call->flags & TRACE_EVENT_FL_ENABLED))
+			ret = call->class->reg(call, TRACE_REG_REGISTER);
+		if (!ret)
+			call->flags |= TRACE_EVENT_FL_HIST;
+	} else if (call->flags & TRACE_EVENT_FL_HIST) {
+		call->flags &= ~TRACE_EVENT_FL_HIST;
+		if (!(call->flags & TRACE_EVENT_FL_ENABLED))
+			call->class->reg(call, TRACE_REG_UNREGISTER);
+	}
+
+	return ret;
+}
+#endif /* CONFIG_EVENT_HIST */
+
 static void ftrace_clear_events(void)
 {
 	struct ftrace_event_call *call;
@@ -1206,6 +1235,12 @@ event_create_dir(struct ftrace_event_call *call, struct dentry *d_events,
 	trace_create_file("format", 0444, call->dir, call,
 			  format);
 
+#ifdef CONFIG_EVENT_HIST
+	if (call->class->reg)
+		trace_create_file("hist", 0644, call->dir, call,
+				  &event_hist_fops);
+#endif
+
 	return 0;
 }
 
@@ -1282,6 +1317,7 @@ static void remove_subsystem_dir(const char *name)
  */
 static void __trace_remove_event_call(struct ftrace_event_call *call)
 {
+	event_hist_destroy(call);
 	ftrace_event_enable_disable(call, 0);
 	if (call->event.funcs)
 		__unregister_ftrace_event(&call->event);
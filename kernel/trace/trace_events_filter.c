@@ -614,8 +614,8 @@ __find_event_field(struct list_head *head, char *name)
 	return NULL;
 }
 
-static struct ftrace_event_field *
-find_event_field(struct ftrace_event_call *call, char *name)
+struct ftrace_event_field *
+trace_find_event_field(struct ftrace_event_call *call, char *name)
 {
 	struct ftrace_event_field *field;
 	struct list_head *head;
@@ -956,7 +956,7 @@ static int filter_add_pred(struct filter_parse_state *ps,
 	else if (pred->op == OP_OR)
 		goto add_pred_fn;
 
-	field = find_event_field(call, pred->field_name);
+	field = trace_find_event_field(call, pred->field_name);
 	if (!field) {
 		parse_error(ps, FILT_ERR_FIELD_NOT_FOUND, 0);
 		return -EINVAL;
@@ -1942,6 +1942,50 @@ out_unlock:
 	return err;
 }
 
+/*
+ * Parse a filter for call that is not installed as the event filter,
+ * for users such as histograms that apply it on their own.
+ * Must be called with event_mutex held.
+ */
+int create_event_filter(struct ftrace_event_call *call, char *filter_str,
+			struct event_filter **filterp)
+{
+	struct filter_parse_state *ps;
+	struct event_filter *filter;
+	int err;
+
+	filter = __alloc_filter();
+	if (!filter)
+		return -ENOMEM;
+
+	err = -ENOMEM;
+	ps = kzalloc(sizeof(*ps), GFP_KERNEL);
+	if (!ps)
+		goto free_filter;
+
+	parse_init(ps, filter_ops, filter_str);
+	err = filter_parse(ps);
+	if (!err)
+		err = replace_preds(call, filter, ps, filter_str, false);
+
+	filter_opstack_clear(ps);
+	postfix_clear(ps);
+	kfree(ps);
+
+free_filter:
+	if (err)
+		__free_filter(filter);
+	else
+		*filterp = filter;
+
+	return err;
+}
+
+void free_event_filter(struct event_filter *filter)
+{
+	__free_filter(filter);
+}
+
 #ifdef CONFIG_PERF_EVENTS
 
 void ftrace_profile_free_filter(struct perf_event *event)
@@ -0,0 +1,583 @@
+/*
+ * In-kernel histograms of trace event fields
+ *
+ * Every event directory gets a 'hist' file. Writing a spec to it
+ *
+ *	keys=<field>[,<field>] [vals=<field>[,...]] [log2=<field>]
+ *		[size=<entries>] [if <filter>]
+ *
+ * registers the event and aggregates every hit that passes the filter
+ * into a hash table: per distinct key a hit count, the sums of the
+ * value fields and, with log2=, a histogram of one field in power of
+ * two buckets. An event that is not also enabled is dropped from the
+ * ring buffer right after it has been counted. Reading the file shows
+ * the entries, most hits first. Writing "clear" starts over with the
+ * same spec, writing "0" removes the histogram.
+ *
+ * Entries are inserted and updated locklessly from the probe, so any
+ * number of cpus can record at once. The table never grows: once it is
+ * full, hits for new keys are counted as dropped.
+ *
+ * The record is read from where the probe built it in the ring buffer.
+ * When the probe cannot reserve room there (tracing is off or stopped,
+ * or the buffer is full and does not overwrite) the hit cannot be
+ * filtered or keyed; it is counted as dropped as well.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; version 2 of the License.
+ */
+
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/sort.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+
+#include "trace.h"
+
+#define HIST_KEYS_MAX		2
+#define HIST_VALS_MAX		4
+/* Bucket 0 counts values below 1, bucket n counts [2^(n-1), 2^n) */
+#define HIST_LOG2_BUCKETS	64
+#define HIST_SIZE_DEFAULT	2048
+#define HIST_SIZE_MAX		65536
+
+struct hist_field {
+	const char		*name;
+	int			offset;
+	int			size;
+	int			is_signed;
+};
+
+struct hist_entry {
+	u64			key[HIST_KEYS_MAX];
+	atomic64_t		hitcount;
+	atomic64_t		sums[HIST_VALS_MAX];
+};
+
+/*
+ * Open addressed with twice as many slots as entries, so that the
+ * probe sequence for a key that is not in the table ends quickly at an
+ * empty slot. A slot is claimed by setting its hash, and the entry is
+ * taken from the preallocated pool and published once its key is set.
+ */
+struct hist_slot {
+	u32			hash;
+	struct hist_entry	*entry;
+};
+
+struct event_hist {
+	char			*spec;
+	struct event_filter	*filter;
+	struct hist_field	keys[HIST_KEYS_MAX];
+	struct hist_field	vals[HIST_VALS_MAX];
+	struct hist_field	log2;
+	int			n_keys;
+	int			n_vals;
+	int			has_log2;
+
+	unsigned int		size;
+	struct hist_slot	*slots;
+	struct hist_entry	*entries;
+	atomic_t		*buckets;
+	atomic_t		nr_entries;
+	atomic64_t		hits;
+	atomic_long_t		drops;
+};
+
+static u64 hist_field_value(struct hist_field *f, void *rec)
+{
+	void *addr = rec + f->offset;
+
+	switch (f->size) {
+	case 1:
+		return f->is_signed ? (u64)*(s8 *)addr : *(u8 *)addr;
+	case 2:
+		return f->is_signed ? (u64)*(s16 *)addr : *(u16 *)addr;
+	case 4:
+		return f->is_signed ? (u64)*(s32 *)addr : *(u32 *)addr;
+	default:
+		return *(u64 *)addr;
+	}
+}
+
+static unsigned int hist_log2_bucket(struct hist_field *f, u64 val)
+{
+	if (f->is_signed && (s64)val < 0)
+		return 0;
+	return min_t(unsigned int, fls64(val), HIST_LOG2_BUCKETS - 1);
+}
+
+static struct hist_entry *hist_find_entry(struct event_hist *hist, u64 *key)
+{
+	unsigned int mask = 2 * hist->size - 1;
+	struct hist_entry *entry;
+	struct hist_slot *slot;
+	unsigned int idx, i;
+	u32 hash, h;
+	int n;
+
+	hash = jhash2((u32 *)key, HIST_KEYS_MAX * 2, 0) ?: 1;
+
+	for (i = 0, idx = hash & mask; i <= mask; i++, idx = (idx + 1) & mask) {
+		slot = &hist->slots[idx];
+		h = ACCESS_ONCE(slot->hash);
+		if (!h) {
+			/*
+			 * Once full, claim no more slots: at most size plus
+			 * the racing inserters are claimed, so that the table
+			 * stays half empty and a missing key is found missing
+			 * after a short probe.
+			 */
+			if (atomic_read(&hist->nr_entries) >= hist->size)
+				return NULL;
+			h = cmpxchg(&slot->hash, 0, hash);
+			if (!h) {
+				n = atomic_inc_return(&hist->nr_entries) - 1;
+				/* Lost the race for the last entry */
+				if (n >= hist->size)
+					return NULL;
+				entry = &hist->entries[n];
+				memcpy(entry->key, key, sizeof(entry->key));
+				smp_wmb();
+				slot->entry = entry;
+				return entry;
+			}
+		}
+		if (h != hash)
+			continue;
+
+		/*
+		 * The key is being inserted from another context, possibly
+		 * one we interrupted, so don't wait for it.
+		 */
+		entry = ACCESS_ONCE(slot->entry);
+		if (!entry)
+			return NULL;
+		smp_read_barrier_depends();
+		if (!memcmp(entry->key, key, sizeof(entry->key)))
+			return entry;
+	}
+
+	return NULL;
+}
+
+/* Called from the event probe with preemption disabled */
+void event_hist_record(struct ftrace_event_call *call, void *rec)
+{
+	struct event_hist *hist = rcu_dereference_sched(call->hist);
+	u64 key[HIST_KEYS_MAX] = { };
+	struct hist_entry *entry;
+	unsigned int b;
+	int i;
+
+	if (!hist)
+		return;
+
+	if (hist->filter && !filter_match_preds(hist->filter, rec))
+		return;
+
+	atomic64_inc(&hist->hits);
+
+	for (i = 0; i < hist->n_keys; i++)
+		key[i] = hist_field_value(&hist->keys[i], rec);
+
+	entry = hist_find_entry(hist, key);
+	if (!entry) {
+		atomic_long_inc(&hist->drops);
+		return;
+	}
+
+	atomic64_inc(&entry->hitcount);
+	for (i = 0; i < hist->n_vals; i++)
+		atomic64_add(hist_field_value(&hist->vals[i], rec),
+			     &entry->sums[i]);
+
+	if (hist->has_log2) {
+		b = hist_log2_bucket(&hist->log2,
+				     hist_field_value(&hist->log2, rec));
+		atomic_inc(&hist->buckets[(entry - hist->entries) *
+					  HIST_LOG2_BUCKETS + b]);
+	}
+}
+
+/* Called from the event probe with preemption disabled */
+void event_hist_missed(struct ftrace_event_call *call)
+{
+	struct event_hist *hist = rcu_dereference_sched(call->hist);
+
+	if (hist)
+		atomic_long_inc(&hist->drops);
+}
+
+static void hist_free(struct event_hist *hist)
+{
+	if (!hist)
+		return;
+
+	if (hist->filter)
+		free_event_filter(hist->filter);
+	vfree(hist->buckets);
+	vfree(hist->entries);
+	vfree(hist->slots);
+	kfree(hist->spec);
+	kfree(hist);
+}
+
+static int hist_field_init(struct ftrace_event_call *call, char *name,
+			   struct hist_field *f)
+{
+	struct ftrace_event_field *field;
+
+	field = trace_find_event_field(call, name);
+	if (!field || field->filter_type != FILTER_OTHER)
+		return -EINVAL;
+
+	switch (field->size) {
+	case 1:
+	case 2:
+	case 4:
+	case 8:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	f->name = field->name;
+	f->offset = field->offset;
+	f->size = field->size;
+	f->is_signed = field->is_signed;
+
+	return 0;
+}
+
+static int hist_fields_init(struct ftrace_event_call *call, char *str,
+			    struct hist_field *fields, int max)
+{
+	char *name;
+	int n = 0, err;
+
+	while ((name = strsep(&str, ",")) != NULL) {
+		if (n == max)
+			return -EINVAL;
+		err = hist_field_init(call, name, &fields[n]);
+		if (err)
+			return err;
+		n++;
+	}
+
+	return n;
+}
+
+static int hist_parse(struct ftrace_event_call *call, struct event_hist *hist,
+		      char *str)
+{
+	unsigned int size = HIST_SIZE_DEFAULT;
+	char *tok, *filter_str = NULL;
+	int ret;
+
+	tok = strstr(str, " if ");
+	if (tok) {
+		*tok = '\0';
+		filter_str = tok + 4;
+	}
+
+	while ((tok = strsep(&str, " \t")) != NULL) {
+		if (!*tok)
+			continue;
+
+		if (!strncmp(tok, "keys=", 5)) {
+			ret = hist_fields_init(call, tok + 5, hist->keys,
+					       HIST_KEYS_MAX);
+			if (ret < 0)
+				return ret;
+			hist->n_keys = ret;
+		} else if (!strncmp(tok, "vals=", 5)) {
+			ret = hist_fields_init(call, tok + 5, hist->vals,
+					       HIST_VALS_MAX);
+			if (ret < 0)
+				return ret;
+			hist->n_vals = ret;
+		} else if (!strncmp(tok, "log2=", 5)) {
+			ret = hist_field_init(call, tok + 5, &hist->log2);
+			if (ret < 0)
+				return ret;
+			hist->has_log2 = 1;
+		} else if (!strncmp(tok, "size=", 5)) {
+			ret = kstrtouint(tok + 5, 0, &size);
+			if (ret < 0)
+				return ret;
+			if (!size || size > HIST_SIZE_MAX)
+				return -EINVAL;
+		} else
+			return -EINVAL;
+	}
+
+	if (!hist->n_keys)
+		return -EINVAL;
+
+	if (filter_str) {
+		ret = create_event_filter(call, filter_str, &hist->filter);
+		if (ret < 0)
+			return ret;
+	}
+
+	hist->size = roundup_pow_of_two(size);
+	return 0;
+}
+
+static struct event_hist *hist_create(struct ftrace_event_call *call,
+				      const char *spec)
+{
+	struct event_hist *hist;
+	char *buf;
+	int err;
+
+	hist = kzalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return ERR_PTR(-ENOMEM);
+
+	err = -ENOMEM;
+	hist->spec = kstrdup(spec, GFP_KERNEL);
+	buf = kstrdup(spec, GFP_KERNEL);
+	if (!hist->spec || !buf)
+		goto fail;
+
+	err = hist_parse(call, hist, buf);
+	if (err)
+		goto fail;
+
+	err = -ENOMEM;
+	hist->slots = vzalloc(2 * hist->size * sizeof(*hist->slots));
+	hist->entries = vzalloc(hist->size * sizeof(*hist->entries));
+	if (!hist->slots || !hist->entries)
+		goto fail;
+	if (hist->has_log2) {
+		hist->buckets = vzalloc(hist->size * HIST_LOG2_BUCKETS *
+					sizeof(*hist->buckets));
+		if (!hist->buckets)
+			goto fail;
+	}
+
+	kfree(buf);
+	return hist;
+
+fail:
+	kfree(buf);
+	hist_free(hist);
+	return ERR_PTR(err);
+}
+
+/* Swap in a new histogram, or none. Called with event_mutex held. */
+static int hist_replace(struct ftrace_event_call *call,
+			struct event_hist *hist)
+{
+	struct event_hist *old = call->hist;
+	int err;
+
+	if (!hist) {
+		trace_event_hist_reg(call, 0);
+		RCU_INIT_POINTER(call->hist, NULL);
+	} else {
+		rcu_assign_pointer(call->hist, hist);
+		err = trace_event_hist_reg(call, 1);
+		if (err) {
+			RCU_INIT_POINTER(call->hist, old);
+			return err;
+		}
+	}
+
+	if (old) {
+		/* Make sure the probe is done with the old one */
+		synchronize_sched();
+		hist_free(old);
+	}
+
+	return 0;
+}
+
+/* The event is going away, called with event_mutex held */
+void event_hist_destroy(struct ftrace_event_call *call)
+{
+	if (call->hist)
+		hist_replace(call, NULL);
+}
+
+static int hist_entry_cmp(const void *a, const void *b)
+{
+	const struct hist_entry *ea = *(const struct hist_entry **)a;
+	const struct hist_entry *eb = *(const struct hist_entry **)b;
+	u64 ha = atomic64_read(&ea->hitcount);
+	u64 hb = atomic64_read(&eb->hitcount);
+
+	if (ha == hb)
+		return 0;
+	return ha < hb ? 1 : -1;
+}
+
+static void hist_show_value(struct seq_file *m, struct hist_field *f, u64 val)
+{
+	if (f->is_signed)
+		seq_printf(m, "%s: %10lld", f->name, (s64)val);
+	else
+		seq_printf(m, "%s: %10llu", f->name, val);
+}
+
+static void hist_show_entry(struct seq_file *m, struct event_hist *hist,
+			    struct hist_entry *entry)
+{
+	atomic_t *buckets;
+	unsigned int b, cnt;
+	int i;
+
+	seq_puts(m, "{ ");
+	for (i = 0; i < hist->n_keys; i++) {
+		if (i)
+			seq_puts(m, ", ");
+		hist_show_value(m, &hist->keys[i], entry->key[i]);
+	}
+	seq_printf(m, " } hitcount: %10llu",
+		   (u64)atomic64_read(&entry->hitcount));
+	for (i = 0; i < hist->n_vals; i++) {
+		seq_puts(m, "  ");
+		hist_show_value(m, &hist->vals[i],
+				atomic64_read(&entry->sums[i]));
+	}
+	seq_putc(m, '\n');
+
+	if (!hist->has_log2)
+		return;
+
+	buckets = &hist->buckets[(entry - hist->entries) * HIST_LOG2_BUCKETS];
+	for (b = 0; b < HIST_LOG2_BUCKETS; b++) {
+		cnt = atomic_read(&buckets[b]);
+		if (!cnt)
+			continue;
+		if (!b)
+			seq_printf(m, "    %s %20s %10u\n", hist->log2.name,
+				   "< 1", cnt);
+		else if (b == HIST_LOG2_BUCKETS - 1)
+			seq_printf(m, "    %s >= %17llu %10u\n", hist->log2.name,
+				   1ULL << (b - 1), cnt);
+		else
+			seq_printf(m, "    %s %9llu - %8llu %10u\n",
+				   hist->log2.name, 1ULL << (b - 1),
+				   (1ULL << b) - 1, cnt);
+	}
+}
+
+static int event_hist_show(struct seq_file *m, void *v)
+{
+	struct ftrace_event_call *call = m->private;
+	struct hist_entry **sorted = NULL;
+	struct hist_entry *entry;
+	struct event_hist *hist;
+	unsigned int i, n = 0;
+
+	mutex_lock(&event_mutex);
+	hist = call->hist;
+	if (!hist) {
+		seq_puts(m, "# no histogram\n");
+		goto out;
+	}
+
+	seq_printf(m, "# %s\n\n", hist->spec);
+
+	sorted = vmalloc(hist->size * sizeof(*sorted));
+	if (!sorted) {
+		mutex_unlock(&event_mutex);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < 2 * hist->size; i++) {
+		entry = ACCESS_ONCE(hist->slots[i].entry);
+		if (!entry)
+			continue;
+		smp_read_barrier_depends();
+		sorted[n++] = entry;
+	}
+	sort(sorted, n, sizeof(*sorted), hist_entry_cmp, NULL);
+
+	for (i = 0; i < n; i++)
+		hist_show_entry(m, hist, sorted[i]);
+
+	seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n"
+		   "    Dropped: %lu\n", (u64)atomic64_read(&hist->hits), n,
+		   atomic_long_read(&hist->drops));
+out:
+	mutex_unlock(&event_mutex);
+	vfree(sorted);
+
+	return 0;
+}
+
+static ssize_t event_hist_write(struct file *file, const char __user *ubuf,
+				size_t cnt, loff_t *ppos)
+{
+	struct ftrace_event_call *call =
+		((struct seq_file *)file->private_data)->private;
+	struct event_hist *hist = NULL;
+	char *buf, *spec;
+	int err;
+
+	if (cnt >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = (char *)__get_free_page(GFP_TEMPORARY);
+	if (!buf)
+		return -ENOMEM;
+
+	if (copy_from_user(buf, ubuf, cnt)) {
+		free_page((unsigned long) buf);
+		return -EFAULT;
+	}
+	buf[cnt] = '\0';
+	spec = strstrip(buf);
+
+	mutex_lock(&event_mutex);
+	err = 0;
+	if (!strcmp(spec, "clear")) {
+		if (!call->hist)
+			goto out;
+		spec = call->hist->spec;
+	} else if (!*spec || !strcmp(spec, "0")) {
+		if (call->hist)
+			err = hist_replace(call, NULL);
+		goto out;
+	}
+
+	hist = hist_create(call, spec);
+	if (IS_ERR(hist)) {
+		err = PTR_ERR(hist);
+		goto out;
+	}
+	err = hist_replace(call, hist);
+	if (err)
+		hist_free(hist);
+out:
+	mutex_unlock(&event_mutex);
+	free_page((unsigned long) buf);
+	if (err < 0)
+		return err;
+
+	*ppos += cnt;
+
+	return cnt;
+}
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, event_hist_show, inode->i_private);
+}
+
+const struct file_operations event_hist_fops = {
+	.open		= event_hist_open,
+	.read		= seq_read,
+	.write		= event_hist_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
@@ -1389,8 +1389,10 @@ static __kprobes void kprobe_trace_func(struct kprobe *kp, struct pt_regs *regs)
 
 	event = trace_current_buffer_lock_reserve(&buffer, call->event.type,
 						  size, irq_flags, pc);
-	if (!event)
+	if (!event) {
+		trace_event_reserve_failed(call);
 		return;
+	}
 
 	entry = ring_buffer_event_data(event);
 	entry->ip = (unsigned long)kp->addr;
@@ -1420,8 +1422,10 @@ static __kprobes void kretprobe_trace_func(struct kretprobe_instance *ri,
 
 	event = trace_current_buffer_lock_reserve(&buffer, call->event.type,
 						  size, irq_flags, pc);
-	if (!event)
+	if (!event) {
+		trace_event_reserve_failed(call);
 		return;
+	}
 
 	entry = ring_buffer_event_data(event);
 	entry->func = (unsigned long)tp->rp.kp.addr;
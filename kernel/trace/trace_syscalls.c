@@ -324,8 +324,10 @@ void ftrace_syscall_enter(void *ignore, struct pt_regs *regs, long id)
 
 	event = trace_current_buffer_lock_reserve(&buffer,
 			sys_data->enter_event->event.type, size, irq_flags, pc);
-	if (!event)
+	if (!event) {
+		trace_event_reserve_failed(sys_data->enter_event);
 		return;
+	}
 
 	entry = ring_buffer_event_data(event);
 	entry->nr = syscall_nr;
@@ -363,8 +365,10 @@ void ftrace_syscall_exit(void *ignore, struct pt_regs *regs, long ret)
 	event = trace_current_buffer_lock_reserve(&buffer,
 			sys_data->exit_event->event.type, sizeof(*entry),
 			irq_flags, pc);
-	if (!event)
+	if (!event) {
+		trace_event_reserve_failed(sys_data->exit_event);
 		return;
+	}
 
 	entry = ring_buffer_event_data(event);
 	entry->nr = syscall_nr;
@@ -3,234 +3,186 @@
  *
  * Copyright (C) 2008 Frederic Weisbecker <fweisbec@gmail.com>
  *
+ * Collects how long the works of each work function waited between
+ * being queued and starting to run, how long they ran, and how often
+ * they kept other works on a concurrency managed gcwq waiting by
+ * running for at least workqueue_block_thresh_us without sleeping.
+ *
+ * Start/stop collection, starting clears what was collected:
+ * # echo [1|0] > /sys/kernel/debug/tracing/workqueue_hist
+ *
+ * Means and maxima, busiest function first:
+ * # cat /sys/kernel/debug/tracing/trace_stat/workqueues
+ *
+ * Histograms:
+ * # cat /sys/kernel/debug/tracing/workqueue_hist
  */
 
 
 #include <trace/events/workqueue.h>
-#include <linux/list.h>
-#include <linux/percpu.h>
-#include <linux/slab.h>
-#include <linux/kref.h>
+#include <linux/debugfs.h>
+#include <linux/uaccess.h>
+#include <linux/hash.h>
 #include "trace_stat.h"
 #include "trace.h"
 
 
-/* A cpu workqueue thread */
-struct cpu_workqueue_stats {
-	struct list_head            list;
-	struct kref                 kref;
-	int		            cpu;
-	pid_t			    pid;
-/* Can be inserted from interrupt or user context, need to be atomic */
-	atomic_t	            inserted;
-/*
- *  Don't need to be atomic, works are serialized in a single workqueue thread
- *  on a single CPU.
- */
-	unsigned int		    executed;
-};
-
-/* List of workqueue threads on one cpu */
-struct workqueue_global_stats {
-	struct list_head	list;
-	spinlock_t		lock;
+#define WQ_STAT_BITS		8
+#define WQ_STAT_ENTRIES		(1 << WQ_STAT_BITS)
+#define WQ_STAT_HASH_BITS	(WQ_STAT_BITS - 1)
+
+/* Slot 0 is below 1 usec, slot n holds [2^(n-1), 2^n) usecs */
+#define WQ_HIST_SLOTS		24
+
+/* One work function */
+struct workqueue_func_stats {
+	struct workqueue_func_stats *next;	/* hash chain */
+	work_func_t		func;
+	unsigned long		executed;
+	unsigned long		blocked;
+	u64			latency_total;
+	u64			latency_max;
+	u64			runtime_total;
+	u64			runtime_max;
+	unsigned int		latency_hist[WQ_HIST_SLOTS];
+	unsigned int		runtime_hist[WQ_HIST_SLOTS];
 };
 
-/* Don't need a global lock because allocated before the workqueues, and
- * never freed.
+/*
+ * Entries are handed out from a static array and only go away when a
+ * new collection is started, so readers need no reference counting.
  */
-static DEFINE_PER_CPU(struct workqueue_global_stats, all_workqueue_stat);
-#define workqueue_cpu_stat(cpu) (&per_cpu(all_workqueue_stat, cpu))
-
-static void cpu_workqueue_stat_free(struct kref *kref)
-{
-	kfree(container_of(kref, struct cpu_workqueue_stats, kref));
-}
+static struct workqueue_func_stats func_stats[WQ_STAT_ENTRIES];
+static struct workqueue_func_stats *func_stats_hash[1 << WQ_STAT_HASH_BITS];
+static unsigned int nr_func_stats;
+static unsigned long func_stats_overflow;
+static DEFINE_SPINLOCK(func_stats_lock);
 
-/* Insertion of a work */
-static void
-probe_workqueue_insertion(void *ignore,
-			  struct task_struct *wq_thread,
-			  struct work_struct *work)
-{
-	int cpu = cpumask_first(&wq_thread->cpus_allowed);
-	struct cpu_workqueue_stats *node;
-	unsigned long flags;
+/* Serializes starting and stopping with readers */
+static DEFINE_MUTEX(func_stats_mutex);
+static int func_stats_active;
 
-	spin_lock_irqsave(&workqueue_cpu_stat(cpu)->lock, flags);
-	list_for_each_entry(node, &workqueue_cpu_stat(cpu)->list, list) {
-		if (node->pid == wq_thread->pid) {
-			atomic_inc(&node->inserted);
-			goto found;
-		}
-	}
-	pr_debug("trace_workqueue: entry not found\n");
-found:
-	spin_unlock_irqrestore(&workqueue_cpu_stat(cpu)->lock, flags);
-}
+static u32 block_thresh_us = 10000;
 
-/* Execution of a work */
-static void
-probe_workqueue_execution(void *ignore,
-			  struct task_struct *wq_thread,
-			  struct work_struct *work)
+static struct workqueue_func_stats *func_stats_lookup(work_func_t func)
 {
-	int cpu = cpumask_first(&wq_thread->cpus_allowed);
-	struct cpu_workqueue_stats *node;
-	unsigned long flags;
+	struct workqueue_func_stats **head, *fs;
 
-	spin_lock_irqsave(&workqueue_cpu_stat(cpu)->lock, flags);
-	list_for_each_entry(node, &workqueue_cpu_stat(cpu)->list, list) {
-		if (node->pid == wq_thread->pid) {
-			node->executed++;
-			goto found;
-		}
-	}
-	pr_debug("trace_workqueue: entry not found\n");
-found:
-	spin_unlock_irqrestore(&workqueue_cpu_stat(cpu)->lock, flags);
-}
+	head = &func_stats_hash[hash_ptr(func, WQ_STAT_HASH_BITS)];
+	for (fs = *head; fs; fs = fs->next)
+		if (fs->func == func)
+			return fs;
 
-/* Creation of a cpu workqueue thread */
-static void probe_workqueue_creation(void *ignore,
-				     struct task_struct *wq_thread, int cpu)
-{
-	struct cpu_workqueue_stats *cws;
-	unsigned long flags;
+	if (nr_func_stats >= WQ_STAT_ENTRIES)
+		return NULL;
 
-	WARN_ON(cpu < 0);
+	fs = &func_stats[nr_func_stats];
+	fs->func = func;
+	fs->next = *head;
+	*head = fs;
+	/* Readers walk the array up to nr_func_stats without the lock */
+	smp_wmb();
+	nr_func_stats++;
 
-	/* Workqueues are sometimes created in atomic context */
-	cws = kzalloc(sizeof(struct cpu_workqueue_stats), GFP_ATOMIC);
-	if (!cws) {
-		pr_warning("trace_workqueue: not enough memory\n");
-		return;
-	}
-	INIT_LIST_HEAD(&cws->list);
-	kref_init(&cws->kref);
-	cws->cpu = cpu;
-	cws->pid = wq_thread->pid;
-
-	spin_lock_irqsave(&workqueue_cpu_stat(cpu)->lock, flags);
-	list_add_tail(&cws->list, &workqueue_cpu_stat(cpu)->list);
-	spin_unlock_irqrestore(&workqueue_cpu_stat(cpu)->lock, flags);
+	return fs;
 }
 
-/* Destruction of a cpu workqueue thread */
-static void
-probe_workqueue_destruction(void *ignore, struct task_struct *wq_thread)
+static unsigned int hist_slot(u64 nsecs)
 {
-	/* Workqueue only execute on one cpu */
-	int cpu = cpumask_first(&wq_thread->cpus_allowed);
-	struct cpu_workqueue_stats *node, *next;
-	unsigned long flags;
-
-	spin_lock_irqsave(&workqueue_cpu_stat(cpu)->lock, flags);
-	list_for_each_entry_safe(node, next, &workqueue_cpu_stat(cpu)->list,
-							list) {
-		if (node->pid == wq_thread->pid) {
-			list_del(&node->list);
-			kref_put(&node->kref, cpu_workqueue_stat_free);
-			goto found;
-		}
-	}
-
-	pr_debug("trace_workqueue: don't find workqueue to destroy\n");
-found:
-	spin_unlock_irqrestore(&workqueue_cpu_stat(cpu)->lock, flags);
+	unsigned long usecs = (unsigned long)div_u64(nsecs, NSEC_PER_USEC);
 
+	return min_t(unsigned int, fls_long(usecs), WQ_HIST_SLOTS - 1);
 }
 
-static struct cpu_workqueue_stats *workqueue_stat_start_cpu(int cpu)
+/* Completion of a work, called with the gcwq lock held */
+static void
+probe_workqueue_execute_done(void *ignore, struct cpu_workqueue_struct *cwq,
+			     work_func_t func, u64 latency, u64 runtime,
+			     bool blocked)
 {
+	struct workqueue_func_stats *fs;
 	unsigned long flags;
-	struct cpu_workqueue_stats *ret = NULL;
 
+	if (likely(!func_stats_active))
+		return;
 
-	spin_lock_irqsave(&workqueue_cpu_stat(cpu)->lock, flags);
+	spin_lock_irqsave(&func_stats_lock, flags);
+	if (!func_stats_active)
+		goto out;
 
-	if (!list_empty(&workqueue_cpu_stat(cpu)->list)) {
-		ret = list_entry(workqueue_cpu_stat(cpu)->list.next,
-				 struct cpu_workqueue_stats, list);
-		kref_get(&ret->kref);
+	fs = func_stats_lookup(func);
+	if (!fs) {
+		func_stats_overflow++;
+		goto out;
 	}
 
-	spin_unlock_irqrestore(&workqueue_cpu_stat(cpu)->lock, flags);
+	fs->executed++;
+	fs->latency_total += latency;
+	fs->latency_max = max(fs->latency_max, latency);
+	fs->latency_hist[hist_slot(latency)]++;
+	fs->runtime_total += runtime;
+	fs->runtime_max = max(fs->runtime_max, runtime);
+	fs->runtime_hist[hist_slot(runtime)]++;
+	if (blocked && runtime >= (u64)block_thresh_us * NSEC_PER_USEC)
+		fs->blocked++;
+out:
+	spin_unlock_irqrestore(&func_stats_lock, flags);
+}
 
-	return ret;
+static void func_stats_reset(void)
+{
+	spin_lock_irq(&func_stats_lock);
+	memset(func_stats, 0, sizeof(func_stats));
+	memset(func_stats_hash, 0, sizeof(func_stats_hash));
+	nr_func_stats = 0;
+	func_stats_overflow = 0;
+	spin_unlock_irq(&func_stats_lock);
 }
 
 static void *workqueue_stat_start(struct tracer_stat *trace)
 {
-	int cpu;
-	void *ret = NULL;
-
-	for_each_possible_cpu(cpu) {
-		ret = workqueue_stat_start_cpu(cpu);
-		if (ret)
-			return ret;
-	}
-	return NULL;
+	return nr_func_stats ? &func_stats[0] : NULL;
 }
 
 static void *workqueue_stat_next(void *prev, int idx)
 {
-	struct cpu_workqueue_stats *prev_cws = prev;
-	struct cpu_workqueue_stats *ret;
-	int cpu = prev_cws->cpu;
-	unsigned long flags;
-
-	spin_lock_irqsave(&workqueue_cpu_stat(cpu)->lock, flags);
-	if (list_is_last(&prev_cws->list, &workqueue_cpu_stat(cpu)->list)) {
-		spin_unlock_irqrestore(&workqueue_cpu_stat(cpu)->lock, flags);
-		do {
-			cpu = cpumask_next(cpu, cpu_possible_mask);
-			if (cpu >= nr_cpu_ids)
-				return NULL;
-		} while (!(ret = workqueue_stat_start_cpu(cpu)));
-		return ret;
-	} else {
-		ret = list_entry(prev_cws->list.next,
-				 struct cpu_workqueue_stats, list);
-		kref_get(&ret->kref);
-	}
-	spin_unlock_irqrestore(&workqueue_cpu_stat(cpu)->lock, flags);
-
-	return ret;
+	smp_rmb();
+	return idx < nr_func_stats ? &func_stats[idx] : NULL;
 }
 
-static int workqueue_stat_show(struct seq_file *s, void *p)
+static int workqueue_stat_cmp(void *p1, void *p2)
 {
-	struct cpu_workqueue_stats *cws = p;
-	struct pid *pid;
-	struct task_struct *tsk;
-
-	pid = find_get_pid(cws->pid);
-	if (pid) {
-		tsk = get_pid_task(pid, PIDTYPE_PID);
-		if (tsk) {
-			seq_printf(s, "%3d %6d     %6u       %s\n", cws->cpu,
-				   atomic_read(&cws->inserted), cws->executed,
-				   tsk->comm);
-			put_task_struct(tsk);
-		}
-		put_pid(pid);
-	}
+	struct workqueue_func_stats *a = p1, *b = p2;
 
-	return 0;
+	if (a->runtime_total == b->runtime_total)
+		return 0;
+	return a->runtime_total > b->runtime_total ? 1 : -1;
 }
 
-static void workqueue_stat_release(void *stat)
+static u64 mean_usecs(u64 total, unsigned long nr)
 {
-	struct cpu_workqueue_stats *node = stat;
+	return nr ? div_u64(div_u64(total, nr), NSEC_PER_USEC) : 0;
+}
 
-	kref_put(&node->kref, cpu_workqueue_stat_free);
+static int workqueue_stat_show(struct seq_file *s, void *p)
+{
+	struct workqueue_func_stats *fs = p;
+
+	seq_printf(s, "%10lu %10llu %10llu %10llu %10llu %8lu  %pf\n",
+		   fs->executed,
+		   mean_usecs(fs->latency_total, fs->executed),
+		   div_u64(fs->latency_max, NSEC_PER_USEC),
+		   mean_usecs(fs->runtime_total, fs->executed),
+		   div_u64(fs->runtime_max, NSEC_PER_USEC),
+		   fs->blocked, fs->func);
+	return 0;
 }
 
 static int workqueue_stat_headers(struct seq_file *s)
 {
-	seq_printf(s, "# CPU  INSERTED  EXECUTED   NAME\n");
-	seq_printf(s, "# |      |         |          |\n");
+	seq_printf(s, "# Latency and runtime in usecs\n");
+	seq_printf(s, "#  EXECUTED   LAT_MEAN    LAT_MAX   RUN_MEAN    RUN_MAX  BLOCKED  FUNCTION\n");
+	seq_printf(s, "#     |          |          |          |          |        |        |\n");
 	return 0;
 }
 
@@ -238,19 +190,109 @@ struct tracer_stat workqueue_stats __read_mostly = {
 	.name = "workqueues",
 	.stat_start = workqueue_stat_start,
 	.stat_next = workqueue_stat_next,
+	.stat_cmp = workqueue_stat_cmp,
 	.stat_show = workqueue_stat_show,
-	.stat_release = workqueue_stat_release,
 	.stat_headers = workqueue_stat_headers
 };
 
+static void hist_show_slot(struct seq_file *m, int slot, unsigned int latency,
+			   unsigned int runtime)
+{
+	if (!slot)
+		seq_printf(m, "  %10s %-10lu", "0 -", 1UL);
+	else if (slot == WQ_HIST_SLOTS - 1)
+		seq_printf(m, "  %10s %-10lu", ">=", 1UL << (slot - 1));
+	else
+		seq_printf(m, "  %8lu - %-10lu", 1UL << (slot - 1), 1UL << slot);
+	seq_printf(m, " %10u %10u\n", latency, runtime);
+}
+
+static int workqueue_hist_show(struct seq_file *m, void *v)
+{
+	struct workqueue_func_stats *fs;
+	unsigned int i, nr;
+	int slot;
+
+	mutex_lock(&func_stats_mutex);
+	seq_printf(m, "Collection: %s\n", func_stats_active ? "active" : "stopped");
+	if (func_stats_overflow)
+		seq_printf(m, "Overflow: %lu works\n", func_stats_overflow);
+
+	nr = nr_func_stats;
+	smp_rmb();
+	for (i = 0; i < nr; i++) {
+		fs = &func_stats[i];
+
+		seq_printf(m, "\n%pf: %lu executed, %lu blocked\n",
+			   fs->func, fs->executed, fs->blocked);
+		seq_printf(m, "  %21s %10s %10s\n", "usecs", "latency", "runtime");
+		for (slot = 0; slot < WQ_HIST_SLOTS; slot++) {
+			if (!fs->latency_hist[slot] && !fs->runtime_hist[slot])
+				continue;
+			hist_show_slot(m, slot, fs->latency_hist[slot],
+				       fs->runtime_hist[slot]);
+		}
+	}
+	mutex_unlock(&func_stats_mutex);
+
+	return 0;
+}
+
+static ssize_t workqueue_hist_write(struct file *file, const char __user *ubuf,
+				    size_t count, loff_t *ppos)
+{
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul_from_user(ubuf, count, 10, &val);
+	if (ret)
+		return ret;
+
+	mutex_lock(&func_stats_mutex);
+	if (val && !func_stats_active) {
+		func_stats_reset();
+		func_stats_active = 1;
+	} else if (!val) {
+		func_stats_active = 0;
+	}
+	mutex_unlock(&func_stats_mutex);
+
+	return count;
+}
+
+static int workqueue_hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, workqueue_hist_show, NULL);
+}
+
+static const struct file_operations workqueue_hist_fops = {
+	.open		= workqueue_hist_open,
+	.read		= seq_read,
+	.write		= workqueue_hist_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
 
 int __init stat_workqueue_init(void)
 {
+	struct dentry *d_tracer;
+
 	if (register_stat_tracer(&workqueue_stats)) {
 		pr_warning("Unable to register workqueue stat tracer\n");
 		return 1;
 	}
 
+	d_tracer = tracing_init_dentry();
+	if (!d_tracer)
+		return 0;
+
+	trace_create_file("workqueue_hist", 0644, d_tracer, NULL,
+			  &workqueue_hist_fops);
+	if (!debugfs_create_u32("workqueue_block_thresh_us", 0644, d_tracer,
+				&block_thresh_us))
+		pr_warning("Could not create debugfs "
+			   "'workqueue_block_thresh_us' entry\n");
+
 	return 0;
 }
 fs_initcall(stat_workqueue_init);
@@ -261,40 +303,15 @@ fs_initcall(stat_workqueue_init);
  */
 int __init trace_workqueue_early_init(void)
 {
-	int ret, cpu;
+	int ret;
 
-	for_each_possible_cpu(cpu) {
-		spin_lock_init(&workqueue_cpu_stat(cpu)->lock);
-		INIT_LIST_HEAD(&workqueue_cpu_stat(cpu)->list);
+	ret = register_trace_workqueue_execute_done(probe_workqueue_execute_done,
+						    NULL);
+	if (ret) {
+		pr_warning("trace_workqueue: unable to trace workqueues\n");
+		return 1;
 	}
 
-	ret = register_trace_workqueue_insertion(probe_workqueue_insertion, NULL);
-	if (ret)
-		goto out;
-
-	ret = register_trace_workqueue_execution(probe_workqueue_execution, NULL);
-	if (ret)
-		goto no_insertion;
-
-	ret = register_trace_workqueue_creation(probe_workqueue_creation, NULL);
-	if (ret)
-		goto no_execution;
-
-	ret = register_trace_workqueue_destruction(probe_workqueue_destruction, NULL);
-	if (ret)
-		goto no_creation;
-
 	return 0;
-
-no_creation:
-	unregister_trace_workqueue_creation(probe_workqueue_creation, NULL);
-no_execution:
-	unregister_trace_workqueue_execution(probe_workqueue_execution, NULL);
-no_insertion:
-	unregister_trace_workqueue_insertion(probe_workqueue_insertion, NULL);
-out:
-	pr_warning("trace_workqueue: unable to trace workqueues\n");
-
-	return 1;
 }
 early_initcall(trace_workqueue_early_init);
@@ -17,8 +17,8 @@
  * This is the generic async execution mechanism.  Work items as are
  * executed in process context.  The worker pool is shared and
  * automatically managed.  There is one worker pool for each CPU and
- * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * a few extra for works which are better served by workers which are
+ * not bound to any specific CPU, each confined to a cpumask.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +41,8 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/device.h>
+#include <linux/delay.h>
 
 #include "workqueue_sched.h"
 
@@ -112,9 +114,15 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * Q: wq_pool_mutex protected.
+ *
+ * QL: Modified with both wq_pool_mutex and gcwq->lock held, either is
+ *     enough for read access.
  */
 
 struct global_cwq;
+struct wq_device;
 
 /*
  * The poor guys doing the actual heavy lifting.  All on-duty workers
@@ -137,6 +145,7 @@ struct worker {
 	unsigned int		flags;		/* X: flags */
 	int			id;		/* I: worker id */
 	struct work_struct	rebind_work;	/* L: rebind worker to cpu */
+	unsigned int		cpumask_gen;	/* L: pool cpumask applied */
 };
 
 /*
@@ -173,6 +182,11 @@ struct global_cwq {
  * The per-CPU workqueue.  The lower WORK_STRUCT_FLAG_BITS of
  * work_struct->data are used for flags and thus cwqs need to be
  * aligned at two's power of the number of flag bits.
+ *
+ * The gcwq of an unbound workqueue's cwq changes when the workqueue
+ * is moved to another unbound pool, which happens only while none of
+ * its works is active or running and with wq->flush_mutex,
+ * workqueue_lock and both gcwq locks held.
  */
 struct cpu_workqueue_struct {
 	struct global_cwq	*gcwq;		/* I: the associated gcwq */
@@ -242,6 +256,9 @@ struct workqueue_struct {
 
 	int			saved_max_active; /* W: saved cwq max_active */
 	const char		*name;		/* I: workqueue name */
+#ifdef CONFIG_SYSFS
+	struct wq_device	*wq_dev;	/* Q: sysfs interface */
+#endif
 #ifdef CONFIG_LOCKDEP
 	struct lockdep_map	lockdep_map;
 #endif
@@ -278,7 +295,8 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 		}
 		if (sw & 2)
 			return WORK_CPU_UNBOUND;
-	}
+	} else if (sw & 4 && cpu >= WORK_CPU_UNBOUND)
+		return cpu + 1;
 	return WORK_CPU_NONE;
 }
 
@@ -291,20 +309,21 @@ static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
 /*
  * CPU iterators
  *
- * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+ * Extra gcwqs are defined for invalid cpu numbers starting at
+ * WORK_CPU_UNBOUND to host workqueues which are not bound to any
+ * specific CPU.  WORK_CPU_UNBOUND itself is the default unbound pool.
+ * The following iterators are similar to for_each_*_cpu() iterators
+ * but also considers the unbound gcwqs.
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
+ * for_each_gcwq_cpu()		: possible CPUs + all unbound pools
  * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
  * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
  *				  WORK_CPU_UNBOUND for unbound workqueues
  */
 #define for_each_gcwq_cpu(cpu)						\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
+	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 7);		\
 	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 3))
+	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 7))
 
 #define for_each_online_gcwq_cpu(cpu)					\
 	for ((cpu) = __next_gcwq_cpu(-1, cpu_online_mask, 3);		\
@@ -432,6 +451,60 @@ static inline void debug_work_activate(struct work_struct *work) { }
 static inline void debug_work_deactivate(struct work_struct *work) { }
 #endif
 
+#ifdef CONFIG_WORKQUEUE_TRACER
+/*
+ * How long a work item waited and ran, for the workqueue_execute_done
+ * tracepoint.  The work carries the time it was queued at, the rest
+ * lives on process_one_work()'s stack.
+ */
+struct work_times {
+	u64			queued;
+	u64			start;
+	unsigned long		nvcsw;
+};
+
+static inline void work_times_queue(struct work_struct *work)
+{
+	work->queued_at = local_clock();
+}
+
+static inline void work_times_start(struct work_times *t,
+				    struct work_struct *work)
+{
+	t->queued = work->queued_at;
+	t->start = local_clock();
+	t->nvcsw = current->nvcsw;
+}
+
+/*
+ * A worker of a concurrency managed gcwq which doesn't sleep keeps
+ * everything queued behind it waiting, no other worker is woken up
+ * until it blocks.  Report whether this work did that.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static void work_times_end(struct work_times *t, struct worker *worker,
+			   struct cpu_workqueue_struct *cwq, work_func_t f)
+{
+	u64 now = local_clock();
+	bool blocked = !(worker->flags & WORKER_NOT_RUNNING) &&
+		       current->nvcsw == t->nvcsw &&
+		       !list_empty(&worker->gcwq->worklist);
+
+	trace_workqueue_execute_done(cwq, f, t->start - t->queued,
+				     now - t->start, blocked);
+}
+#else
+struct work_times { };
+static inline void work_times_queue(struct work_struct *work) { }
+static inline void work_times_start(struct work_times *t,
+				    struct work_struct *work) { }
+static inline void work_times_end(struct work_times *t, struct worker *worker,
+				  struct cpu_workqueue_struct *cwq,
+				  work_func_t f) { }
+#endif
+
 /* Serializes the accesses to the list of workqueues. */
 static DEFINE_SPINLOCK(workqueue_lock);
 static LIST_HEAD(workqueues);
@@ -446,31 +519,57 @@ static DEFINE_PER_CPU(struct global_cwq, global_cwq);
 static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, gcwq_nr_running);
 
 /*
- * Global cpu workqueue and nr_running counter for unbound gcwq.  The
- * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
+ * Global cpu workqueues and nr_running counter for unbound gcwqs.  The
+ * gcwqs are always online, have GCWQ_DISASSOCIATED set, and all their
  * workers have WORKER_UNBOUND set.
  */
-static struct global_cwq unbound_global_cwq;
+static struct global_cwq unbound_global_cwq[WORK_NR_UNBOUND_POOLS];
 static atomic_t unbound_gcwq_nr_running = ATOMIC_INIT(0);	/* always 0 */
 
+/*
+ * Each unbound gcwq is a pool of workers confined to a cpumask.  Pool
+ * 0 spans all cpus and is where unbound workqueues start out, the
+ * others are handed out by cpumask to workqueues which are restricted
+ * with workqueue_set_unbound_cpumask() and reused for another cpumask
+ * once no workqueue uses them anymore.  Workers are never taken away
+ * from a pool, an unused pool just keeps its idle ones.  cpumask_gen
+ * is bumped along with every change of the cpumask, so that workers
+ * can tell whether they still run on the right cpus.
+ */
+struct unbound_pool {
+	cpumask_var_t		cpumask;	/* Q: cpus the workers run on */
+	unsigned int		cpumask_gen;	/* QL: cpumask changes */
+	int			nr_wqs;		/* Q: workqueues using the pool */
+};
+
+static struct unbound_pool unbound_pools[WORK_NR_UNBOUND_POOLS];
+static DEFINE_MUTEX(wq_pool_mutex);
+
 static int worker_thread(void *__worker);
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(global_cwq, cpu);
 	else
-		return &unbound_global_cwq;
+		return &unbound_global_cwq[cpu - WORK_CPU_UNBOUND];
 }
 
 static atomic_t *get_gcwq_nr_running(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(gcwq_nr_running, cpu);
 	else
 		return &unbound_gcwq_nr_running;
 }
 
+static struct unbound_pool *gcwq_unbound_pool(struct global_cwq *gcwq)
+{
+	if (gcwq->cpu < WORK_CPU_UNBOUND)
+		return NULL;
+	return &unbound_pools[gcwq->cpu - WORK_CPU_UNBOUND];
+}
+
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
@@ -482,7 +581,7 @@ static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 			return wq->cpu_wq.single;
 #endif
 		}
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
+	} else if (likely(cpu >= WORK_CPU_UNBOUND && cpu < WORK_CPU_NONE))
 		return wq->cpu_wq.single;
 	return NULL;
 }
@@ -565,7 +664,7 @@ static struct global_cwq *get_work_gcwq(struct work_struct *work)
 	if (cpu == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
+	BUG_ON(cpu >= nr_cpu_ids && cpu < WORK_CPU_UNBOUND);
 	return get_gcwq(cpu);
 }
 
@@ -928,6 +1027,7 @@ static void insert_work(struct cpu_workqueue_struct *cwq,
 
 	/* we own @work, set data and link */
 	set_work_cwq(work, cwq, extra_flags);
+	work_times_queue(work);
 
 	/*
 	 * Ensure that we get the right work->data if we see the
@@ -1028,8 +1128,15 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 		} else
 			spin_lock_irqsave(&gcwq->lock, flags);
 	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
+		/* the pool of @wq may change until we hold its lock */
+		cwq = get_cwq(WORK_CPU_UNBOUND, wq);
+retry:
+		gcwq = ACCESS_ONCE(cwq->gcwq);
 		spin_lock_irqsave(&gcwq->lock, flags);
+		if (unlikely(gcwq != cwq->gcwq)) {
+			spin_unlock_irqrestore(&gcwq->lock, flags);
+			goto retry;
+		}
 	}
 
 	/* gcwq determined, get cwq and queue */
@@ -1158,7 +1265,7 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		if (!(wq->flags & WQ_UNBOUND)) {
 			struct global_cwq *gcwq = get_work_gcwq(work);
 
-			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
+			if (gcwq && gcwq->cpu < WORK_CPU_UNBOUND)
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
@@ -1309,6 +1416,66 @@ __acquires(&gcwq->lock)
 	}
 }
 
+/**
+ * worker_apply_pool_cpumask - move a worker onto the cpus of its pool
+ * @worker: the current worker, serving worker->gcwq
+ *
+ * Workers are PF_THREAD_BOUND and set_cpus_allowed_ptr() refuses to
+ * change the affinity of such tasks from the outside, so unbound
+ * workers and rescuers follow the cpumask of their pool themselves,
+ * whenever they wake up and whenever worker_cpumask_stale() says the
+ * pool got a new cpumask since.  If all cpus of the pool go down, the
+ * scheduler's fallback takes the workers elsewhere until one comes
+ * back.
+ *
+ * CONTEXT:
+ * Might sleep.  Called without any lock.
+ */
+static void worker_apply_pool_cpumask(struct worker *worker)
+{
+	struct global_cwq *gcwq = worker->gcwq;
+	struct unbound_pool *pool = gcwq_unbound_pool(gcwq);
+	unsigned int gen;
+
+	if (!pool)
+		return;
+
+	/*
+	 * The cpumask is read without gcwq->lock, retry if it changed
+	 * while we were at it.
+	 */
+	spin_lock_irq(&gcwq->lock);
+	do {
+		gen = pool->cpumask_gen;
+		spin_unlock_irq(&gcwq->lock);
+
+		if (!cpumask_equal(tsk_cpus_allowed(current), pool->cpumask))
+			set_cpus_allowed_ptr(current, pool->cpumask);
+
+		spin_lock_irq(&gcwq->lock);
+	} while (gen != pool->cpumask_gen);
+	worker->cpumask_gen = gen;
+	spin_unlock_irq(&gcwq->lock);
+}
+
+/**
+ * worker_cpumask_stale - has the pool of @worker moved to other cpus?
+ * @worker: worker of interest
+ *
+ * An unused pool can be handed to a workqueue with another cpumask
+ * while one of its workers keeps running, and that worker must not go
+ * on to process the new workqueue's works on the old cpus.
+ *
+ * CONTEXT:
+ * spin_lock_irq(gcwq->lock).
+ */
+static bool worker_cpumask_stale(struct worker *worker)
+{
+	struct unbound_pool *pool = gcwq_unbound_pool(worker->gcwq);
+
+	return pool && worker->cpumask_gen != pool->cpumask_gen;
+}
+
 /*
  * Function for worker->rebind_work used to rebind rogue busy workers
  * to the associated cpu which is coming back online.  This is
@@ -1358,7 +1525,7 @@ static struct worker *alloc_worker(void)
  */
 static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 {
-	bool on_unbound_cpu = gcwq->cpu == WORK_CPU_UNBOUND;
+	bool on_unbound_cpu = gcwq->cpu >= WORK_CPU_UNBOUND;
 	struct worker *worker = NULL;
 	int id = -1;
 
@@ -1383,9 +1550,13 @@ static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 						      worker,
 						      cpu_to_node(gcwq->cpu),
 						      "kworker/%u:%d", gcwq->cpu, id);
-	else
+	else if (gcwq->cpu == WORK_CPU_UNBOUND)
 		worker->task = kthread_create(worker_thread, worker,
 					      "kworker/u:%d", id);
+	else
+		worker->task = kthread_create(worker_thread, worker,
+					      "kworker/u%u:%d",
+					      gcwq->cpu - WORK_CPU_UNBOUND, id);
 	if (IS_ERR(worker->task))
 		goto fail;
 
@@ -1502,8 +1673,8 @@ static bool send_mayday(struct work_struct *work)
 
 	/* mayday mayday mayday */
 	cpu = cwq->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
+	/* unbound pools can't be set in cpumask, use cpu 0 instead */
+	if (cpu >= WORK_CPU_UNBOUND)
 		cpu = 0;
 	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
 		wake_up_process(wq->rescuer->task);
@@ -1805,12 +1976,13 @@ __releases(&gcwq->lock)
 __acquires(&gcwq->lock)
 {
 	struct cpu_workqueue_struct *cwq = get_work_cwq(work);
-	struct global_cwq *gcwq = cwq->gcwq;
+	struct global_cwq *gcwq = worker->gcwq;
 	struct hlist_head *bwh = busy_worker_head(gcwq, work);
 	bool cpu_intensive = cwq->wq->flags & WQ_CPU_INTENSIVE;
 	work_func_t f = work->func;
 	int work_color;
 	struct worker *collision;
+	struct work_times times;
 #ifdef CONFIG_LOCKDEP
 	/*
 	 * It is permissible to free the struct work_struct from
@@ -1868,6 +2040,7 @@ __acquires(&gcwq->lock)
 
 	spin_unlock_irq(&gcwq->lock);
 
+	work_times_start(&times, work);
 	smp_wmb();	/* paired with test_and_set_bit(PENDING) */
 	work_clear_pending(work);
 
@@ -1895,6 +2068,8 @@ __acquires(&gcwq->lock)
 
 	spin_lock_irq(&gcwq->lock);
 
+	work_times_end(&times, worker, cwq, f);
+
 	/* clear cpu intensive status */
 	if (unlikely(cpu_intensive))
 		worker_clr_flags(worker, WORKER_CPU_INTENSIVE);
@@ -1945,6 +2120,8 @@ static int worker_thread(void *__worker)
 	/* tell the scheduler that this is a workqueue worker */
 	worker->task->flags |= PF_WQ_WORKER;
 woke_up:
+	worker_apply_pool_cpumask(worker);
+
 	spin_lock_irq(&gcwq->lock);
 
 	/* DIE can be set only while we're idle, checking here is enough */
@@ -1979,9 +2156,18 @@ recheck:
 	worker_clr_flags(worker, WORKER_PREP);
 
 	do {
-		struct work_struct *work =
-			list_first_entry(&gcwq->worklist,
-					 struct work_struct, entry);
+		struct work_struct *work;
+
+		if (unlikely(worker_cpumask_stale(worker))) {
+			spin_unlock_irq(&gcwq->lock);
+			worker_apply_pool_cpumask(worker);
+			spin_lock_irq(&gcwq->lock);
+			worker_set_flags(worker, WORKER_PREP, false);
+			goto recheck;
+		}
+
+		work = list_first_entry(&gcwq->worklist,
+					struct work_struct, entry);
 
 		if (likely(!(*work_data_bits(work) & WORK_STRUCT_LINKED))) {
 			/* optimization path, not strictly necessary */
@@ -2062,9 +2248,15 @@ repeat:
 		__set_current_state(TASK_RUNNING);
 		mayday_clear_cpu(cpu, wq->mayday_mask);
 
-		/* migrate to the target cpu if possible */
+		/* migrate to the target cpu or pool if possible */
 		rescuer->gcwq = gcwq;
+		worker_apply_pool_cpumask(rescuer);
 		worker_maybe_bind_and_lock(rescuer);
+		while (unlikely(worker_cpumask_stale(rescuer))) {
+			spin_unlock_irq(&gcwq->lock);
+			worker_apply_pool_cpumask(rescuer);
+			spin_lock_irq(&gcwq->lock);
+		}
 
 		/*
 		 * Slurp in all works issued via this workqueue and
@@ -2898,6 +3090,407 @@ static void free_cwqs(struct workqueue_struct *wq)
 	}
 }
 
+/**
+ * get_unbound_pool - find or set up the unbound pool for a cpumask
+ * @cpumask: cpus the pool is to run on
+ *
+ * Look up the unbound pool running on @cpumask or claim one no
+ * workqueue uses for it, make sure it has a worker and count the
+ * caller as a user.
+ *
+ * CONTEXT:
+ * Might sleep.  Called with wq_pool_mutex held.
+ *
+ * RETURNS:
+ * The gcwq of the pool, ERR_PTR(-ENOSPC) if all pools are used for
+ * other cpumasks or ERR_PTR(-ENOMEM) if no worker could be created.
+ */
+static struct global_cwq *get_unbound_pool(const struct cpumask *cpumask)
+{
+	struct global_cwq *gcwq;
+	struct worker *worker;
+	int i, free = -1;
+	bool has_workers;
+
+	for (i = 0; i < WORK_NR_UNBOUND_POOLS; i++) {
+		if (cpumask_equal(unbound_pools[i].cpumask, cpumask))
+			goto found;
+		/* the default pool always spans all cpus */
+		if (free < 0 && i && !unbound_pools[i].nr_wqs)
+			free = i;
+	}
+	if (free < 0)
+		return ERR_PTR(-ENOSPC);
+
+	i = free;
+found:
+	gcwq = get_gcwq(WORK_CPU_UNBOUND + i);
+
+	/* workers left in a reclaimed pool notice the new cpumask */
+	if (i == free) {
+		spin_lock_irq(&gcwq->lock);
+		cpumask_copy(unbound_pools[i].cpumask, cpumask);
+		unbound_pools[i].cpumask_gen++;
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	/* pools other than the default one get their first worker here */
+	spin_lock_irq(&gcwq->lock);
+	has_workers = gcwq->nr_workers;
+	spin_unlock_irq(&gcwq->lock);
+
+	if (!has_workers) {
+		worker = create_worker(gcwq, false);
+		if (!worker)
+			return ERR_PTR(-ENOMEM);
+		spin_lock_irq(&gcwq->lock);
+		start_worker(worker);
+		spin_unlock_irq(&gcwq->lock);
+	}
+
+	unbound_pools[i].nr_wqs++;
+	return gcwq;
+}
+
+static void put_unbound_pool(struct global_cwq *gcwq)
+{
+	gcwq_unbound_pool(gcwq)->nr_wqs--;
+}
+
+/*
+ * Does @cwq have works active or running on its gcwq?  Called with
+ * the gcwq lock held.
+ */
+static bool cwq_busy_on_gcwq(struct cpu_workqueue_struct *cwq)
+{
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct worker *worker, *rescuer = cwq->wq->rescuer;
+	struct work_struct *work;
+	struct hlist_node *pos;
+	int i;
+
+	if (cwq->nr_active)
+		return true;
+
+	/* barriers aren't counted as active */
+	list_for_each_entry(work, &gcwq->worklist, entry)
+		if (get_work_cwq(work) == cwq)
+			return true;
+
+	for_each_busy_worker(worker, i, pos, gcwq)
+		if (worker->current_cwq == cwq)
+			return true;
+
+	return rescuer && rescuer->gcwq == gcwq &&
+		!list_empty(&rescuer->scheduled);
+}
+
+/**
+ * workqueue_set_unbound_cpumask - confine an unbound workqueue to some cpus
+ * @wq: target unbound workqueue
+ * @cpumask: cpus the works of @wq may run on
+ *
+ * Move @wq to the unbound worker pool running on @cpumask, which is
+ * set up if no workqueue uses it yet.  Workqueues with the same
+ * cpumask share a pool and at most WORK_NR_UNBOUND_POOLS different
+ * cpumasks, including the default one of all cpus, can be in use at
+ * a time.
+ *
+ * Activation of works on @wq is held off as for freezing until its
+ * active works have finished on the old pool, the works still pending
+ * then are run by the new one.
+ *
+ * CONTEXT:
+ * Might sleep.  Don't call from a work item of @wq.
+ *
+ * RETURNS:
+ * 0 on success, -EINVAL if @wq isn't unbound or @cpumask has no
+ * possible cpu, -ENOSPC if all pools are in use for other cpumasks and
+ * -ENOMEM on allocation failure.
+ */
+int workqueue_set_unbound_cpumask(struct workqueue_struct *wq,
+				  const struct cpumask *cpumask)
+{
+	struct cpu_workqueue_struct *cwq = get_cwq(WORK_CPU_UNBOUND, wq);
+	struct global_cwq *gcwq, *old_gcwq;
+	cpumask_var_t mask;
+	bool busy;
+	int ret = 0;
+
+	if (!(wq->flags & WQ_UNBOUND))
+		return -EINVAL;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	cpumask_and(mask, cpumask, cpu_possible_mask);
+	if (cpumask_empty(mask)) {
+		ret = -EINVAL;
+		goto out_free;
+	}
+
+	mutex_lock(&wq_pool_mutex);
+	gcwq = get_unbound_pool(mask);
+	mutex_unlock(&wq_pool_mutex);
+	if (IS_ERR(gcwq)) {
+		ret = PTR_ERR(gcwq);
+		goto out_free;
+	}
+
+	/*
+	 * Wait without wq_pool_mutex, works of @wq may create or destroy
+	 * workqueues.  The reference held on @gcwq keeps it from being
+	 * reused, and a racing caller just finds @wq on another old pool.
+	 */
+	do {
+		/* flushers look at cwq->gcwq under flush_mutex */
+		mutex_lock(&wq->flush_mutex);
+		spin_lock(&workqueue_lock);
+		old_gcwq = cwq->gcwq;
+		busy = false;
+		if (old_gcwq != gcwq) {
+			spin_lock_irq(&old_gcwq->lock);
+			spin_lock_nested(&gcwq->lock, SINGLE_DEPTH_NESTING);
+
+			/*
+			 * Redone on every try, workqueue_set_max_active()
+			 * may have restored max_active meanwhile.
+			 */
+			cwq->max_active = 0;
+			busy = cwq_busy_on_gcwq(cwq);
+			if (!busy) {
+				cwq->gcwq = gcwq;
+				if (!(wq->flags & WQ_FREEZABLE) ||
+				    !(gcwq->flags & GCWQ_FREEZING))
+					cwq->max_active = wq->saved_max_active;
+				while (!list_empty(&cwq->delayed_works) &&
+				       cwq->nr_active < cwq->max_active)
+					cwq_activate_first_delayed(cwq);
+				wake_up_worker(gcwq);
+			}
+
+			spin_unlock(&gcwq->lock);
+			spin_unlock_irq(&old_gcwq->lock);
+		}
+		spin_unlock(&workqueue_lock);
+		mutex_unlock(&wq->flush_mutex);
+
+		if (busy)
+			msleep(1);
+	} while (busy);
+
+	/* drops the extra reference if @wq already was on @gcwq */
+	mutex_lock(&wq_pool_mutex);
+	put_unbound_pool(old_gcwq);
+	mutex_unlock(&wq_pool_mutex);
+out_free:
+	free_cpumask_var(mask);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(workqueue_set_unbound_cpumask);
+
+#ifdef CONFIG_SYSFS
+/*
+ * Workqueues created with WQ_SYSFS show up as devices on the workqueue
+ * bus, /sys/bus/workqueue/devices/<name>/ with these attributes:
+ *
+ *  per_cpu	RO bool	: whether the workqueue is per-cpu or unbound
+ *  max_active	RW int	: maximum number of in-flight work items
+ *  cpumask	RW mask	: cpus works of an unbound workqueue run on
+ *
+ * Workqueues created before the bus is registered are added by
+ * wq_sysfs_init().
+ */
+struct wq_device {
+	struct workqueue_struct		*wq;
+	struct device			dev;
+};
+
+static bool wq_sysfs_ready;		/* Q: bus is registered */
+static struct device *wq_root_dev;
+
+static struct workqueue_struct *dev_to_wq(struct device *dev)
+{
+	return container_of(dev, struct wq_device, dev)->wq;
+}
+
+static ssize_t wq_per_cpu_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+			 !(wq->flags & WQ_UNBOUND));
+}
+
+static ssize_t wq_max_active_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", wq->saved_max_active);
+}
+
+static ssize_t wq_max_active_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	int val;
+
+	if (kstrtoint(buf, 10, &val) || val <= 0)
+		return -EINVAL;
+
+	workqueue_set_max_active(wq, val);
+	return count;
+}
+
+static ssize_t wq_cpumask_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	struct global_cwq *gcwq;
+	int written;
+
+	mutex_lock(&wq_pool_mutex);
+	gcwq = get_cwq(WORK_CPU_UNBOUND, wq)->gcwq;
+	written = cpumask_scnprintf(buf, PAGE_SIZE,
+				    gcwq_unbound_pool(gcwq)->cpumask);
+	mutex_unlock(&wq_pool_mutex);
+
+	written += scnprintf(buf + written, PAGE_SIZE - written, "\n");
+	return written;
+}
+
+static ssize_t wq_cpumask_store(struct device *dev,
+				struct device_attribute *attr,
+				const char *buf, size_t count)
+{
+	struct workqueue_struct *wq = dev_to_wq(dev);
+	cpumask_var_t mask;
+	int ret;
+
+	if (!alloc_cpumask_var(&mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = bitmap_parse(buf, count, cpumask_bits(mask), nr_cpumask_bits);
+	if (!ret)
+		ret = workqueue_set_unbound_cpumask(wq, mask);
+
+	free_cpumask_var(mask);
+	return ret ?: count;
+}
+
+static struct device_attribute wq_sysfs_attrs[] = {
+	__ATTR(per_cpu, 0444, wq_per_cpu_show, NULL),
+	__ATTR(max_active, 0644, wq_max_active_show, wq_max_active_store),
+	__ATTR_NULL,
+};
+
+static struct device_attribute wq_sysfs_unbound_attr =
+	__ATTR(cpumask, 0644, wq_cpumask_show, wq_cpumask_store);
+
+static struct bus_type wq_bus = {
+	.name		= "workqueue",
+	.dev_attrs	= wq_sysfs_attrs,
+};
+
+static void wq_device_release(struct device *dev)
+{
+	kfree(container_of(dev, struct wq_device, dev));
+}
+
+/*
+ * Called with wq_pool_mutex held, which keeps this in line with
+ * wq_sysfs_init().
+ */
+static int wq_sysfs_register(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+	int ret;
+
+	if (!wq_sysfs_ready)
+		return 0;
+
+	wq_dev = kzalloc(sizeof(*wq_dev), GFP_KERNEL);
+	if (!wq_dev)
+		return -ENOMEM;
+
+	wq_dev->wq = wq;
+	wq_dev->dev.bus = &wq_bus;
+	wq_dev->dev.parent = wq_root_dev;
+	wq_dev->dev.release = wq_device_release;
+	dev_set_name(&wq_dev->dev, "%s", wq->name);
+
+	ret = device_register(&wq_dev->dev);
+	if (ret) {
+		put_device(&wq_dev->dev);
+		return ret;
+	}
+
+	if (wq->flags & WQ_UNBOUND) {
+		ret = device_create_file(&wq_dev->dev, &wq_sysfs_unbound_attr);
+		if (ret) {
+			device_unregister(&wq_dev->dev);
+			return ret;
+		}
+	}
+
+	wq->wq_dev = wq_dev;
+	return 0;
+}
+
+static void wq_sysfs_unregister(struct workqueue_struct *wq)
+{
+	struct wq_device *wq_dev;
+
+	mutex_lock(&wq_pool_mutex);
+	wq_dev = wq->wq_dev;
+	wq->wq_dev = NULL;
+	mutex_unlock(&wq_pool_mutex);
+
+	/* waits for attribute methods, which may take wq_pool_mutex */
+	if (wq_dev)
+		device_unregister(&wq_dev->dev);
+}
+
+static int __init wq_sysfs_init(void)
+{
+	struct workqueue_struct *wq;
+	int ret;
+
+	ret = bus_register(&wq_bus);
+	if (ret)
+		return ret;
+
+	wq_root_dev = root_device_register("workqueue");
+	if (IS_ERR(wq_root_dev)) {
+		bus_unregister(&wq_bus);
+		return PTR_ERR(wq_root_dev);
+	}
+
+	/*
+	 * The workqueues list only changes with wq_pool_mutex held
+	 * too, walk it for the ones created before.  destroy_workqueue()
+	 * sets WQ_DYING before it unregisters.
+	 */
+	mutex_lock(&wq_pool_mutex);
+	wq_sysfs_ready = true;
+	list_for_each_entry(wq, &workqueues, list)
+		if ((wq->flags & (WQ_SYSFS | WQ_DYING)) == WQ_SYSFS &&
+		    wq_sysfs_register(wq))
+			printk(KERN_WARNING "workqueue: failed to register "
+			       "%s with sysfs\n", wq->name);
+	mutex_unlock(&wq_pool_mutex);
+
+	return 0;
+}
+core_initcall(wq_sysfs_init);
+#else	/* CONFIG_SYSFS */
+static int wq_sysfs_register(struct workqueue_struct *wq) { return 0; }
+static void wq_sysfs_unregister(struct workqueue_struct *wq) { }
+#endif	/* CONFIG_SYSFS */
+
 static int wq_clamp_max_active(int max_active, unsigned int flags,
 			       const char *name)
 {
@@ -2988,8 +3581,10 @@ struct workqueue_struct *__alloc_workqueue_key(const char *name,
 	/*
 	 * workqueue_lock protects global freeze state and workqueues
 	 * list.  Grab it, set max_active accordingly and add the new
-	 * workqueue to workqueues list.
+	 * workqueue to workqueues list.  wq_pool_mutex counts the users
+	 * of unbound pools and orders the list against sysfs setup.
 	 */
+	mutex_lock(&wq_pool_mutex);
 	spin_lock(&workqueue_lock);
 
 	if (workqueue_freezing && wq->flags & WQ_FREEZABLE)
@@ -3000,6 +3595,16 @@ struct workqueue_struct *__alloc_workqueue_key(const char *name,
 
 	spin_unlock(&workqueue_lock);
 
+	if (flags & WQ_UNBOUND)
+		unbound_pools[0].nr_wqs++;
+
+	if (flags & WQ_SYSFS && wq_sysfs_register(wq)) {
+		mutex_unlock(&wq_pool_mutex);
+		destroy_workqueue(wq);
+		return NULL;
+	}
+	mutex_unlock(&wq_pool_mutex);
+
 	return wq;
 err:
 	if (wq) {
@@ -3032,6 +3637,7 @@ void destroy_workqueue(struct workqueue_struct *wq)
 	 * should be relatively short.  Whine if it takes too long.
 	 */
 	wq->flags |= WQ_DYING;
+	wq_sysfs_unregister(wq);
 reflush:
 	flush_workqueue(wq);
 
@@ -3058,10 +3664,15 @@ reflush:
 	 * wq list is used to freeze wq, remove from list after
 	 * flushing is complete in case freeze races us.
 	 */
+	mutex_lock(&wq_pool_mutex);
 	spin_lock(&workqueue_lock);
 	list_del(&wq->list);
 	spin_unlock(&workqueue_lock);
 
+	if (wq->flags & WQ_UNBOUND)
+		put_unbound_pool(get_cwq(WORK_CPU_UNBOUND, wq)->gcwq);
+	mutex_unlock(&wq_pool_mutex);
+
 	/* sanity check */
 	for_each_cwq_cpu(cpu, wq) {
 		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
@@ -3105,13 +3716,14 @@ void workqueue_set_max_active(struct workqueue_struct *wq, int max_active)
 	wq->saved_max_active = max_active;
 
 	for_each_cwq_cpu(cpu, wq) {
-		struct global_cwq *gcwq = get_gcwq(cpu);
+		struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+		struct global_cwq *gcwq = cwq->gcwq;
 
 		spin_lock_irq(&gcwq->lock);
 
 		if (!(wq->flags & WQ_FREEZABLE) ||
 		    !(gcwq->flags & GCWQ_FREEZING))
-			get_cwq(gcwq->cpu, wq)->max_active = max_active;
+			cwq->max_active = max_active;
 
 		spin_unlock_irq(&gcwq->lock);
 	}
@@ -3151,7 +3763,9 @@ unsigned int work_cpu(struct work_struct *work)
 {
 	struct global_cwq *gcwq = get_work_gcwq(work);
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	if (!gcwq)
+		return WORK_CPU_NONE;
+	return min_t(unsigned int, gcwq->cpu, WORK_CPU_UNBOUND);
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3770,7 +4384,9 @@ void thaw_workqueues(void)
 		list_for_each_entry(wq, &workqueues, list) {
 			struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
 
-			if (!cwq || !(wq->flags & WQ_FREEZABLE))
+			/* an unbound cwq is found through every pool */
+			if (!cwq || cwq->gcwq != gcwq ||
+			    !(wq->flags & WQ_FREEZABLE))
 				continue;
 
 			/* restore max_active and repopulate worklist */
@@ -3800,6 +4416,11 @@ static int __init init_workqueues(void)
 	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
 	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
 
+	for (i = 0; i < WORK_NR_UNBOUND_POOLS; i++)
+		BUG_ON(!zalloc_cpumask_var(&unbound_pools[i].cpumask,
+					   GFP_KERNEL));
+	cpumask_copy(unbound_pools[0].cpumask, cpu_possible_mask);
+
 	/* initialize gcwqs */
 	for_each_gcwq_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
@@ -3843,7 +4464,8 @@ static int __init init_workqueues(void)
 	system_wq = alloc_workqueue("events", 0, 0);
 	system_long_wq = alloc_workqueue("events_long", 0, 0);
 	system_nrt_wq = alloc_workqueue("events_nrt", WQ_NON_REENTRANT, 0);
-	system_unbound_wq = alloc_workqueue("events_unbound", WQ_UNBOUND,
+	system_unbound_wq = alloc_workqueue("events_unbound",
+					    WQ_UNBOUND | WQ_SYSFS,
 					    WQ_UNBOUND_MAX_ACTIVE);
 	system_freezable_wq = alloc_workqueue("events_freezable",
 					      WQ_FREEZABLE, 0);
@@ -0,0 +1,513 @@
+/*
+ * Boot time self-test of the BPF socket filter interpreter and JIT
+ *
+ * Every filter runs through sk_run_filter() and, when CONFIG_BPF_JIT is
+ * set, through the JIT image as well, on both a linear and a paged skb.
+ * The results must agree with each other and with the expected value.  A
+ * filter the JIT declines to compile fails the test unless it is marked
+ * FLAG_JIT_OPTIONAL.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; version 2 of the License.
+ */
+
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+
+#define MAX_INSNS	16
+#define PKT_LEN		64
+#define HEAD_LEN	20	/* linear part of the paged skb */
+
+/* the result depends on the running cpu, only compare interpreter and JIT */
+#define FLAG_NO_EXPECT	1
+/* not every JIT compiles this, it may be left to the interpreter */
+#define FLAG_JIT_OPTIONAL	2
+
+struct bpf_test {
+	const char *descr;
+	struct sock_filter insns[MAX_INSNS];
+	u32 expect;
+	int flags;
+};
+
+static struct bpf_test tests[] __initdata = {
+	{
+		"RET K",
+		{ BPF_STMT(BPF_RET | BPF_K, 42) },
+		42,
+	},
+	{
+		"LD IMM",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 0xdeadbeef),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0xdeadbeef,
+	},
+	{
+		"ALU K",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 0x12345),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_K, 0x10000),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_K, 3),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_K, 0xff00),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xfff0),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_K, 4),
+			BPF_STMT(BPF_ALU | BPF_RSH | BPF_K, 2),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0x3ff40,
+	},
+	{
+		"ALU X",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 3),
+			BPF_STMT(BPF_LD | BPF_IMM, 10),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_SUB | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_MUL | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_LSH | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_RSH | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_OR | BPF_X, 0),
+			BPF_STMT(BPF_ALU | BPF_AND | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		3,
+	},
+	{
+		"DIV K",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1000),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_K, 7),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		142,
+	},
+	{
+		"DIV X",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1000),
+			BPF_STMT(BPF_LDX | BPF_IMM, 7),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		142,
+	},
+	{
+		"DIV X by zero",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1000),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0),
+			BPF_STMT(BPF_ALU | BPF_DIV | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0,
+	},
+	{
+		"NEG",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 1),
+			BPF_STMT(BPF_ALU | BPF_NEG, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0xffffffff,
+	},
+	{
+		"LD ABS",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 4),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 16),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 63),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0x04051657,
+	},
+	{
+		"LD ABS across the head",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, HEAD_LEN - 2),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0x12131415,
+	},
+	{
+		"LD ABS out of bounds",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, PKT_LEN - 2),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0,
+	},
+	{
+		"LD IND",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 8),
+			BPF_STMT(BPF_LD | BPF_W | BPF_IND, 2),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0x0a0b0c0d,
+	},
+	{
+		"LD IND out of bounds",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, PKT_LEN - 4),
+			BPF_STMT(BPF_LD | BPF_H | BPF_IND, 4),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0,
+	},
+	{
+		"LD IND wrapping offset",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 0xffffffff),
+			BPF_STMT(BPF_LD | BPF_B | BPF_IND, 3),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		2,
+	},
+	{
+		"LEN",
+		{
+			BPF_STMT(BPF_LDX | BPF_W | BPF_LEN, 0),
+			BPF_STMT(BPF_MISC | BPF_TXA, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PKT_LEN,
+	},
+	{
+		"LDX MSH",
+		{
+			BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, ETH_HLEN),
+			BPF_STMT(BPF_MISC | BPF_TXA, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		(ETH_HLEN & 0xf) << 2,
+	},
+	{
+		"MEM",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 5),
+			BPF_STMT(BPF_ST, 0),
+			BPF_STMT(BPF_LDX | BPF_IMM, 11),
+			BPF_STMT(BPF_STX, 15),
+			BPF_STMT(BPF_LD | BPF_MEM, 15),
+			BPF_STMT(BPF_MISC | BPF_TAX, 0),
+			BPF_STMT(BPF_LD | BPF_MEM, 0),
+			BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		16,
+	},
+	{
+		"JMP K",
+		{
+			BPF_STMT(BPF_LD | BPF_IMM, 10),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 10, 0, 6),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 10, 5, 0),
+			BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, 10, 0, 4),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x300, 3, 0),
+			BPF_STMT(BPF_LD | BPF_IMM, 0x12345),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x10001, 0, 1),
+			BPF_STMT(BPF_JMP | BPF_JA, 1),
+			BPF_STMT(BPF_RET | BPF_K, 0),
+			BPF_STMT(BPF_RET | BPF_K, 7),
+		},
+		7,
+	},
+	{
+		"JMP X",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 5),
+			BPF_STMT(BPF_LD | BPF_IMM, 6),
+			BPF_JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 0, 5),
+			BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_X, 0, 1, 1),
+			BPF_STMT(BPF_LDX | BPF_IMM, 0),
+			BPF_JUMP(BPF_JMP | BPF_JGE | BPF_X, 0, 0, 2),
+			BPF_JUMP(BPF_JMP | BPF_JSET | BPF_X, 0, 0, 1),
+			BPF_STMT(BPF_RET | BPF_K, 8),
+			BPF_STMT(BPF_RET | BPF_K, 9),
+		},
+		8,
+	},
+	{
+		"ANC PROTOCOL",
+		{
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_AD_OFF + SKF_AD_PROTOCOL),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		ETH_P_IP,
+	},
+	{
+		"ANC MARK",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_MARK),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0x12345678,
+	},
+	{
+		"ANC QUEUE",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_QUEUE),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		3,
+	},
+	{
+		"ANC RXHASH",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_RXHASH),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0xcafe,
+	},
+	{
+		"ANC IFINDEX without device",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_IFINDEX),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0,
+	},
+	{
+		"ANC HATYPE without device",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_HATYPE),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0,
+		FLAG_JIT_OPTIONAL,
+	},
+	{
+		"ANC CPU",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0,
+		FLAG_NO_EXPECT,
+	},
+	{
+		"ANC PKTTYPE",
+		{
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		PACKET_HOST,
+		FLAG_JIT_OPTIONAL,
+	},
+	{
+		"LD ABS SKF_NET_OFF",
+		{
+			BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_NET_OFF + 2),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		ETH_HLEN + 2,
+		FLAG_JIT_OPTIONAL,
+	},
+	{
+		"LD ABS SKF_LL_OFF",
+		{
+			BPF_STMT(BPF_LD | BPF_H | BPF_ABS, SKF_LL_OFF + 12),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		0x0c0d,
+		FLAG_JIT_OPTIONAL,
+	},
+	{
+		"LD IND SKF_NET_OFF",
+		{
+			BPF_STMT(BPF_LDX | BPF_IMM, 3),
+			BPF_STMT(BPF_LD | BPF_B | BPF_IND, SKF_NET_OFF),
+			BPF_STMT(BPF_RET | BPF_A, 0),
+		},
+		ETH_HLEN + 3,
+	},
+	{
+		"LD ABS SKF_NET_OFF out of bounds",
+		{
+			BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_NET_OFF + PKT_LEN),
+			BPF_STMT(BPF_RET | BPF_K, 1),
+		},
+		0,
+		FLAG_JIT_OPTIONAL,
+	},
+};
+
+/*
+ * 64 bytes holding their own offset, the network header right after a
+ * 14 byte link layer header.  The paged variant keeps HEAD_LEN bytes in
+ * the linear area and the rest in a page fragment.
+ */
+static struct sk_buff *__init test_bpf_skb(bool paged)
+{
+	unsigned int head_len = paged ? HEAD_LEN : PKT_LEN;
+	struct sk_buff *skb;
+	struct page *page;
+	u8 *data;
+	int i;
+
+	skb = alloc_skb(PKT_LEN, GFP_KERNEL);
+	if (!skb)
+		return NULL;
+
+	data = skb_put(skb, head_len);
+	for (i = 0; i < head_len; i++)
+		data[i] = i;
+
+	if (paged) {
+		page = alloc_page(GFP_KERNEL);
+		if (!page) {
+			kfree_skb(skb);
+			return NULL;
+		}
+		data = page_address(page);
+		for (i = head_len; i < PKT_LEN; i++)
+			data[i - head_len] = i;
+
+		skb_fill_page_desc(skb, 0, page, 0, PKT_LEN - head_len);
+		skb->len += PKT_LEN - head_len;
+		skb->data_len += PKT_LEN - head_len;
+		skb->truesize += PAGE_SIZE;
+	}
+
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, ETH_HLEN);
+	skb->protocol = htons(ETH_P_IP);
+	skb->pkt_type = PACKET_HOST;
+	skb->mark = 0x12345678;
+	skb->queue_mapping = 3;
+	skb->rxhash = 0xcafe;
+
+	return skb;
+}
+
+static unsigned int __init test_bpf_len(const struct bpf_test *t)
+{
+	unsigned int len;
+
+	/* the filter ends with the last non zero (RET) instruction */
+	for (len = MAX_INSNS; len > 0; len--)
+		if (t->insns[len - 1].code)
+			break;
+	return len;
+}
+
+static struct sk_filter *__init test_bpf_filter(const struct bpf_test *t)
+{
+	unsigned int len = test_bpf_len(t);
+	struct sk_filter *fp;
+	int err;
+
+	fp = kmalloc(sizeof(*fp) + len * sizeof(struct sock_filter),
+		     GFP_KERNEL);
+	if (!fp)
+		return ERR_PTR(-ENOMEM);
+
+	atomic_set(&fp->refcnt, 1);
+	fp->len = len;
+	fp->bpf_func = sk_run_filter;
+	memcpy(fp->insns, t->insns, len * sizeof(struct sock_filter));
+
+	err = sk_chk_filter(fp->insns, len);
+	if (err) {
+		kfree(fp);
+		return ERR_PTR(err);
+	}
+
+#ifdef CONFIG_BPF_JIT
+	{
+		/* compile regardless of the sysctl, the test owns the filter */
+		int enable = bpf_jit_enable;
+
+		bpf_jit_enable = 1;
+		bpf_jit_compile(fp);
+		bpf_jit_enable = enable;
+	}
+#endif
+	return fp;
+}
+
+static int __init test_bpf_run(const struct bpf_test *t, struct sk_buff *skb,
+			       const char *kind)
+{
+	struct sk_filter *fp;
+	unsigned int ret, jit_ret;
+	int err = 0;
+
+	fp = test_bpf_filter(t);
+	if (IS_ERR(fp)) {
+		pr_err("test_bpf: %s: filter rejected (%ld)\n",
+		       t->descr, PTR_ERR(fp));
+		return 1;
+	}
+
+#ifdef CONFIG_BPF_JIT
+	if (!(t->flags & FLAG_JIT_OPTIONAL) && fp->bpf_func == sk_run_filter) {
+		pr_err("test_bpf: %s: not JIT compiled\n", t->descr);
+		err = 1;
+	}
+#endif
+
+	ret = sk_run_filter(skb, fp->insns);
+	jit_ret = SK_RUN_FILTER(fp, skb);
+
+	if (ret != jit_ret) {
+		pr_err("test_bpf: %s (%s skb): interpreter %#x, jit %#x\n",
+		       t->descr, kind, ret, jit_ret);
+		err = 1;
+	} else if (!(t->flags & FLAG_NO_EXPECT) && ret != t->expect) {
+		pr_err("test_bpf: %s (%s skb): got %#x, expected %#x\n",
+		       t->descr, kind, ret, t->expect);
+		err = 1;
+	}
+
+	bpf_jit_free(fp);
+	kfree(fp);
+	return err;
+}
+
+static int __init test_bpf_init(void)
+{
+	struct sk_buff *linear, *paged;
+	int i, failed = 0;
+
+	linear = test_bpf_skb(false);
+	paged = test_bpf_skb(true);
+	if (!linear || !paged) {
+		pr_err("test_bpf: cannot allocate the test skbs\n");
+		goto out;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		failed += test_bpf_run(&tests[i], linear, "linear");
+		failed += test_bpf_run(&tests[i], paged, "paged");
+	}
+
+	if (failed)
+		pr_err("test_bpf: %d of %zu runs failed\n",
+		       failed, 2 * ARRAY_SIZE(tests));
+	else
+		pr_info("test_bpf: all %zu runs passed\n",
+			2 * ARRAY_SIZE(tests));
+out:
+	kfree_skb(linear);
+	kfree_skb(paged);
+	return 0;
+}
+
+late_initcall(test_bpf_init);
@@ -0,0 +1,142 @@
+/*
+ * Cost of printk() under contention
+ *
+ * One thread per online cpu, bound to it, calls printk() a number of
+ * times, with interrupts disabled by default as a driver's interrupt
+ * handler would. This runs once on a single cpu and once on all of them
+ * at the same time, and the mean and worst time a printk() call took is
+ * reported for both.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; version 2 of the License.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/sched.h>
+#include <linux/cpu.h>
+
+static unsigned int nr_msgs = 10000;
+module_param(nr_msgs, uint, 0444);
+MODULE_PARM_DESC(nr_msgs, "printk() calls per cpu");
+
+static int irqs_off = 1;
+module_param(irqs_off, bool, 0444);
+MODULE_PARM_DESC(irqs_off, "Call printk() with interrupts disabled");
+
+static int level = 7;
+module_param(level, int, 0444);
+MODULE_PARM_DESC(level, "Log level of the messages");
+
+struct test_printk_cpu {
+	u64 total_ns;
+	u64 max_ns;
+};
+
+static DEFINE_PER_CPU(struct test_printk_cpu, results);
+static atomic_t nr_waiting;
+static atomic_t nr_busy;
+static DECLARE_COMPLETION(all_done);
+
+static int test_printk_thread(void *data)
+{
+	struct test_printk_cpu *res = data;
+	unsigned long flags = 0;
+	unsigned int i;
+	u64 t0, t;
+
+	/* Start together, the point is to contend */
+	atomic_dec(&nr_waiting);
+	while (atomic_read(&nr_waiting))
+		cpu_relax();
+
+	for (i = 0; i < nr_msgs; i++) {
+		if (irqs_off)
+			local_irq_save(flags);
+		t0 = local_clock();
+		printk("<%d>test_printk: cpu %d message %u of %u\n",
+		       level, smp_processor_id(), i, nr_msgs);
+		t = local_clock() - t0;
+		if (irqs_off)
+			local_irq_restore(flags);
+
+		res->total_ns += t;
+		if (t > res->max_ns)
+			res->max_ns = t;
+		if (!irqs_off)
+			cond_resched();
+	}
+
+	if (atomic_dec_and_test(&nr_busy))
+		complete(&all_done);
+	return 0;
+}
+
+static int __init test_printk_run(const struct cpumask *cpus)
+{
+	struct test_printk_cpu *res;
+	struct task_struct *p;
+	u64 total = 0, max = 0;
+	int cpu, nr = cpumask_weight(cpus), started = 0;
+
+	atomic_set(&nr_waiting, nr);
+	atomic_set(&nr_busy, nr);
+	INIT_COMPLETION(all_done);
+
+	for_each_cpu(cpu, cpus) {
+		res = &per_cpu(results, cpu);
+		memset(res, 0, sizeof(*res));
+		p = kthread_create(test_printk_thread, res,
+				   "test_printk/%d", cpu);
+		if (IS_ERR(p)) {
+			/* let the threads already started go and finish */
+			atomic_sub(nr - started, &nr_busy);
+			atomic_sub(nr - started, &nr_waiting);
+			if (started)
+				wait_for_completion(&all_done);
+			return PTR_ERR(p);
+		}
+		kthread_bind(p, cpu);
+		wake_up_process(p);
+		started++;
+	}
+	wait_for_completion(&all_done);
+
+	for_each_cpu(cpu, cpus) {
+		res = &per_cpu(results, cpu);
+		total += res->total_ns;
+		max = max(max, res->max_ns);
+	}
+
+	pr_info("test_printk: %d cpus, %u calls each%s: "
+		"mean %llu ns, max %llu ns\n", nr, nr_msgs,
+		irqs_off ? " with irqs off" : "",
+		div_u64(total, nr * nr_msgs), max);
+	return 0;
+}
+
+static int __init test_printk_init(void)
+{
+	int err;
+
+	if (!nr_msgs)
+		return -EINVAL;
+
+	get_online_cpus();
+	err = test_printk_run(cpumask_of(cpumask_first(cpu_online_mask)));
+	if (!err && num_online_cpus() > 1)
+		err = test_printk_run(cpu_online_mask);
+	put_online_cpus();
+
+	/* Nothing to keep loaded, fail so the test can be run again */
+	return err ? err : -EAGAIN;
+}
+module_init(test_printk_init);
+
+MODULE_DESCRIPTION("printk() contention test");
+MODULE_LICENSE("GPL");
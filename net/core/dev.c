@@ -2008,22 +2008,17 @@ static int dev_gso_segment(struct sk_buff *skb, int features)
 }
 
 /*
- * Try to orphan skb early, right before transmission by the device.
- * We cannot orphan skb if tx timestamp is requested or the sk-reference
- * is needed on driver level for other reasons, e.g. see net/can/raw.c
+ * The skb keeps its socket until the driver frees it, so that the socket
+ * is charged for what sits in the device ring too (TCP small queues rely
+ * on that). Drivers that orphan it themselves lose skb->sk, so copy
+ * sk_hash into skb->rxhash for skb_tx_hash().
  */
-static inline void skb_orphan_try(struct sk_buff *skb)
+static inline void skb_save_sk_hash(struct sk_buff *skb)
 {
 	struct sock *sk = skb->sk;
 
-	if (sk && !skb_shinfo(skb)->tx_flags) {
-		/* skb_tx_hash() wont be able to get sk.
-		 * We copy sk_hash into skb->rxhash
-		 */
-		if (!skb->rxhash)
-			skb->rxhash = sk->sk_hash;
-		skb_orphan(skb);
-	}
+	if (sk && !skb->rxhash)
+		skb->rxhash = sk->sk_hash;
 }
 
 static bool can_checksum_protocol(unsigned long features, __be16 protocol)
@@ -2114,7 +2109,7 @@ int dev_hard_start_xmit(struct sk_buff *skb, struct net_device *dev,
 		if (!list_empty(&ptype_all))
 			dev_queue_xmit_nit(skb, dev);
 
-		skb_orphan_try(skb);
+		skb_save_sk_hash(skb);
 
 		features = netif_skb_features(skb);
 
@@ -2183,7 +2178,7 @@ gso:
 			return rc;
 		}
 		txq_trans_update(txq);
-		if (unlikely(netif_tx_queue_stopped(txq) && skb->next))
+		if (unlikely(netif_xmit_stopped(txq) && skb->next))
 			return NETDEV_TX_BUSY;
 	} while (skb->next);
 
@@ -2457,7 +2452,7 @@ int dev_queue_xmit(struct sk_buff *skb)
 
 			HARD_TX_LOCK(dev, txq, cpu);
 
-			if (!netif_tx_queue_stopped(txq)) {
+			if (!netif_xmit_stopped(txq)) {
 				__this_cpu_inc(xmit_recursion);
 				rc = dev_hard_start_xmit(skb, dev, txq);
 				__this_cpu_dec(xmit_recursion);
@@ -2588,6 +2583,67 @@ EXPORT_SYMBOL(__skb_get_rxhash);
 struct rps_sock_flow_table __rcu *rps_sock_flow_table __read_mostly;
 EXPORT_SYMBOL(rps_sock_flow_table);
 
+/*
+ * Automatic RPS: receive queues without an explicit rps_cpus map (typically
+ * the single queue of an SDIO or USB NIC) spread their flows over all online
+ * CPUs once they receive more than rps_auto_threshold packets per second,
+ * and go back to local processing when the rate falls under half of it.
+ * Zero disables the feature.
+ */
+int rps_auto_threshold __read_mostly;
+static struct rps_map __rcu *rps_auto_map;
+static DEFINE_MUTEX(rps_auto_mutex);
+
+#define RPS_AUTO_INTERVAL	(HZ / 10 ? : 1)
+
+static void rps_auto_map_update(void)
+{
+	struct rps_map *map, *old_map;
+	int cpu, i = 0;
+
+	map = kzalloc(max_t(unsigned int, RPS_MAP_SIZE(num_online_cpus()),
+			    L1_CACHE_BYTES), GFP_KERNEL);
+
+	mutex_lock(&rps_auto_mutex);
+	if (map) {
+		for_each_online_cpu(cpu)
+			map->cpus[i++] = cpu;
+		map->len = i;
+	}
+	old_map = rcu_dereference_protected(rps_auto_map,
+					    lockdep_is_held(&rps_auto_mutex));
+	rcu_assign_pointer(rps_auto_map, map);
+	mutex_unlock(&rps_auto_mutex);
+
+	if (old_map)
+		kfree_rcu(old_map, rcu);
+}
+
+static bool rps_auto_busy(struct netdev_rx_queue *rxqueue)
+{
+	unsigned long elapsed = jiffies - rxqueue->auto_stamp;
+	unsigned long limit;
+
+	rxqueue->auto_count++;
+	if (elapsed < RPS_AUTO_INTERVAL)
+		return rxqueue->auto_active;
+
+	if (elapsed > 2 * RPS_AUTO_INTERVAL) {
+		/* idle for a while, start a new estimate */
+		rxqueue->auto_active = false;
+	} else {
+		limit = rps_auto_threshold * elapsed / HZ;
+		if (rxqueue->auto_count >= limit)
+			rxqueue->auto_active = true;
+		else if (rxqueue->auto_count < limit / 2)
+			rxqueue->auto_active = false;
+	}
+	rxqueue->auto_stamp += elapsed;
+	rxqueue->auto_count = 0;
+
+	return rxqueue->auto_active;
+}
+
 static struct rps_dev_flow *
 set_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 	    struct rps_dev_flow *rflow, u16 next_cpu)
@@ -2674,7 +2730,11 @@ static int get_rps_cpu(struct net_device *dev, struct sk_buff *skb,
 			goto done;
 		}
 	} else if (!rcu_dereference_raw(rxqueue->rps_flow_table)) {
-		goto done;
+		if (!rps_auto_threshold || !rps_auto_busy(rxqueue))
+			goto done;
+		map = rcu_dereference(rps_auto_map);
+		if (!map || map->len < 2)
+			goto done;
 	}
 
 	skb_reset_network_header(skb);
@@ -2818,6 +2878,10 @@ static int enqueue_to_backlog(struct sk_buff *skb, int cpu,
 
 	local_irq_save(flags);
 
+#ifdef CONFIG_RPS
+	if (cpu != smp_processor_id())
+		__get_cpu_var(softnet_data).steered_rps++;
+#endif
 	rps_lock(sd);
 	if (skb_queue_len(&sd->input_pkt_queue) <= netdev_max_backlog) {
 		if (skb_queue_len(&sd->input_pkt_queue)) {
@@ -4099,10 +4163,12 @@ static int softnet_seq_show(struct seq_file *seq, void *v)
 {
 	struct softnet_data *sd = v;
 
-	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x\n",
+	seq_printf(seq, "%08x %08x %08x %08x %08x %08x %08x %08x %08x %08x "
+		   "%08x %08x\n",
 		   sd->processed, sd->dropped, sd->time_squeeze, 0,
 		   0, 0, 0, 0, /* was fastroute */
-		   sd->cpu_collision, sd->received_rps);
+		   sd->cpu_collision, sd->received_rps,
+		   sd->steered_rps, skb_queue_len(&sd->input_pkt_queue));
 	return 0;
 }
 
@@ -5407,6 +5473,9 @@ static void netdev_init_one_queue(struct net_device *dev,
 	queue->xmit_lock_owner = -1;
 	netdev_queue_numa_node_write(queue, NUMA_NO_NODE);
 	queue->dev = dev;
+#ifdef CONFIG_BQL
+	dql_init(&queue->dql, HZ);
+#endif
 }
 
 static int netif_alloc_netdev_queues(struct net_device *dev)
@@ -6179,6 +6248,12 @@ static int dev_cpu_callback(struct notifier_block *nfb,
 	unsigned int cpu, oldcpu = (unsigned long)ocpu;
 	struct softnet_data *sd, *oldsd;
 
+#ifdef CONFIG_RPS
+	if (action == CPU_ONLINE || action == CPU_ONLINE_FROZEN ||
+	    action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		rps_auto_map_update();
+#endif
+
 	if (action != CPU_DEAD && action != CPU_DEAD_FROZEN)
 		return NOTIFY_OK;
 
@@ -6525,6 +6600,9 @@ static int __init net_dev_init(void)
 	open_softirq(NET_TX_SOFTIRQ, net_tx_action);
 	open_softirq(NET_RX_SOFTIRQ, net_rx_action);
 
+#ifdef CONFIG_RPS
+	rps_auto_map_update();
+#endif
 	hotcpu_notifier(dev_cpu_callback, 0);
 	dst_init();
 	dev_mcast_init();
@@ -170,6 +170,14 @@ static struct ctl_table net_core_table[] = {
 		.mode		= 0644,
 		.proc_handler	= rps_sock_flow_sysctl
 	},
+	{
+		.procname	= "rps_auto_threshold",
+		.data		= &rps_auto_threshold,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.extra1		= &zero,
+		.proc_handler	= proc_dointvec_minmax
+	},
 #endif
 #endif /* CONFIG_NET */
 	{
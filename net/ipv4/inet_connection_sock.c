@@ -15,6 +15,7 @@
 
 #include <linux/module.h>
 #include <linux/jhash.h>
+#include <linux/tcp.h>
 
 #include <net/inet_connection_sock.h>
 #include <net/inet_hashtables.h>
@@ -266,6 +267,7 @@ static int inet_csk_wait_for_connect(struct sock *sk, long timeo)
 struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 {
 	struct inet_connection_sock *icsk = inet_csk(sk);
+	struct request_sock *req;
 	struct sock *newsk;
 	int error;
 
@@ -292,8 +294,22 @@ struct sock *inet_csk_accept(struct sock *sk, int flags, int *err)
 			goto out_err;
 	}
 
-	newsk = reqsk_queue_get_child(&icsk->icsk_accept_queue, sk);
-	WARN_ON(newsk->sk_state == TCP_SYN_RECV);
+	req = reqsk_queue_remove(&icsk->icsk_accept_queue);
+	newsk = req->sk;
+	sk_acceptq_removed(sk);
+	if (sk->sk_protocol == IPPROTO_TCP && tcp_rsk(req)->listener) {
+		/* A Fast Open child still owns its request sock until the
+		 * SYN-ACK is acked, tcp_fastopen_remove() frees it then.
+		 */
+		write_lock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
+		if (tcp_rsk(req)->listener) {
+			req->sk = NULL;
+			req = NULL;
+		}
+		write_unlock_bh(&icsk->icsk_accept_queue.syn_wait_lock);
+	}
+	if (req)
+		__reqsk_free(req);
 out:
 	release_sock(sk);
 	return newsk;
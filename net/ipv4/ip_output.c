@@ -748,14 +748,15 @@ static inline int ip_ufo_append_data(struct sock *sk,
 			int getfrag(void *from, char *to, int offset, int len,
 			       int odd, struct sk_buff *skb),
 			void *from, int length, int hh_len, int fragheaderlen,
-			int transhdrlen, int maxfraglen, unsigned int flags)
+			int transhdrlen, int maxfraglen, unsigned int gso_size,
+			unsigned int flags)
 {
 	struct sk_buff *skb;
 	int err;
 
 	/* There is support for UDP fragmentation offload by network
-	 * device, so create one single skb packet containing complete
-	 * udp datagram
+	 * device, or the socket asked for UDP segmentation offload, so
+	 * create one single skb packet containing complete udp datagram
 	 */
 	if ((skb = skb_peek_tail(queue)) == NULL) {
 		skb = sock_alloc_send_skb(sk,
@@ -780,9 +781,15 @@ static inline int ip_ufo_append_data(struct sock *sk,
 		skb->ip_summed = CHECKSUM_PARTIAL;
 		skb->csum = 0;
 
-		/* specify the length of each IP datagram fragment */
-		skb_shinfo(skb)->gso_size = maxfraglen - fragheaderlen;
-		skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
+		if (gso_size) {
+			/* split into datagrams of gso_size payload each */
+			skb_shinfo(skb)->gso_size = gso_size;
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+		} else {
+			/* specify the length of each IP datagram fragment */
+			skb_shinfo(skb)->gso_size = maxfraglen - fragheaderlen;
+			skb_shinfo(skb)->gso_type = SKB_GSO_UDP;
+		}
 		__skb_queue_tail(queue, skb);
 	}
 
@@ -839,13 +846,18 @@ static int __ip_append_data(struct sock *sk,
 	    !exthdrlen)
 		csummode = CHECKSUM_PARTIAL;
 
+	/* UDP_SEGMENT cannot be honoured once xfrm adds its headers */
+	if (cork->gso_size && rt->dst.header_len)
+		return -EINVAL;
+
 	cork->length += length;
-	if (((length > mtu) || (skb && skb_is_gso(skb))) &&
+	if (((length > mtu) || (skb && skb_is_gso(skb)) || cork->gso_size) &&
 	    (sk->sk_protocol == IPPROTO_UDP) &&
-	    (rt->dst.dev->features & NETIF_F_UFO) && !rt->dst.header_len) {
+	    ((rt->dst.dev->features & NETIF_F_UFO) || cork->gso_size) &&
+	    !rt->dst.header_len) {
 		err = ip_ufo_append_data(sk, queue, getfrag, from, length,
 					 hh_len, fragheaderlen, transhdrlen,
-					 maxfraglen, flags);
+					 maxfraglen, cork->gso_size, flags);
 		if (err)
 			goto error;
 		return 0;
@@ -1079,6 +1091,7 @@ static int ip_setup_cork(struct sock *sk, struct inet_cork *cork,
 	cork->dst = &rt->dst;
 	cork->length = 0;
 	cork->tx_flags = ipc->tx_flags;
+	cork->gso_size = sk->sk_protocol == IPPROTO_UDP ? ipc->gso_size : 0;
 	cork->page = NULL;
 	cork->off = 0;
 
@@ -1152,6 +1165,10 @@ ssize_t	ip_append_page(struct sock *sk, struct flowi4 *fl4, struct page *page,
 	if (!(rt->dst.dev->features&NETIF_F_SG))
 		return -EOPNOTSUPP;
 
+	/* pages are not split into UDP_SEGMENT datagrams */
+	if (cork->gso_size)
+		return -EOPNOTSUPP;
+
 	hh_len = LL_RESERVED_SPACE(rt->dst.dev);
 	mtu = cork->fragsize;
 
@@ -1486,6 +1503,7 @@ void ip_send_reply(struct sock *sk, struct sk_buff *skb, __be32 daddr,
 	ipc.addr = daddr;
 	ipc.opt = NULL;
 	ipc.tx_flags = 0;
+	ipc.gso_size = 0;
 
 	if (replyopts.opt.opt.optlen) {
 		ipc.opt = &replyopts.opt;
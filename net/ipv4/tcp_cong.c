@@ -352,6 +352,30 @@ void tcp_cong_avoid_ai(struct tcp_sock *tp, u32 w)
 }
 EXPORT_SYMBOL_GPL(tcp_cong_avoid_ai);
 
+/*
+ * Pacing rate is twice the current delivery rate (mss * cwnd / srtt), so
+ * that slow start can still double cwnd every RTT. It is derived after the
+ * congestion module (cubic, reno, ...) has updated cwnd, so modules need
+ * no knowledge of it.
+ */
+void tcp_update_pacing_rate(struct sock *sk)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	u64 rate;
+
+	rate = (u64)tp->mss_cache * 2 * (HZ << 3);
+	rate *= max(tp->snd_cwnd, tp->packets_out);
+
+	/* srtt is in jiffies << 3. Below a couple of jiffies it is too
+	 * coarse to divide by, and zero before the first RTT sample:
+	 * keep the numerator, i.e. assume a one jiffy/8 srtt.
+	 */
+	if (tp->srtt > 8 + 2)
+		do_div(rate, tp->srtt);
+
+	sk->sk_pacing_rate = min_t(u64, rate, ~0U);
+}
+
 /*
  * TCP Reno congestion control
  * This is special case used for fallback as well.
@@ -0,0 +1,153 @@
+/*
+ * TCP Fast Open: cookie generation, the client side cookie cache and
+ * listener side bookkeeping of Fast Open children.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *	modify it under the terms of the GNU General Public License
+ *	as published by the Free Software Foundation; either version
+ *	2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/random.h>
+#include <linux/cryptohash.h>
+#include <linux/percpu.h>
+#include <linux/seqlock.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+/* Fills the SHA block after the address, and seeds the digest as well */
+static u32 tcp_fastopen_secret[16 - 1 + SHA_DIGEST_WORDS] __read_mostly;
+
+static DEFINE_PER_CPU(__u32 [16 + 5 + SHA_WORKSPACE_WORDS],
+		      tcp_fastopen_scratch);
+
+/* Serializes readers and writers of the per-destination cookie cache */
+static DEFINE_SEQLOCK(tcp_fastopen_seqlock);
+
+static int __init tcp_fastopen_init(void)
+{
+	get_random_bytes(tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	return 0;
+}
+__initcall(tcp_fastopen_init);
+
+/* Computes the cookie a server hands out to the client at @addr.
+ * Must be called with BH disabled (it uses a per-cpu scratch area).
+ */
+void tcp_fastopen_cookie_gen(__be32 addr, struct tcp_fastopen_cookie *foc)
+{
+	__u32 *tmp = __get_cpu_var(tcp_fastopen_scratch);
+
+	tmp[0] = (__force u32)addr;
+	memcpy(tmp + 1, tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	sha_transform(tmp + 16, (__u8 *)tmp, tmp + 16 + 5);
+
+	BUILD_BUG_ON(TCP_FASTOPEN_COOKIE_SIZE > 5 * sizeof(__u32));
+	memcpy(foc->val, tmp + 16, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+static struct inet_peer *tcp_fastopen_get_peer(struct sock *sk,
+					       bool *release_it)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+
+	if (!icsk->icsk_af_ops->get_peer)
+		return NULL;
+	return icsk->icsk_af_ops->get_peer(sk, release_it);
+}
+
+/* Client side: look up the cookie, MSS and recent SYN losses cached for
+ * the destination of @sk.
+ */
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	struct inet_peer *peer;
+	bool release_it = false;
+	unsigned int seq;
+
+	peer = tcp_fastopen_get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	do {
+		seq = read_seqbegin(&tcp_fastopen_seqlock);
+		if (peer->tcp_fastopen_mss)
+			*mss = peer->tcp_fastopen_mss;
+		cookie->len = peer->tcp_fastopen_cookie_len;
+		if (cookie->len > 0)
+			memcpy(cookie->val, peer->tcp_fastopen_cookie,
+			       cookie->len);
+		*syn_loss = peer->tcp_fastopen_syn_loss;
+		*last_syn_loss = *syn_loss ? peer->tcp_fastopen_syn_loss_ts : 0;
+	} while (read_seqretry(&tcp_fastopen_seqlock, seq));
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+/* Client side: remember the cookie and MSS from a SYN-ACK. @syn_lost
+ * records that a SYN with data apparently never made it, so that a
+ * middlebox dropping such SYNs quickly turns Fast Open off for this peer.
+ */
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	struct inet_peer *peer;
+	bool release_it = false;
+
+	peer = tcp_fastopen_get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&tcp_fastopen_seqlock);
+	if (mss)
+		peer->tcp_fastopen_mss = mss;
+	if (cookie->len > 0) {
+		peer->tcp_fastopen_cookie_len = cookie->len;
+		memcpy(peer->tcp_fastopen_cookie, cookie->val, cookie->len);
+	}
+	if (syn_lost) {
+		peer->tcp_fastopen_syn_loss++;
+		peer->tcp_fastopen_syn_loss_ts = jiffies;
+	} else {
+		peer->tcp_fastopen_syn_loss = 0;
+	}
+	write_sequnlock_bh(&tcp_fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+/* Detach a Fast Open child from the request sock it was created from,
+ * once its SYN-ACK is acked or the child goes away. The request sock is
+ * freed here unless it still sits in the listener's accept queue, in
+ * which case inet_csk_accept() or inet_csk_listen_stop() frees it.
+ */
+void tcp_fastopen_remove(struct sock *sk)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	struct request_sock *req = tp->fastopen_rsk;
+	struct sock *lsk = tcp_rsk(req)->listener;
+	struct request_sock_queue *queue;
+
+	tp->fastopen_rsk = NULL;
+
+	queue = &inet_csk(lsk)->icsk_accept_queue;
+	write_lock_bh(&queue->syn_wait_lock);
+	tcp_sk(lsk)->fastopen_qlen--;
+	tcp_rsk(req)->listener = NULL;
+	if (req->sk)	/* still queued, the accept side frees it */
+		req = NULL;
+	write_unlock_bh(&queue->syn_wait_lock);
+
+	sock_put(lsk);
+	if (req)
+		__reqsk_free(req);
+}
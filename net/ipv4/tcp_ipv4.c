@@ -773,7 +773,8 @@ static void tcp_v4_reqsk_send_ack(struct sock *sk, struct sk_buff *skb,
  */
 static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 			      struct request_sock *req,
-			      struct request_values *rvp)
+			      struct request_values *rvp,
+			      struct tcp_fastopen_cookie *foc)
 {
 	const struct inet_request_sock *ireq = inet_rsk(req);
 	struct flowi4 fl4;
@@ -784,7 +785,7 @@ static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 	if (!dst && (dst = inet_csk_route_req(sk, &fl4, req)) == NULL)
 		return -1;
 
-	skb = tcp_make_synack(sk, dst, req, rvp);
+	skb = tcp_make_synack(sk, dst, req, rvp, foc);
 
 	if (skb) {
 		__tcp_v4_send_check(skb, ireq->loc_addr, ireq->rmt_addr);
@@ -803,7 +804,7 @@ static int tcp_v4_rtx_synack(struct sock *sk, struct request_sock *req,
 			      struct request_values *rvp)
 {
 	TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_RETRANSSEGS);
-	return tcp_v4_send_synack(sk, NULL, req, rvp);
+	return tcp_v4_send_synack(sk, NULL, req, rvp, NULL);
 }
 
 /*
@@ -1232,10 +1233,158 @@ static const struct tcp_request_sock_ops tcp_request_sock_ipv4_ops = {
 };
 #endif
 
+/*
+ *	Decide whether the data of a SYN may be accepted right away (TCP Fast
+ *	Open). @valid_foc is set to the cookie to hand back in the SYN-ACK
+ *	when the client asked for one or presented a stale one.
+ */
+static int tcp_fastopen_check(struct sock *sk, struct sk_buff *skb,
+			      struct request_sock *req,
+			      struct tcp_fastopen_cookie *foc,
+			      struct tcp_fastopen_cookie *valid_foc)
+{
+	struct tcp_sock *tp = tcp_sk(sk);
+	int skip_cookie = 0;
+
+	if (likely(foc->len < 0)) {
+		if ((sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_REQD) &&
+		    TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1)
+			skip_cookie = 1;	/* no cookie to validate */
+		else
+			return 0;
+	}
+	/* A Fast Open option is present; bump the counter. */
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+
+	/* Make sure the listener has enabled Fast Open, and that we do not
+	 * exceed the number of pending Fast Open children allowed, before
+	 * spending cycles on the cookie.
+	 */
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    tp->fastopen_max_qlen == 0)
+		return 0;
+
+	if (tp->fastopen_qlen >= tp->fastopen_max_qlen) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		/* Avoid bumping LINUX_MIB_TCPFASTOPENPASSIVEFAIL */
+		foc->len = -1;
+		return 0;
+	}
+
+	if (skip_cookie) {
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		return 1;
+	}
+
+	if (foc->len == TCP_FASTOPEN_COOKIE_SIZE) {
+		if (!(sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_CHKED)) {
+			tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, valid_foc);
+			if (memcmp(foc->val, valid_foc->val,
+				   TCP_FASTOPEN_COOKIE_SIZE) != 0)
+				return 0;
+			valid_foc->len = -1;
+		}
+		/* Acknowledge the data received from the peer. */
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		return 1;
+	} else if (foc->len == 0) {	/* client requesting a cookie */
+		tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, valid_foc);
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+	} else {
+		/* Client sent a cookie with wrong size. Treat it
+		 * the same as invalid and return a valid one.
+		 */
+		tcp_fastopen_cookie_gen(ip_hdr(skb)->saddr, valid_foc);
+	}
+	return 0;
+}
+
+/*
+ *	Create the child of a Fast Open SYN right away, so that the data of
+ *	the SYN reaches the application before the handshake completes.
+ *	The request sock goes straight into the accept queue; the child
+ *	retransmits the SYN-ACK from its own retransmit timer until acked.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct sk_buff *skb_synack,
+				    struct request_sock *req)
+{
+	struct request_sock_queue *queue = &inet_csk(sk)->icsk_accept_queue;
+	const struct inet_request_sock *ireq = inet_rsk(req);
+	struct tcp_sock *tp;
+	struct sock *child;
+
+	req->retrans = 0;
+	req->sk = NULL;
+
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, NULL);
+	if (child == NULL) {
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		kfree_skb(skb_synack);
+		return -1;
+	}
+	/* The child retransmits the SYN-ACK should this one get lost. */
+	ip_build_and_send_pkt(skb_synack, sk, ireq->loc_addr, ireq->rmt_addr,
+			      ireq->opt);
+
+	/* Hold the listener so that an accepted child outliving it can
+	 * still take syn_wait_lock in tcp_fastopen_remove().
+	 */
+	sock_hold(sk);
+	tcp_rsk(req)->listener = sk;
+	write_lock(&queue->syn_wait_lock);
+	tcp_sk(sk)->fastopen_qlen++;
+	write_unlock(&queue->syn_wait_lock);
+
+	tp = tcp_sk(child);
+	tp->fastopen_rsk = req;
+
+	/* RFC1323: The window in SYN & SYN/ACK segments is never
+	 * scaled. So correct it appropriately.
+	 */
+	tp->snd_wnd = ntohs(tcp_hdr(skb)->window);
+
+	/* The request sock is not in the SYN table of the listener, so the
+	 * child's retransmit timer takes care of the SYN-ACK.
+	 */
+	inet_csk_reset_xmit_timer(child, ICSK_TIME_RETRANS,
+				  TCP_TIMEOUT_INIT, TCP_RTO_MAX);
+
+	inet_csk_reqsk_queue_add(sk, req, child);
+
+	/* Now finish what the final ACK of the handshake would do. */
+	inet_csk(child)->icsk_af_ops->rebuild_header(child);
+	tcp_init_congestion_control(child);
+	tcp_mtup_init(child);
+	tcp_init_buffer_space(child);
+	tcp_init_metrics(child);
+
+	/* Queue the data carried in the SYN. Take a reference, since the
+	 * caller frees the skb.
+	 */
+	if (TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1) {
+		skb = skb_get(skb);
+		skb_dst_drop(skb);
+		__skb_pull(skb, tcp_hdr(skb)->doff * 4);
+		skb_set_owner_r(skb, child);
+		__skb_queue_tail(&child->sk_receive_queue, skb);
+		tp->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		tp->syn_data_acked = 1;
+	}
+	sk->sk_data_ready(sk, 0);
+	bh_unlock_sock(child);
+	sock_put(child);
+	return 0;
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_extend_values tmp_ext;
 	struct tcp_options_received tmp_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
+	struct tcp_fastopen_cookie valid_foc = { .len = -1 };
+	struct sk_buff *skb_synack;
 	u8 *hash_location;
 	struct request_sock *req;
 	struct inet_request_sock *ireq;
@@ -1288,7 +1437,8 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_clear_options(&tmp_opt);
 	tmp_opt.mss_clamp = TCP_MSS_DEFAULT;
 	tmp_opt.user_mss  = tp->rx_opt.user_mss;
-	tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+	tcp_parse_options(skb, &tmp_opt, &hash_location, 0,
+			  want_cookie ? NULL : &foc);
 
 	if (tmp_opt.cookie_plus > 0 &&
 	    tmp_opt.saw_tstamp &&
@@ -1395,12 +1545,39 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	}
 	tcp_rsk(req)->snt_isn = isn;
 
-	if (tcp_v4_send_synack(sk, dst, req,
-			       (struct request_values *)&tmp_ext) ||
-	    want_cookie)
+	if (want_cookie || !tcp_fastopen_check(sk, skb, req, &foc, &valid_foc)) {
+		if (tcp_v4_send_synack(sk, dst, req,
+				       (struct request_values *)&tmp_ext,
+				       valid_foc.len > 0 ? &valid_foc : NULL) ||
+		    want_cookie)
+			goto drop_and_free;
+
+		inet_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+		if (foc.len > 0)
+			NET_INC_STATS_BH(sock_net(sk),
+					 LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		return 0;
+	}
+
+	/* The SYN-ACK is built before the child exists, since the child
+	 * inherits the receive window chosen for it.
+	 */
+	if (!dst) {
+		struct flowi4 fl4;
+
+		dst = inet_csk_route_req(sk, &fl4, req);
+		if (!dst)
+			goto drop_and_free;
+	}
+	skb_synack = tcp_make_synack(sk, dst, req,
+				     (struct request_values *)&tmp_ext, NULL);
+	dst_release(dst);
+	if (!skb_synack)
 		goto drop_and_free;
+	__tcp_v4_send_check(skb_synack, ireq->loc_addr, ireq->rmt_addr);
 
-	inet_csk_reqsk_queue_hash_add(sk, req, TCP_TIMEOUT_INIT);
+	if (tcp_v4_conn_req_fastopen(sk, skb, skb_synack, req))
+		goto drop_and_free;
 	return 0;
 
 drop_and_release:
@@ -1921,6 +2098,13 @@ void tcp_v4_destroy_sock(struct sock *sk)
 
 	tcp_clear_xmit_timers(sk);
 
+	/* A Fast Open child going away before its SYN-ACK was acked */
+	if (tp->fastopen_rsk)
+		tcp_fastopen_remove(sk);
+
+	/* If socket is aborted during connect operation */
+	tcp_free_fastopen_req(tp);
+
 	tcp_cleanup_congestion_control(sk);
 
 	/* Cleanup up the write buffer. */
@@ -2602,6 +2786,7 @@ struct proto tcp_prot = {
 	.sendmsg		= tcp_sendmsg,
 	.sendpage		= tcp_sendpage,
 	.backlog_rcv		= tcp_v4_do_rcv,
+	.release_cb		= tcp_release_cb,
 	.hash			= inet_hash,
 	.unhash			= inet_unhash,
 	.get_port		= inet_csk_get_port,
@@ -726,6 +726,29 @@ static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4)
 	uh->len = htons(len);
 	uh->check = 0;
 
+	if (skb_is_gso(skb) &&
+	    (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)) {	/* UDP_SEGMENT */
+		unsigned int gso_size = skb_shinfo(skb)->gso_size;
+		unsigned int datalen = len - sizeof(*uh);
+
+		if (offset + sizeof(*uh) + gso_size > dst_mtu(skb_dst(skb)) ||
+		    datalen > gso_size * UDP_MAX_SEGMENTS ||
+		    sk->sk_no_check == UDP_CSUM_NOXMIT) {
+			kfree_skb(skb);
+			return -EINVAL;
+		}
+		if (datalen > gso_size) {
+			skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(datalen,
+								 gso_size);
+		} else {
+			/* fits in one datagram, send it as is */
+			skb_shinfo(skb)->gso_size = 0;
+			skb_shinfo(skb)->gso_type = 0;
+		}
+		udp4_hwcsum(skb, fl4->saddr, fl4->daddr);
+		goto send;
+	}
+
 	if (is_udplite)  				 /*     UDP-Lite      */
 		csum = udplite_csum(skb);
 
@@ -819,6 +842,7 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	ipc.opt = NULL;
 	ipc.tx_flags = 0;
+	ipc.gso_size = up->gso_size;
 
 	getfrag = is_udplite ? udplite_getfrag : ip_generic_getfrag;
 
@@ -1768,6 +1792,16 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		}
 		break;
 
+	/* Let one send carry many datagrams of val bytes payload each,
+	 * split up by GSO on the way out. Only IPv4 UDP implements it. */
+	case UDP_SEGMENT:
+		if (is_udplite || sk->sk_family != PF_INET)
+			return -ENOPROTOOPT;
+		if (val < 0 || val > USHRT_MAX)
+			return -EINVAL;
+		up->gso_size = val;
+		break;
+
 	/*
 	 * 	UDP-Lite's partial checksum coverage (RFC 3828).
 	 */
@@ -1850,6 +1884,10 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = up->encap_type;
 		break;
 
+	case UDP_SEGMENT:
+		val = up->gso_size;
+		break;
+
 	/* The following two cannot be changed on UDP sockets, the return is
 	 * always 0 (which corresponds to the full checksum coverage of UDP). */
 	case UDPLITE_SEND_CSCOV:
@@ -2232,6 +2270,60 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+/* UDP_SEGMENT: split one large payload into gso_size byte datagrams,
+ * each with its own UDP header and checksum. IP headers of the segments
+ * are updated in inet_gso_segment()
+ */
+static struct sk_buff *udp4_gso_segment(struct sk_buff *gso_skb, u32 features)
+{
+	struct sk_buff *segs, *seg;
+	const struct iphdr *iph;
+	struct udphdr *uh;
+	unsigned int mss, len;
+
+	mss = skb_shinfo(gso_skb)->gso_size;
+	if (unlikely(gso_skb->len <= sizeof(*uh) + mss))
+		return ERR_PTR(-EINVAL);
+
+	if (skb_gso_ok(gso_skb, features | NETIF_F_GSO_ROBUST)) {
+		/* Packet is from an untrusted source, reset gso_segs. */
+		skb_shinfo(gso_skb)->gso_segs =
+			DIV_ROUND_UP(gso_skb->len - sizeof(*uh), mss);
+		return NULL;
+	}
+
+	if (unlikely(!pskb_may_pull(gso_skb, sizeof(*uh))))
+		return ERR_PTR(-EINVAL);
+
+	iph = ip_hdr(gso_skb);
+	__skb_pull(gso_skb, sizeof(*uh));
+
+	segs = skb_segment(gso_skb, features);
+	if (IS_ERR(segs))
+		return segs;
+
+	for (seg = segs; seg; seg = seg->next) {
+		uh = udp_hdr(seg);
+		len = seg->len - skb_transport_offset(seg);
+		uh->len = htons(len);
+
+		if (seg->ip_summed == CHECKSUM_PARTIAL) {
+			uh->check = ~csum_tcpudp_magic(iph->saddr, iph->daddr,
+						       len, IPPROTO_UDP, 0);
+		} else {
+			/* skb_segment() left the payload sum in seg->csum */
+			uh->check = 0;
+			uh->check = csum_tcpudp_magic(iph->saddr, iph->daddr,
+						      len, IPPROTO_UDP,
+						      csum_partial(uh, sizeof(*uh),
+								   seg->csum));
+			if (uh->check == 0)
+				uh->check = CSUM_MANGLED_0;
+		}
+	}
+	return segs;
+}
+
 struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 {
 	struct sk_buff *segs = ERR_PTR(-EINVAL);
@@ -2239,6 +2331,9 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 	int offset;
 	__wsum csum;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp4_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
@@ -189,15 +189,23 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  * qtaguid_mt()
  *   account_for_uid()
  *     if_tag_stat_update()
- *       get_sock_stat()
- *         sock_tag_list_lock
- *       struct iface_stat->tag_stat_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *       rcu_read_lock()
+ *         get_sock_tag()
+ *           (sock_tag_tree, sock_tag_seq)
  *         tag_stat_update()
  *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *             (tag_counter_set_tree, tag_counter_set_seq)
+ *         only when a new tag_stat is needed:
+ *         struct iface_stat->tag_stat_list_lock
+ *           tag_stat_update()
+ *   iface_stat_update_from_skb()
+ *     rcu_read_lock()
+ *
+ * The packet path takes no spinlocks. The trees it searches are only
+ * modified with their lock held and inside a write_seqcount section, and
+ * their entries are freed after an RCU grace period, so a lookup that
+ * races with a writer just retries. Counters are per-cpu and only summed
+ * when read.
  *
  *
  * qtaguid_ctrl_parse()
@@ -227,9 +235,11 @@ static DEFINE_SPINLOCK(iface_stat_list_lock);
 
 static struct rb_root sock_tag_tree = RB_ROOT;
 static DEFINE_SPINLOCK(sock_tag_list_lock);
+static seqcount_t sock_tag_seq = SEQCNT_ZERO;
 
 static struct rb_root tag_counter_set_tree = RB_ROOT;
 static DEFINE_SPINLOCK(tag_counter_set_list_lock);
+static seqcount_t tag_counter_set_seq = SEQCNT_ZERO;
 
 static struct rb_root uid_tag_data_tree = RB_ROOT;
 static DEFINE_SPINLOCK(uid_tag_data_tree_lock);
@@ -379,6 +389,47 @@ static struct sock_tag *sock_tag_tree_search(struct rb_root *root,
 	return NULL;
 }
 
+/*
+ * Bound on the nodes visited by a lockless search. A valid rb tree never
+ * gets this deep; a reader that does is looking at a half-done rotation
+ * and will retry once the seqcount tells it so.
+ */
+#define QTU_RB_MAX_DEPTH 64
+
+/*
+ * Search a tag_node tree without its lock.
+ * Caller must be in an RCU read-side section.
+ */
+static struct tag_node *tag_node_tree_search_rcu(struct rb_root *root,
+						 tag_t tag, seqcount_t *seq)
+{
+	struct rb_node *node;
+	struct tag_node *data;
+	unsigned int start;
+	int depth;
+
+	do {
+		start = read_seqcount_begin(seq);
+		data = NULL;
+		node = rcu_dereference_raw(root->rb_node);
+		for (depth = 0; node && depth < QTU_RB_MAX_DEPTH; depth++) {
+			struct tag_node *this = rb_entry(node, struct tag_node,
+							 node);
+			int result = tag_compare(tag, this->tag);
+
+			if (result < 0)
+				node = rcu_dereference_raw(node->rb_left);
+			else if (result > 0)
+				node = rcu_dereference_raw(node->rb_right);
+			else {
+				data = this;
+				break;
+			}
+		}
+	} while (read_seqcount_retry(seq, start));
+	return data;
+}
+
 static void sock_tag_tree_insert(struct sock_tag *data, struct rb_root *root)
 {
 	struct rb_node **new = &(root->rb_node), *parent = NULL;
@@ -417,7 +468,7 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		kfree_rcu(st_entry, rcu);
 	}
 }
 
@@ -732,23 +783,28 @@ static int get_active_counter_set(tag_t tag)
 {
 	int active_set = 0;
 	struct tag_counter_set *tcs;
+	struct tag_node *tn;
 
 	MT_DEBUG("qtaguid: get_active_counter_set(tag=0x%llx)"
 		 " (uid=%u)\n",
 		 tag, get_uid_from_tag(tag));
 	/* For now we only handle UID tags for active sets */
 	tag = get_utag_from_tag(tag);
-	spin_lock_bh(&tag_counter_set_list_lock);
-	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
-	if (tcs)
-		active_set = tcs->active_set;
-	spin_unlock_bh(&tag_counter_set_list_lock);
+	rcu_read_lock();
+	tn = tag_node_tree_search_rcu(&tag_counter_set_tree, tag,
+				      &tag_counter_set_seq);
+	if (tn) {
+		tcs = rb_entry(&tn->node, struct tag_counter_set, tn.node);
+		active_set = ACCESS_ONCE(tcs->active_set);
+	}
+	rcu_read_unlock();
 	return active_set;
 }
 
 /*
  * Find the entry for tracking the specified interface.
- * Caller must hold iface_stat_list_lock
+ * Caller must hold iface_stat_list_lock or be in an RCU read-side section.
+ * iface_stat entries are never freed once on the list.
  */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
@@ -761,7 +817,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	/* Iterate over interfaces */
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -788,9 +844,10 @@ static int pp_iface_stat_line(bool header, char *outp,
 			       "tx_other_bytes tx_other_packets\n"
 			);
 	} else {
-		struct data_counters *cnts;
+		struct data_counters totals;
+		struct data_counters *cnts = &totals;
 		int cnt_set = 0;   /* We only use one set for the device */
-		cnts = &iface_entry->totals_via_skb;
+		dc_pcpu_sum(cnts, iface_entry->totals_via_skb);
 		len = snprintf(
 			outp, char_count,
 			"%s "
@@ -991,7 +1048,16 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		kfree(new_iface);
 		return NULL;
 	}
+	new_iface->totals_via_skb = dc_pcpu_alloc(GFP_ATOMIC);
+	if (new_iface->totals_via_skb == NULL) {
+		pr_err("qtaguid: iface_stat: create(%s): "
+		       "counters alloc failed\n", net_dev->name);
+		kfree(new_iface->ifname);
+		kfree(new_iface);
+		return NULL;
+	}
 	spin_lock_init(&new_iface->tag_stat_list_lock);
+	seqcount_init(&new_iface->tag_stat_seq);
 	new_iface->tag_stat_tree = RB_ROOT;
 	_iface_stat_set_active(new_iface, net_dev, true);
 
@@ -1004,6 +1070,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 		pr_err("qtaguid: iface_stat: create(%s): "
 		       "work alloc failed\n", new_iface->ifname);
 		_iface_stat_set_active(new_iface, net_dev, false);
+		kfree(new_iface->totals_via_skb);
 		kfree(new_iface->ifname);
 		kfree(new_iface);
 		return NULL;
@@ -1011,7 +1078,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1203,16 +1270,40 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
-static struct sock_tag *get_sock_stat(const struct sock *sk)
+/*
+ * Lockless lookup of the tag on a socket for the packet path.
+ * Caller must be in an RCU read-side section.
+ * Returns false if the socket is not tagged.
+ */
+static bool get_sock_tag(const struct sock *sk, tag_t *tag)
 {
-	struct sock_tag *sock_tag_entry;
-	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
+	struct rb_node *node;
+	unsigned int start;
+	bool found;
+	int depth;
+
+	MT_DEBUG("qtaguid: get_sock_tag(sk=%p)\n", sk);
 	if (!sk)
-		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+		return false;
+	do {
+		start = read_seqcount_begin(&sock_tag_seq);
+		found = false;
+		node = rcu_dereference_raw(sock_tag_tree.rb_node);
+		for (depth = 0; node && depth < QTU_RB_MAX_DEPTH; depth++) {
+			struct sock_tag *data = rb_entry(node, struct sock_tag,
+							 sock_node);
+			if (sk < data->sk)
+				node = rcu_dereference_raw(node->rb_left);
+			else if (sk > data->sk)
+				node = rcu_dereference_raw(node->rb_right);
+			else {
+				*tag = data->tag;
+				found = true;
+				break;
+			}
+		}
+	} while (read_seqcount_retry(&sock_tag_seq, start));
+	return found;
 }
 
 static int ipx_proto(const struct sk_buff *skb,
@@ -1255,6 +1346,20 @@ data_counters_update(struct data_counters *dc, int set,
 	}
 }
 
+/* Update this cpu's copy of the counters. Callable from any context. */
+static void dc_pcpu_update(struct data_counters_pcpu *pcpu, int set,
+			   enum ifs_tx_rx direction, int proto, int bytes)
+{
+	struct data_counters_pcpu *c;
+
+	local_bh_disable();
+	c = &pcpu[smp_processor_id()];
+	u64_stats_update_begin(&c->syncp);
+	data_counters_update(&c->dc, set, direction, proto, bytes);
+	u64_stats_update_end(&c->syncp);
+	local_bh_enable();
+}
+
 /*
  * Update stats for the specified interface. Do nothing if the entry
  * does not exist (when a device was never configured with an IP address).
@@ -1354,21 +1459,20 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 			 par->family, proto);
 	}
 
-	spin_lock_bh(&iface_stat_list_lock);
+	rcu_read_lock();
 	entry = get_iface_entry(el_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid: iface_stat: %s(%s): not tracked\n",
 			 __func__, el_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
 	IF_DEBUG("qtaguid: %s(%s): entry=%p\n", __func__,
 		 el_dev->name, entry);
 
-	data_counters_update(&entry->totals_via_skb, 0, direction, proto,
-			     bytes);
-	spin_unlock_bh(&iface_stat_list_lock);
+	dc_pcpu_update(entry->totals_via_skb, 0, direction, proto, bytes);
+	rcu_read_unlock();
 }
 
 static void tag_stat_update(struct tag_stat *tag_entry,
@@ -1380,20 +1484,23 @@ static void tag_stat_update(struct tag_stat *tag_entry,
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
-			     proto, bytes);
+	dc_pcpu_update(tag_entry->counters, active_set, direction,
+		       proto, bytes);
 	if (tag_entry->parent_counters)
-		data_counters_update(tag_entry->parent_counters, active_set,
-				     direction, proto, bytes);
+		dc_pcpu_update(tag_entry->parent_counters, active_set,
+			       direction, proto, bytes);
 }
 
 /*
  * Create a new entry for tracking the specified {acct_tag,uid_tag} within
- * the interface.
+ * the interface. @parent_counters, if any, are the {0, uid_tag} counters
+ * also charged for it; they are set before the entry becomes visible to
+ * the packet path.
  * iface_entry->tag_stat_list_lock should be held.
  */
-static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
-					   tag_t tag)
+static struct tag_stat *
+create_if_tag_stat(struct iface_stat *iface_entry, tag_t tag,
+		   struct data_counters_pcpu *parent_counters)
 {
 	struct tag_stat *new_tag_stat_entry = NULL;
 	IF_DEBUG("qtaguid: iface_stat: %s(): ife=%p tag=0x%llx"
@@ -1404,12 +1511,43 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		pr_err("qtaguid: iface_stat: tag stat alloc failed\n");
 		goto done;
 	}
+	new_tag_stat_entry->counters = dc_pcpu_alloc(GFP_ATOMIC);
+	if (!new_tag_stat_entry->counters) {
+		pr_err("qtaguid: iface_stat: tag stat counters alloc failed\n");
+		kfree(new_tag_stat_entry);
+		new_tag_stat_entry = NULL;
+		goto done;
+	}
 	new_tag_stat_entry->tn.tag = tag;
+	new_tag_stat_entry->parent_counters = parent_counters;
+	write_seqcount_begin(&iface_entry->tag_stat_seq);
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
+	write_seqcount_end(&iface_entry->tag_stat_seq);
 done:
 	return new_tag_stat_entry;
 }
 
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts_entry = container_of(head, struct tag_stat, rcu);
+
+	kfree(ts_entry->counters);
+	kfree(ts_entry);
+}
+
+/* Search an iface's tag_stat tree from the packet path. */
+static struct tag_stat *tag_stat_tree_search_rcu(struct iface_stat *iface_entry,
+						 tag_t tag)
+{
+	struct tag_node *node;
+
+	node = tag_node_tree_search_rcu(&iface_entry->tag_stat_tree, tag,
+					&iface_entry->tag_stat_seq);
+	if (!node)
+		return NULL;
+	return rb_entry(&node->node, struct tag_stat, tn.node);
+}
+
 static void if_tag_stat_update(const char *ifname, uid_t uid,
 			       const struct sock *sk, enum ifs_tx_rx direction,
 			       int proto, int bytes)
@@ -1417,20 +1555,19 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
-	struct sock_tag *sock_tag_entry;
+	struct data_counters_pcpu *uid_tag_counters;
 	struct iface_stat *iface_entry;
 	struct tag_stat *new_tag_stat = NULL;
 	MT_DEBUG("qtaguid: if_tag_stat_update(ifname=%s "
 		"uid=%u sk=%p dir=%d proto=%d bytes=%d)\n",
 		 ifname, uid, sk, direction, proto, bytes);
 
-
+	rcu_read_lock();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
 		pr_err("qtaguid: iface_stat: stat_update() %s not found\n",
 		       ifname);
-		return;
+		goto out;
 	}
 	/* It is ok to process data when an iface_entry is inactive */
 
@@ -1441,9 +1578,7 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	 * Look for a tagged sock.
 	 * It will have an acct_uid.
 	 */
-	sock_tag_entry = get_sock_stat(sk);
-	if (sock_tag_entry) {
-		tag = sock_tag_entry->tag;
+	if (get_sock_tag(sk, &tag)) {
 		acct_tag = get_atag_from_tag(tag);
 		uid_tag = get_utag_from_tag(tag);
 	} else {
@@ -1454,19 +1589,25 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 	MT_DEBUG("qtaguid: iface_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
-	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
-	spin_lock_bh(&iface_entry->tag_stat_list_lock);
-
-	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
-					      tag);
+	/* Look for {acct_tag,uid_tag} under this interface */
+	tag_stat_entry = tag_stat_tree_search_rcu(iface_entry, tag);
 	if (tag_stat_entry) {
 		/*
 		 * Updating the {acct_tag, uid_tag} entry handles both stats:
 		 * {0, uid_tag} will also get updated.
 		 */
 		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
-		return;
+		goto out;
+	}
+
+	/* Not there: take the lock, recheck and create the entries. */
+	spin_lock_bh(&iface_entry->tag_stat_list_lock);
+
+	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
+					      tag);
+	if (tag_stat_entry) {
+		tag_stat_update(tag_stat_entry, direction, proto, bytes);
+		goto out_unlock;
 	}
 
 	/* Loop over tag list under this interface for {0,uid_tag} */
@@ -1478,16 +1619,20 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		 * No parent counters. So
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
-		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
-		uid_tag_counters = &new_tag_stat->counters;
+		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag, NULL);
+		if (!new_tag_stat)
+			goto out_unlock;
+		uid_tag_counters = new_tag_stat->counters;
 	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_counters = tag_stat_entry->counters;
 	}
 
 	if (acct_tag) {
 		/* Create the child {acct_tag, uid_tag} and hook up parent. */
-		new_tag_stat = create_if_tag_stat(iface_entry, tag);
-		new_tag_stat->parent_counters = uid_tag_counters;
+		new_tag_stat = create_if_tag_stat(iface_entry, tag,
+						  uid_tag_counters);
+		if (!new_tag_stat)
+			goto out_unlock;
 	} else {
 		/*
 		 * For new_tag_stat to be still NULL here would require:
@@ -1500,7 +1645,10 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		BUG_ON(!new_tag_stat);
 	}
 	tag_stat_update(new_tag_stat, direction, proto, bytes);
+out_unlock:
 	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+out:
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -2112,9 +2260,11 @@ static int ctrl_cmd_delete(const char *input)
 			 input, st_entry->tag, entry_uid);
 
 		if (!acct_tag || st_entry->tag == tag) {
+			write_seqcount_begin(&sock_tag_seq);
 			rb_erase(&st_entry->sock_node, &sock_tag_tree);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
+			write_seqcount_end(&sock_tag_seq);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
 			BUG_ON(tr_entry->num_sock_tags <= 0);
 			tr_entry->num_sock_tags--;
@@ -2144,8 +2294,10 @@ static int ctrl_cmd_delete(const char *input)
 			 tcs_entry->tn.tag,
 			 get_uid_from_tag(tcs_entry->tn.tag),
 			 tcs_entry->active_set);
+		write_seqcount_begin(&tag_counter_set_seq);
 		rb_erase(&tcs_entry->tn.node, &tag_counter_set_tree);
-		kfree(tcs_entry);
+		write_seqcount_end(&tag_counter_set_seq);
+		kfree_rcu(tcs_entry, rcu);
 	}
 	spin_unlock_bh(&tag_counter_set_list_lock);
 
@@ -2174,9 +2326,11 @@ static int ctrl_cmd_delete(const char *input)
 					 input, iface_entry->ifname,
 					 get_atag_from_tag(ts_entry->tn.tag),
 					 entry_uid);
+				write_seqcount_begin(&iface_entry->tag_stat_seq);
 				rb_erase(&ts_entry->tn.node,
 					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				write_seqcount_end(&iface_entry->tag_stat_seq);
+				call_rcu(&ts_entry->rcu, tag_stat_free_rcu);
 			}
 		}
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
@@ -2258,7 +2412,9 @@ static int ctrl_cmd_counter_set(const char *input)
 			goto err;
 		}
 		tcs->tn.tag = tag;
+		write_seqcount_begin(&tag_counter_set_seq);
 		tag_counter_set_tree_insert(tcs, &tag_counter_set_tree);
+		write_seqcount_end(&tag_counter_set_seq);
 		CT_DEBUG("qtaguid: ctrl_counterset(%s): added tcs tag=0x%llx "
 			 "(uid=%u) set=%d\n",
 			 input, tag, get_uid_from_tag(tag), counter_set);
@@ -2359,7 +2515,9 @@ static int ctrl_cmd_tag(const char *input)
 		BUG_ON(IS_ERR_OR_NULL(prev_tag_ref_entry));
 		BUG_ON(prev_tag_ref_entry->num_sock_tags <= 0);
 		prev_tag_ref_entry->num_sock_tags--;
+		write_seqcount_begin(&sock_tag_seq);
 		sock_tag_entry->tag = full_tag;
+		write_seqcount_end(&sock_tag_seq);
 	} else {
 		CT_DEBUG("qtaguid: ctrl_tag(%s): newtag for sk=%p\n",
 			 input, el_socket->sk);
@@ -2398,7 +2556,9 @@ static int ctrl_cmd_tag(const char *input)
 				 &pqd_entry->sock_tag_list);
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
+		write_seqcount_begin(&sock_tag_seq);
 		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		write_seqcount_end(&sock_tag_seq);
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2464,7 +2624,9 @@ static int ctrl_cmd_untag(const char *input)
 	 * The socket already belongs to the current process
 	 * so it can do whatever it wants to it.
 	 */
+	write_seqcount_begin(&sock_tag_seq);
 	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	write_seqcount_end(&sock_tag_seq);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2501,7 +2663,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	kfree_rcu(sock_tag_entry, rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2588,7 +2750,8 @@ struct proc_print_info {
 static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 {
 	int len;
-	struct data_counters *cnts;
+	struct data_counters counters;
+	struct data_counters *cnts = &counters;
 
 	if (!ppi->item_index) {
 		if (ppi->item_index++ < ppi->items_to_skip)
@@ -2619,7 +2782,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		dc_pcpu_sum(cnts, ppi->ts_entry->counters);
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2866,10 +3029,12 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		tr->num_sock_tags--;
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
+		write_seqcount_begin(&sock_tag_seq);
 		rb_erase(&st_entry->sock_node, &sock_tag_tree);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
+		write_seqcount_end(&sock_tag_seq);
 
 		/*
 		 * Try to free the utd_entry if no other proc_qtu_data is
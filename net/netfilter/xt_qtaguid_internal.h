@@ -11,8 +11,13 @@
 #define __XT_QTAGUID_INTERNAL_H__
 
 #include <linux/types.h>
+#include <linux/cpumask.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
 #include <linux/spinlock_types.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -197,6 +202,48 @@ static inline uint64_t dc_sum_packets(struct data_counters *counters,
 		+ counters->bpc[set][direction][IFS_PROTO_OTHER].packets;
 }
 
+/*
+ * Per-cpu copies of data_counters, updated without locks from the packet
+ * path and only summed when the stats are read. Arrays of these are sized
+ * for nr_cpu_ids at allocation time: entries get created from atomic
+ * context, where alloc_percpu() can't be used.
+ */
+struct data_counters_pcpu {
+	struct data_counters dc;
+	struct u64_stats_sync syncp;
+} ____cacheline_aligned_in_smp;
+
+static inline struct data_counters_pcpu *dc_pcpu_alloc(gfp_t flags)
+{
+	return kzalloc(nr_cpu_ids * sizeof(struct data_counters_pcpu), flags);
+}
+
+/* Fold the per-cpu copies into @sum. */
+static inline void dc_pcpu_sum(struct data_counters *sum,
+			       struct data_counters_pcpu *pcpu)
+{
+	struct data_counters snap;
+	unsigned int start;
+	int cpu, set, dir, proto;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		do {
+			start = u64_stats_fetch_begin(&pcpu[cpu].syncp);
+			snap = pcpu[cpu].dc;
+		} while (u64_stats_fetch_retry(&pcpu[cpu].syncp, start));
+
+		for (set = 0; set < IFS_MAX_COUNTER_SETS; set++)
+			for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++)
+				for (proto = 0; proto < IFS_MAX_PROTOS;
+				     proto++) {
+					sum->bpc[set][dir][proto].bytes +=
+						snap.bpc[set][dir][proto].bytes;
+					sum->bpc[set][dir][proto].packets +=
+						snap.bpc[set][dir][proto].packets;
+				}
+	}
+}
 
 /* Generic X based nodes used as a base for rb_tree ops */
 struct tag_node {
@@ -206,12 +253,13 @@ struct tag_node {
 
 struct tag_stat {
 	struct tag_node tn;
-	struct data_counters counters;
+	struct data_counters_pcpu *counters;
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct data_counters_pcpu *parent_counters;
+	struct rcu_head rcu;
 };
 
 struct iface_stat {
@@ -222,7 +270,7 @@ struct iface_stat {
 	struct net_device *net_dev;
 
 	struct byte_packet_counters totals_via_dev[IFS_MAX_DIRECTIONS];
-	struct data_counters totals_via_skb;
+	struct data_counters_pcpu *totals_via_skb;
 	/*
 	 * We keep the last_known, because some devices reset their counters
 	 * just before NETDEV_UP, while some will reset just before
@@ -239,6 +287,11 @@ struct iface_stat {
 
 	struct rb_root tag_stat_tree;
 	spinlock_t tag_stat_list_lock;
+	/*
+	 * Bumped by tag_stat_tree writers (which hold tag_stat_list_lock)
+	 * so that the packet path can search the tree under RCU alone.
+	 */
+	seqcount_t tag_stat_seq;
 };
 
 /* This is needed to create proc_dir_entries from atomic context. */
@@ -263,6 +316,7 @@ struct sock_tag {
 	pid_t pid;
 
 	tag_t tag;
+	struct rcu_head rcu;
 };
 
 struct qtaguid_event_counts {
@@ -301,6 +355,7 @@ struct qtaguid_event_counts {
 struct tag_counter_set {
 	struct tag_node tn;
 	int active_set;
+	struct rcu_head rcu;
 };
 
 /*----------------------------------------------*/
@@ -155,6 +155,8 @@ char *pp_tag_stat(struct tag_stat *ts)
 	char *counters_str;
 	char *parent_counters_str;
 	char *res;
+	struct data_counters counters;
+	struct data_counters parent_counters;
 
 	if (!ts) {
 		res = kasprintf(GFP_ATOMIC, "tag_stat@null{}");
@@ -162,8 +164,14 @@ char *pp_tag_stat(struct tag_stat *ts)
 		return res;
 	}
 	tn_str = pp_tag_node(&ts->tn);
-	counters_str = pp_data_counters(&ts->counters, true);
-	parent_counters_str = pp_data_counters(ts->parent_counters, false);
+	dc_pcpu_sum(&counters, ts->counters);
+	counters_str = pp_data_counters(&counters, true);
+	if (ts->parent_counters) {
+		dc_pcpu_sum(&parent_counters, ts->parent_counters);
+		parent_counters_str = pp_data_counters(&parent_counters, false);
+	} else {
+		parent_counters_str = pp_data_counters(NULL, false);
+	}
 	res = kasprintf(GFP_ATOMIC,
 			"tag_stat@%p{%s, counters=%s, parent_counters=%s}",
 			ts, tn_str, counters_str, parent_counters_str);
@@ -180,7 +188,9 @@ char *pp_iface_stat(struct iface_stat *is)
 	if (!is) {
 		res = kasprintf(GFP_ATOMIC, "iface_stat@null{}");
 	} else {
-		struct data_counters *cnts = &is->totals_via_skb;
+		struct data_counters totals;
+		struct data_counters *cnts = &totals;
+		dc_pcpu_sum(cnts, is->totals_via_skb);
 		res = kasprintf(GFP_ATOMIC, "iface_stat@%p{"
 				"list=list_head{...}, "
 				"ifname=%s, "
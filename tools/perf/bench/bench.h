@@ -3,7 +3,16 @@
 
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
+extern int bench_sched_periodic(int argc, const char **argv, const char *prefix __used);
+extern int bench_sched_frames(int argc, const char **argv, const char *prefix __used);
+extern int bench_sched_wakeup(int argc, const char **argv, const char *prefix __used);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_net_sendfile(int argc, const char **argv, const char *prefix __used);
+extern int bench_net_udp_gso(int argc, const char **argv, const char *prefix __used);
+extern int bench_net_connect(int argc, const char **argv, const char *prefix __used);
+extern int bench_net_pktring(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_write(int argc, const char **argv, const char *prefix __used);
+extern int bench_fs_create(int argc, const char **argv, const char *prefix __used);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,223 @@
+/*
+ * fs-create.c
+ *
+ * create: Small-file creation rate with one and with many threads
+ *
+ * Every thread creates files in a directory of its own, writes a few
+ * KB to each and closes it. This is done once with a single thread and
+ * once with the given number of threads, and the rate of both runs is
+ * reported, so that how far file creation scales with the number of
+ * cpus can be read off directly. On ext4, mount with -o nodelalloc or
+ * use --fsync so that blocks are allocated by the writing threads
+ * rather than later by writeback, see perf-bench(1).
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static const char	*dir_name;
+static int		nr_threads;
+static int		nr_files	= 10000;
+static int		file_size	= 4096;
+static bool		use_fsync;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &dir_name, "dir",
+		   "Create the files under this directory (required)"),
+	OPT_INTEGER('t', "threads", &nr_threads,
+		    "Specify number of threads (default number of online cpus)"),
+	OPT_INTEGER('n', "nr", &nr_files,
+		    "Specify number of files per thread (default 10000)"),
+	OPT_INTEGER('s', "size", &file_size,
+		    "Specify bytes written to each file (default 4096)"),
+	OPT_BOOLEAN('f', "fsync", &use_fsync,
+		    "fsync() every file before closing it"),
+	OPT_END()
+};
+
+static const char * const bench_fs_create_usage[] = {
+	"perf bench fs create -d <dir> <options>",
+	NULL
+};
+
+struct create_thread {
+	pthread_t		thread;
+	int			nr;
+	const char		*buf;
+	pthread_barrier_t	*barrier;
+};
+
+static u64 now_usecs(void)
+{
+	struct timeval tv;
+
+	BUG_ON(gettimeofday(&tv, NULL));
+	return (u64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static void thread_dir(char *path, size_t len, int nr)
+{
+	snprintf(path, len, "%s/perf-bench-fs-create.%d", dir_name, nr);
+}
+
+static void *create_files(void *arg)
+{
+	struct create_thread *t = arg;
+	char dir[PATH_MAX], path[PATH_MAX];
+	int i, fd;
+
+	thread_dir(dir, sizeof(dir), t->nr);
+	pthread_barrier_wait(t->barrier);
+
+	for (i = 0; i < nr_files; i++) {
+		snprintf(path, sizeof(path), "%s/%d", dir, i);
+		fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+		if (fd < 0)
+			die("cannot create %s: %s\n", path, strerror(errno));
+		if (write(fd, t->buf, file_size) != file_size)
+			die("write to %s failed: %s\n", path, strerror(errno));
+		if (use_fsync && fsync(fd))
+			die("fsync of %s failed: %s\n", path, strerror(errno));
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static void remove_files(int threads)
+{
+	char dir[PATH_MAX], path[PATH_MAX];
+	int t, i;
+
+	for (t = 0; t < threads; t++) {
+		thread_dir(dir, sizeof(dir), t);
+		for (i = 0; i < nr_files; i++) {
+			snprintf(path, sizeof(path), "%s/%d", dir, i);
+			unlink(path);
+		}
+		rmdir(dir);
+	}
+	sync();
+}
+
+/* Returns the usecs from the start of all threads to the last one done */
+static u64 run_creates(int threads, const char *buf)
+{
+	struct create_thread *t;
+	pthread_barrier_t barrier;
+	char dir[PATH_MAX];
+	u64 start;
+	int i;
+
+	t = calloc(threads, sizeof(*t));
+	if (!t)
+		die("memory allocation failed\n");
+
+	for (i = 0; i < threads; i++) {
+		thread_dir(dir, sizeof(dir), i);
+		if (mkdir(dir, 0755) && errno != EEXIST)
+			die("cannot create %s: %s\n", dir, strerror(errno));
+	}
+	sync();
+
+	/* The main thread releases the workers and starts the clock */
+	BUG_ON(pthread_barrier_init(&barrier, NULL, threads + 1));
+	for (i = 0; i < threads; i++) {
+		t[i].nr = i;
+		t[i].buf = buf;
+		t[i].barrier = &barrier;
+		if (pthread_create(&t[i].thread, NULL, create_files, &t[i]))
+			die("pthread_create failed\n");
+	}
+
+	pthread_barrier_wait(&barrier);
+	start = now_usecs();
+	for (i = 0; i < threads; i++)
+		pthread_join(t[i].thread, NULL);
+	start = now_usecs() - start;
+
+	pthread_barrier_destroy(&barrier);
+	free(t);
+	remove_files(threads);
+
+	return start;
+}
+
+static void print_result(const char *name, int threads, u64 usecs)
+{
+	double files = (double)threads * nr_files;
+	double rate = usecs ? files * 1000000 / usecs : 0;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %s:\n", name);
+		printf(" %14lf files/sec\n", rate);
+		printf(" %14lf usecs/file per thread\n",
+		       files ? (double)usecs * threads / files : 0);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %d %lf\n", name, threads, rate);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+}
+
+int bench_fs_create(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	char name[32];
+	char *buf;
+	u64 usecs;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_create_usage, 0);
+
+	if (!dir_name) {
+		fprintf(stderr, "Specify the directory to create in with -d\n");
+		return 1;
+	}
+	if (!nr_threads)
+		nr_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (nr_threads <= 0 || nr_files <= 0 || file_size < 0) {
+		fprintf(stderr, "Invalid number of threads, files or size\n");
+		return 1;
+	}
+
+	buf = malloc(file_size ?: 1);
+	if (!buf)
+		die("memory allocation failed\n");
+	memset(buf, 0x5a, file_size);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Creating %d files of %d Bytes per thread in %s%s ...\n\n",
+		       nr_files, file_size, dir_name,
+		       use_fsync ? ", fsync()ed" : "");
+
+	usecs = run_creates(1, buf);
+	print_result("1 thread", 1, usecs);
+
+	if (nr_threads > 1) {
+		usecs = run_creates(nr_threads, buf);
+		snprintf(name, sizeof(name), "%d threads", nr_threads);
+		print_result(name, nr_threads, usecs);
+	}
+
+	free(buf);
+
+	return 0;
+}
@@ -0,0 +1,255 @@
+/*
+ * fs-write.c
+ *
+ * write: Write latency of a flash filesystem with and without background gc
+ *
+ * A set of files in the given directory is overwritten pass after pass,
+ * so that the filesystem keeps turning blocks into garbage and has to
+ * collect it. Every write() is timed. This is done once with the 0/1 switch
+ * given with --switch set to 1 and once with it set to 0. The default is
+ * yaffs2's yaffs_bg_enable module parameter: with it at 0 the background gc
+ * thread holds off and writers do all the collection inline. Meant for a
+ * yaffs2 mount on an MTD simulated by nandsim, see perf-bench(1).
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#define K 1024
+
+static const char	*dir_name;
+static const char	*switch_file	= "/sys/module/yaffs/parameters/yaffs_bg_enable";
+static int		nr_files	= 16;
+static int		file_kb		= 256;
+static int		write_size	= 4096;
+static int		nr_passes	= 20;
+static int		pause_ms	= 1000;
+
+static const struct option options[] = {
+	OPT_STRING('d', "dir", &dir_name, "dir",
+		   "Write the files in this directory (required)"),
+	OPT_STRING('S', "switch", &switch_file, "file",
+		   "Run with 1 and with 0 written to this file "
+		   "(default yaffs_bg_enable)"),
+	OPT_INTEGER('n', "nr", &nr_files,
+		    "Specify number of files (default 16)"),
+	OPT_INTEGER('s', "size", &file_kb,
+		    "Specify size of each file in KB (default 256)"),
+	OPT_INTEGER('w', "write", &write_size,
+		    "Specify bytes per write() (default 4096)"),
+	OPT_INTEGER('p', "passes", &nr_passes,
+		    "Specify number of times all files are rewritten (default 20)"),
+	OPT_INTEGER('P', "pause", &pause_ms,
+		    "Specify idle msecs between passes (default 1000)"),
+	OPT_END()
+};
+
+static const char * const bench_fs_write_usage[] = {
+	"perf bench fs write -d <dir> <options>",
+	NULL
+};
+
+struct write_result {
+	double		mean_usecs;
+	u64		p99_usecs;
+	u64		max_usecs;
+	double		mb_per_sec;
+};
+
+static u64 now_usecs(void)
+{
+	struct timeval tv;
+
+	BUG_ON(gettimeofday(&tv, NULL));
+	return (u64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static int read_switch(char *val)
+{
+	FILE *fp = fopen(switch_file, "r");
+	int ret = 0;
+
+	if (!fp)
+		return -1;
+	if (!fgets(val, 16, fp))
+		ret = -1;
+	else
+		val[strcspn(val, "\n")] = '\0';
+	fclose(fp);
+	return ret;
+}
+
+static int write_switch(const char *val)
+{
+	FILE *fp = fopen(switch_file, "w");
+	int ret;
+
+	if (!fp)
+		return -1;
+	ret = fputs(val, fp) < 0 ? -1 : 0;
+	if (fclose(fp))
+		ret = -1;
+	return ret;
+}
+
+static void file_path(char *path, size_t len, int i)
+{
+	snprintf(path, len, "%s/perf-bench-fs-write.%d", dir_name, i);
+}
+
+static void remove_files(void)
+{
+	char path[PATH_MAX];
+	int i;
+
+	for (i = 0; i < nr_files; i++) {
+		file_path(path, sizeof(path), i);
+		unlink(path);
+	}
+	sync();
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void run_writes(char *buf, u64 *samples, int nr_samples,
+		       struct write_result *res)
+{
+	int writes_per_file = file_kb * K / write_size;
+	char path[PATH_MAX];
+	u64 t, sum = 0;
+	int pass, i, j, fd, n = 0;
+
+	remove_files();
+
+	for (pass = 0; pass < nr_passes; pass++) {
+		for (i = 0; i < nr_files; i++) {
+			file_path(path, sizeof(path), i);
+			fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fd < 0)
+				die("cannot open %s: %s\n", path,
+				    strerror(errno));
+
+			for (j = 0; j < writes_per_file; j++) {
+				t = now_usecs();
+				if (write(fd, buf, write_size) != write_size)
+					die("write to %s failed: %s\n", path,
+					    strerror(errno));
+				samples[n] = now_usecs() - t;
+				sum += samples[n++];
+			}
+			close(fd);
+		}
+		/* Leave the filesystem idle, the way bursty writers do */
+		if (pause_ms)
+			usleep(pause_ms * 1000);
+	}
+
+	remove_files();
+
+	BUG_ON(n != nr_samples);
+	qsort(samples, nr_samples, sizeof(*samples), cmp_u64);
+	res->mean_usecs = (double)sum / nr_samples;
+	res->p99_usecs = samples[(u64)nr_samples * 99 / 100];
+	res->max_usecs = samples[nr_samples - 1];
+	res->mb_per_sec = sum ? (double)nr_samples * write_size / sum : 0;
+}
+
+static void print_result(const char *name, struct write_result *res)
+{
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %s:\n", name);
+		printf(" %14lf usecs/write (mean)\n", res->mean_usecs);
+		printf(" %14" PRIu64 " usecs/write (99th percentile)\n",
+		       res->p99_usecs);
+		printf(" %14" PRIu64 " usecs/write (max)\n", res->max_usecs);
+		printf(" %14lf MB/sec while writing\n", res->mb_per_sec);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %lf %" PRIu64 " %" PRIu64 " %lf\n", name,
+		       res->mean_usecs, res->p99_usecs, res->max_usecs,
+		       res->mb_per_sec);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+}
+
+int bench_fs_write(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	struct write_result res;
+	char saved[16];
+	int nr_samples;
+	u64 *samples;
+	char *buf;
+
+	argc = parse_options(argc, argv, options,
+			     bench_fs_write_usage, 0);
+
+	if (!dir_name) {
+		fprintf(stderr, "Specify the directory to write in with -d\n");
+		return 1;
+	}
+	if (nr_files <= 0 || file_kb <= 0 || write_size <= 0 ||
+	    write_size > file_kb * K || nr_passes <= 0 || pause_ms < 0) {
+		fprintf(stderr, "Invalid number of files, sizes or passes\n");
+		return 1;
+	}
+
+	nr_samples = nr_passes * nr_files * (file_kb * K / write_size);
+	samples = malloc(nr_samples * sizeof(*samples));
+	buf = malloc(write_size);
+	if (!samples || !buf)
+		die("memory allocation failed\n");
+	memset(buf, 0x5a, write_size);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Rewriting %d files of %d KB in %s, %d passes, "
+		       "%d Bytes per write() ...\n\n",
+		       nr_files, file_kb, dir_name, nr_passes, write_size);
+
+	if (read_switch(saved) < 0) {
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf("# cannot read %s: %s\n\n", switch_file,
+			       strerror(errno));
+		run_writes(buf, samples, nr_samples, &res);
+		print_result("current", &res);
+		goto out;
+	}
+
+	if (write_switch("1") < 0)
+		die("cannot write %s: %s\n", switch_file, strerror(errno));
+	run_writes(buf, samples, nr_samples, &res);
+	print_result("background", &res);
+
+	if (write_switch("0") < 0)
+		die("cannot write %s: %s\n", switch_file, strerror(errno));
+	run_writes(buf, samples, nr_samples, &res);
+	print_result("inline", &res);
+
+	write_switch(saved);
+out:
+	free(buf);
+	free(samples);
+
+	return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * net-connect.c
+ *
+ * connect: TCP connection rate, the load that stresses connection tracking
+ *
+ * Each of a number of client processes opens and immediately resets
+ * (SO_LINGER 0) TCP connections to a server in a loop, for a fixed time.
+ * Every connection creates and confirms a new conntrack entry on a box
+ * with netfilter connection tracking loaded, so the aggregate rate shows
+ * how the conntrack table scales with the number of CPUs sending.
+ *
+ * Without --addr a local server on 127.0.0.1 is started. --listen runs
+ * only the server, for the far end of a veth pair in another namespace.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_CLIENTS	1024
+
+static const char	*addr_str;
+static int		port;
+static int		nr_clients	= 4;
+static int		nr_secs		= 5;
+static bool		listen_only;
+
+static const struct option options[] = {
+	OPT_STRING('a', "addr", &addr_str, "addr",
+		    "Connect to a server at this IPv4 address "
+		    "instead of starting one on 127.0.0.1"),
+	OPT_INTEGER('p', "port", &port,
+		    "Specify TCP port of the server"),
+	OPT_INTEGER('t', "threads", &nr_clients,
+		    "Specify number of client processes (default 4)"),
+	OPT_INTEGER('l', "length", &nr_secs,
+		    "Specify run time in seconds (default 5)"),
+	OPT_BOOLEAN('L', "listen", &listen_only,
+		    "Only run the server, on --port"),
+	OPT_END()
+};
+
+static const char * const bench_net_connect_usage[] = {
+	"perf bench net connect <options>",
+	NULL
+};
+
+static double timeval2double(struct timeval *ts)
+{
+	return (double)ts->tv_sec +
+		(double)ts->tv_usec / (double)1000000;
+}
+
+/* Accept and drop connections until killed */
+static void server(int lfd)
+{
+	int fd;
+
+	for (;;) {
+		fd = accept(lfd, NULL, NULL);
+		if (fd >= 0)
+			close(fd);
+		else if (errno != EINTR && errno != ECONNABORTED)
+			exit(1);
+	}
+}
+
+static int setup_listener(struct sockaddr_in *addr)
+{
+	socklen_t addrlen = sizeof(*addr);
+	int one = 1;
+	int lfd;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	BUG_ON(lfd < 0);
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(lfd, (struct sockaddr *)addr, sizeof(*addr)) < 0 ||
+	    listen(lfd, 1024) < 0 ||
+	    getsockname(lfd, (struct sockaddr *)addr, &addrlen) < 0)
+		die("cannot set up the listener: %s\n", strerror(errno));
+	return lfd;
+}
+
+/* Connect and reset in a loop until @end, report the count on @wfd */
+static void client(struct sockaddr_in *addr, struct timeval *end, int wfd)
+{
+	struct linger lin = { .l_onoff = 1, .l_linger = 0 };
+	struct timeval now;
+	u64 nr = 0;
+	int fd;
+
+	do {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0)
+			exit(1);
+		/* RST instead of FIN, no TIME_WAIT to run out of ports */
+		setsockopt(fd, SOL_SOCKET, SO_LINGER, &lin, sizeof(lin));
+		if (connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == 0)
+			nr++;
+		close(fd);
+		BUG_ON(gettimeofday(&now, NULL));
+	} while (timercmp(&now, end, <));
+
+	if (write(wfd, &nr, sizeof(nr)) != sizeof(nr))
+		exit(1);
+	exit(0);
+}
+
+int bench_net_connect(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct timeval tv_start, tv_end, tv_diff;
+	struct sockaddr_in addr;
+	pid_t server_pid = 0, pids[MAX_CLIENTS];
+	int i, lfd, pipefd[2], wait_stat;
+	u64 nr, total = 0;
+	double result;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_connect_usage, 0);
+
+	if (nr_clients <= 0 || nr_clients > MAX_CLIENTS || nr_secs <= 0) {
+		fprintf(stderr, "Invalid number of clients or run time\n");
+		return 1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+
+	if (listen_only) {
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		server(setup_listener(&addr));
+		return 0;
+	}
+
+	if (addr_str) {
+		if (!inet_aton(addr_str, &addr.sin_addr))
+			die("invalid address: %s\n", addr_str);
+		if (!port)
+			die("--addr needs --port\n");
+	} else {
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		lfd = setup_listener(&addr);
+		server_pid = fork();
+		BUG_ON(server_pid < 0);
+		if (!server_pid)
+			server(lfd);
+		close(lfd);
+	}
+
+	if (pipe(pipefd) < 0)
+		die("pipe failed: %s\n", strerror(errno));
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d clients connecting to %s:%d for %d seconds ...\n\n",
+		       nr_clients, inet_ntoa(addr.sin_addr),
+		       ntohs(addr.sin_port), nr_secs);
+
+	BUG_ON(gettimeofday(&tv_start, NULL));
+	tv_end = tv_start;
+	tv_end.tv_sec += nr_secs;
+
+	for (i = 0; i < nr_clients; i++) {
+		pids[i] = fork();
+		BUG_ON(pids[i] < 0);
+		if (!pids[i])
+			client(&addr, &tv_end, pipefd[1]);
+	}
+	close(pipefd[1]);
+
+	for (i = 0; i < nr_clients; i++) {
+		if (read(pipefd[0], &nr, sizeof(nr)) == sizeof(nr))
+			total += nr;
+		waitpid(pids[i], &wait_stat, 0);
+	}
+	BUG_ON(gettimeofday(&tv_end, NULL));
+	close(pipefd[0]);
+
+	if (server_pid) {
+		kill(server_pid, SIGTERM);
+		waitpid(server_pid, &wait_stat, 0);
+	}
+
+	timersub(&tv_end, &tv_start, &tv_diff);
+	result = (double)total / timeval2double(&tv_diff);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %14lf Connections/Sec\n", result);
+		printf(" %14" PRIu64 " Connections total\n", total);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", result);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+
+	return 0;
+}
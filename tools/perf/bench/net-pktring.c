@@ -0,0 +1,322 @@
+/*
+ * net-pktring.c
+ *
+ * pktring: Cost of capturing with a TPACKET_V2 vs a TPACKET_V3 ring
+ *
+ * A child process blasts UDP datagrams at 127.0.0.1 while the parent
+ * captures them on the loopback device through a PACKET_RX_RING of the
+ * same total size, once with fixed-size TPACKET_V2 frames and once with
+ * block-based TPACKET_V3. Reported are the packets seen and dropped by
+ * the ring, the poll() wakeups and the CPU time of the capturing process.
+ *
+ * Needs CAP_NET_RAW.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#define K		1024
+#define V2_FRAME_SIZE	2048
+/* Idle time after the sender is done that ends the capture */
+#define IDLE_MSECS	200
+
+static int		nr_packets	= 1000000;
+static int		size		= 64;
+static int		ring_mb		= 4;
+static int		block_kb	= 1024;
+static int		retire_ms	= 10;
+
+static const struct option options[] = {
+	OPT_INTEGER('n', "nr", &nr_packets,
+		    "Specify number of datagrams to send (default 1000000)"),
+	OPT_INTEGER('s', "size", &size,
+		    "Specify UDP payload size (default 64)"),
+	OPT_INTEGER('r', "ring", &ring_mb,
+		    "Specify ring size in MB (default 4)"),
+	OPT_INTEGER('b', "block", &block_kb,
+		    "Specify ring block size in KB (default 1024)"),
+	OPT_INTEGER('t', "timeout", &retire_ms,
+		    "Specify TPACKET_V3 block retire timeout in msecs (default 10)"),
+	OPT_END()
+};
+
+static const char * const bench_net_pktring_usage[] = {
+	"perf bench net pktring <options>",
+	NULL
+};
+
+struct ring_result {
+	u64		packets;
+	u64		drops;
+	u64		wakeups;
+	double		cpu_secs;
+};
+
+static double timeval2double(struct timeval *ts)
+{
+	return (double)ts->tv_sec +
+		(double)ts->tv_usec / (double)1000000;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	BUG_ON(getrusage(RUSAGE_SELF, &ru));
+	return timeval2double(&ru.ru_utime) + timeval2double(&ru.ru_stime);
+}
+
+/* Send @nr_packets datagrams to @addr as fast as possible, then exit */
+static void sender(struct sockaddr_in *addr)
+{
+	char *buf = zalloc(size);
+	int i, fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (!buf || fd < 0)
+		exit(1);
+	for (i = 0; i < nr_packets; i++)
+		sendto(fd, buf, size, 0, (struct sockaddr *)addr,
+		       sizeof(*addr));
+	exit(0);
+}
+
+/* An AF_PACKET socket on the loopback device with an RX ring mapped */
+static int open_ring(int version, void **map, size_t *map_len)
+{
+	struct sockaddr_ll ll;
+	int fd;
+
+	fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_IP));
+	if (fd < 0)
+		die("cannot open packet socket (needs CAP_NET_RAW): %s\n",
+		    strerror(errno));
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION,
+		       &version, sizeof(version)) < 0)
+		die("PACKET_VERSION %d not supported: %s\n",
+		    version + 1, strerror(errno));
+
+	if (version == TPACKET_V2) {
+		struct tpacket_req req;
+
+		memset(&req, 0, sizeof(req));
+		req.tp_block_size = block_kb * K;
+		req.tp_block_nr = ring_mb * K / block_kb;
+		req.tp_frame_size = V2_FRAME_SIZE;
+		req.tp_frame_nr = req.tp_block_size / V2_FRAME_SIZE *
+				  req.tp_block_nr;
+		if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING,
+			       &req, sizeof(req)) < 0)
+			die("PACKET_RX_RING failed: %s\n", strerror(errno));
+		*map_len = (size_t)req.tp_block_size * req.tp_block_nr;
+	} else {
+		struct tpacket_req3 req;
+
+		memset(&req, 0, sizeof(req));
+		req.tp_block_size = block_kb * K;
+		req.tp_block_nr = ring_mb * K / block_kb;
+		req.tp_frame_size = V2_FRAME_SIZE;
+		req.tp_frame_nr = req.tp_block_size / V2_FRAME_SIZE *
+				  req.tp_block_nr;
+		req.tp_retire_blk_tov = retire_ms;
+		if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING,
+			       &req, sizeof(req)) < 0)
+			die("PACKET_RX_RING failed: %s\n", strerror(errno));
+		*map_len = (size_t)req.tp_block_size * req.tp_block_nr;
+	}
+
+	*map = mmap(NULL, *map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (*map == MAP_FAILED)
+		die("cannot map the ring: %s\n", strerror(errno));
+
+	memset(&ll, 0, sizeof(ll));
+	ll.sll_family = AF_PACKET;
+	ll.sll_protocol = htons(ETH_P_IP);
+	ll.sll_ifindex = if_nametoindex("lo");
+	if (bind(fd, (struct sockaddr *)&ll, sizeof(ll)) < 0)
+		die("cannot bind to lo: %s\n", strerror(errno));
+
+	return fd;
+}
+
+/* Hand every frame user space owns back to the kernel, count them */
+static u64 drain_v2(void *map, unsigned int *idx, unsigned int nr_frames)
+{
+	struct tpacket2_hdr *hdr;
+	u64 nr = 0;
+
+	for (;;) {
+		hdr = map + (size_t)*idx * V2_FRAME_SIZE;
+		if (!(hdr->tp_status & TP_STATUS_USER))
+			break;
+		__sync_synchronize();
+		nr++;
+		hdr->tp_status = TP_STATUS_KERNEL;
+		*idx = (*idx + 1) % nr_frames;
+	}
+	return nr;
+}
+
+static u64 drain_v3(void *map, unsigned int *idx, unsigned int nr_blocks)
+{
+	struct tpacket_block_desc *bd;
+	struct tpacket3_hdr *hdr;
+	unsigned int i;
+	u64 nr = 0;
+
+	for (;;) {
+		bd = map + (size_t)*idx * block_kb * K;
+		if (!(bd->hdr.bh1.block_status & TP_STATUS_USER))
+			break;
+		__sync_synchronize();
+		/* Walk the packets like a real reader would */
+		hdr = (void *)bd + bd->hdr.bh1.offset_to_first_pkt;
+		for (i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+			nr++;
+			hdr = (void *)hdr + hdr->tp_next_offset;
+		}
+		bd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+		*idx = (*idx + 1) % nr_blocks;
+	}
+	return nr;
+}
+
+static void do_capture(int version, struct sockaddr_in *addr,
+		       struct ring_result *res)
+{
+	struct tpacket_stats_v3 st;
+	socklen_t st_len = sizeof(st);
+	struct pollfd pfd;
+	unsigned int idx = 0, nr;
+	double cpu_start;
+	size_t map_len;
+	int wait_stat;
+	bool done = false;
+	void *map;
+	pid_t pid;
+
+	memset(res, 0, sizeof(*res));
+	pfd.fd = open_ring(version, &map, &map_len);
+	pfd.events = POLLIN;
+	nr = version == TPACKET_V2 ?
+		map_len / V2_FRAME_SIZE : map_len / (block_kb * K);
+
+	cpu_start = cpu_time();
+
+	pid = fork();
+	BUG_ON(pid < 0);
+	if (!pid)
+		sender(addr);
+
+	for (;;) {
+		int ret = poll(&pfd, 1, IDLE_MSECS);
+
+		if (ret < 0 && errno != EINTR)
+			die("poll failed: %s\n", strerror(errno));
+		if (ret > 0)
+			res->wakeups++;
+		if (version == TPACKET_V2)
+			res->packets += drain_v2(map, &idx, nr);
+		else
+			res->packets += drain_v3(map, &idx, nr);
+		if (ret == 0 && done)
+			break;
+		if (!done && waitpid(pid, &wait_stat, WNOHANG) == pid)
+			done = true;
+	}
+
+	res->cpu_secs = cpu_time() - cpu_start;
+
+	memset(&st, 0, sizeof(st));
+	if (getsockopt(pfd.fd, SOL_PACKET, PACKET_STATISTICS, &st, &st_len) < 0)
+		die("PACKET_STATISTICS failed: %s\n", strerror(errno));
+	res->drops = st.tp_drops;
+
+	munmap(map, map_len);
+	close(pfd.fd);
+}
+
+static void print_result(const char *name, struct ring_result *res)
+{
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %s:\n", name);
+		printf(" %14" PRIu64 " Packets captured\n", res->packets);
+		printf(" %14" PRIu64 " Packets dropped\n", res->drops);
+		printf(" %14" PRIu64 " Wakeups\n", res->wakeups);
+		printf(" %14lf CPU usec/Packet\n",
+		       res->packets ? res->cpu_secs * 1000000 / res->packets : 0);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%" PRIu64 " %" PRIu64 " %" PRIu64 " %lf\n",
+		       res->packets, res->drops, res->wakeups, res->cpu_secs);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+}
+
+int bench_net_pktring(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct ring_result res;
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	int rfd;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_pktring_usage, 0);
+
+	if (nr_packets <= 0 || size <= 0 || size > 65507 ||
+	    block_kb <= 0 || block_kb * K % getpagesize() ||
+	    ring_mb <= 0 || ring_mb * K % block_kb || retire_ms < 0) {
+		fprintf(stderr, "Invalid number of packets or ring geometry\n");
+		return 1;
+	}
+
+	/* Datagrams need somewhere to go, nobody reads them though */
+	rfd = socket(AF_INET, SOCK_DGRAM, 0);
+	BUG_ON(rfd < 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    getsockname(rfd, (struct sockaddr *)&addr, &addrlen) < 0)
+		die("cannot set up the loopback receiver: %s\n",
+		    strerror(errno));
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Capturing %d datagrams of %d Bytes on lo, "
+		       "%d MB ring of %d KB blocks ...\n\n",
+		       nr_packets, size, ring_mb, block_kb);
+
+	do_capture(TPACKET_V2, &addr, &res);
+	print_result("TPACKET_V2", &res);
+	do_capture(TPACKET_V3, &addr, &res);
+	print_result("TPACKET_V3", &res);
+
+	close(rfd);
+	return 0;
+}
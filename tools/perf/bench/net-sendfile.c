@@ -0,0 +1,308 @@
+/*
+ * net-sendfile.c
+ *
+ * sendfile: Cost of sending a file over TCP, sendfile() vs read() + write()
+ *
+ * A child process drains a loopback TCP connection while the parent sends
+ * the same page-cache-warm file through it, once with sendfile() and once
+ * with a read()/write() loop. Only the sender is measured.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define K 1024
+#define CHUNK (64 * K)
+
+static const char	*length_str	= "64MB";
+static const char	*file_name;
+static bool		use_clock;
+static int		clock_fd;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "64MB",
+		    "Specify length of file to send. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('f', "file", &file_name, "file",
+		    "Send this file instead of a temporary one"),
+	OPT_BOOLEAN('c', "clock", &use_clock,
+		    "Use CPU clock for measuring"),
+	OPT_END()
+};
+
+static const char * const bench_net_sendfile_usage[] = {
+	"perf bench net sendfile <options>",
+	NULL
+};
+
+static struct perf_event_attr clock_attr = {
+	.type		= PERF_TYPE_HARDWARE,
+	.config		= PERF_COUNT_HW_CPU_CYCLES
+};
+
+static void init_clock(void)
+{
+	clock_fd = sys_perf_event_open(&clock_attr, getpid(), -1, -1, 0);
+
+	if (clock_fd < 0 && errno == ENOSYS)
+		die("No CONFIG_PERF_EVENTS=y kernel support configured?\n");
+	else
+		BUG_ON(clock_fd < 0);
+}
+
+static u64 get_clock(void)
+{
+	int ret;
+	u64 clk;
+
+	ret = read(clock_fd, &clk, sizeof(u64));
+	BUG_ON(ret != sizeof(u64));
+
+	return clk;
+}
+
+static double timeval2double(struct timeval *ts)
+{
+	return (double)ts->tv_sec +
+		(double)ts->tv_usec / (double)1000000;
+}
+
+/* Create (or open) the file to send and pull it into the page cache */
+static int open_file(size_t *len)
+{
+	char tmpl[] = "/tmp/perf-bench-sendfile.XXXXXX";
+	char *buf;
+	size_t done;
+	ssize_t ret;
+	int fd;
+
+	buf = zalloc(CHUNK);
+	if (!buf)
+		die("memory allocation failed\n");
+
+	if (file_name) {
+		struct stat st;
+
+		fd = open(file_name, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st) < 0)
+			die("cannot open %s: %s\n", file_name, strerror(errno));
+		*len = st.st_size;
+	} else {
+		fd = mkstemp(tmpl);
+		if (fd < 0)
+			die("cannot create %s: %s\n", tmpl, strerror(errno));
+		unlink(tmpl);
+		for (done = 0; done < *len; done += ret) {
+			ret = write(fd, buf, min(*len - done, (size_t)CHUNK));
+			if (ret <= 0)
+				die("write to %s failed\n", tmpl);
+		}
+	}
+
+	/* Warm the page cache, both methods then start from memory */
+	for (done = 0; done < *len; done += ret) {
+		ret = pread(fd, buf, CHUNK, done);
+		if (ret <= 0)
+			break;
+	}
+
+	free(buf);
+	return fd;
+}
+
+/* Accept @nr connections in turn and throw away what they carry */
+static void sink(int lfd, int nr)
+{
+	char *buf = zalloc(CHUNK);
+	int fd;
+
+	if (!buf)
+		exit(1);
+
+	while (nr--) {
+		fd = accept(lfd, NULL, NULL);
+		if (fd < 0)
+			exit(1);
+		while (read(fd, buf, CHUNK) > 0)
+			;
+		close(fd);
+	}
+	exit(0);
+}
+
+static int connect_to(struct sockaddr_in *addr)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	if (fd < 0 || connect(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0)
+		die("cannot connect to the sink: %s\n", strerror(errno));
+	return fd;
+}
+
+static void send_sendfile(int sfd, int fd, size_t len)
+{
+	off_t off = 0;
+	ssize_t ret;
+
+	while ((size_t)off < len) {
+		ret = sendfile(sfd, fd, &off, len - off);
+		if (ret <= 0)
+			die("sendfile failed: %s\n", strerror(errno));
+	}
+}
+
+static void send_readwrite(int sfd, int fd, size_t len)
+{
+	static char buf[CHUNK];
+	size_t done, sent;
+	ssize_t ret, n;
+
+	for (done = 0; done < len; done += n) {
+		n = pread(fd, buf, min(len - done, (size_t)CHUNK), done);
+		if (n <= 0)
+			die("read failed: %s\n", strerror(errno));
+		for (sent = 0; sent < (size_t)n; sent += ret) {
+			ret = write(sfd, buf + sent, n - sent);
+			if (ret <= 0)
+				die("write failed: %s\n", strerror(errno));
+		}
+	}
+}
+
+typedef void (*send_t)(int, int, size_t);
+
+/* Returns cycles, or bytes per second without --clock */
+static double do_send(send_t fn, struct sockaddr_in *addr, int fd, size_t len)
+{
+	struct timeval tv_start, tv_end, tv_diff;
+	u64 clock_start = 0ULL, clock_end = 0ULL;
+	int sfd = connect_to(addr);
+
+	if (use_clock)
+		clock_start = get_clock();
+	else
+		BUG_ON(gettimeofday(&tv_start, NULL));
+
+	fn(sfd, fd, len);
+
+	if (use_clock)
+		clock_end = get_clock();
+	else
+		BUG_ON(gettimeofday(&tv_end, NULL));
+
+	close(sfd);
+
+	if (use_clock)
+		return (double)(clock_end - clock_start);
+
+	timersub(&tv_end, &tv_start, &tv_diff);
+	return (double)len / timeval2double(&tv_diff);
+}
+
+#define print_bps(x) do {					\
+		if (x < K)					\
+			printf(" %14lf B/Sec", x);		\
+		else if (x < K * K)				\
+			printf(" %14lf KB/Sec", x / K);		\
+		else if (x < K * K * K)				\
+			printf(" %14lf MB/Sec", x / K / K);	\
+		else						\
+			printf(" %14lf GB/Sec", x / K / K / K); \
+	} while (0)
+
+int bench_net_sendfile(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	double result[2];
+	size_t len;
+	int fd, lfd, wait_stat;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_sendfile_usage, 0);
+
+	len = (size_t)perf_atoll((char *)length_str);
+	if (!file_name && (s64)len <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+
+	if (use_clock)
+		init_clock();
+
+	fd = open_file(&len);
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	BUG_ON(lfd < 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(lfd, 2) < 0 ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &addrlen) < 0)
+		die("cannot set up the loopback listener: %s\n",
+		    strerror(errno));
+
+	pid = fork();
+	BUG_ON(pid < 0);
+	if (!pid)
+		sink(lfd, 2);
+	close(lfd);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Sending %zu Bytes over loopback TCP ...\n\n", len);
+
+	result[0] = do_send(send_sendfile, &addr, fd, len);
+	result[1] = do_send(send_readwrite, &addr, fd, len);
+
+	waitpid(pid, &wait_stat, 0);
+	close(fd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		if (use_clock) {
+			printf(" %14lf Clock/Byte (sendfile)\n",
+			       result[0] / (double)len);
+			printf(" %14lf Clock/Byte (read + write)\n",
+			       result[1] / (double)len);
+		} else {
+			print_bps(result[0]);
+			printf(" (sendfile)\n");
+			print_bps(result[1]);
+			printf(" (read + write)\n");
+		}
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		if (use_clock)
+			printf("%lf %lf\n", result[0] / (double)len,
+			       result[1] / (double)len);
+		else
+			printf("%lf %lf\n", result[0], result[1]);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * net-udp-gso.c
+ *
+ * udp-gso: Cost of sending many UDP datagrams, UDP_SEGMENT vs sendmmsg()
+ *
+ * The parent sends the same number of equally sized datagrams to a
+ * loopback UDP socket drained by a child process, once as large sends
+ * that the stack splits up with UDP_SEGMENT, once as sendmmsg() batches
+ * of one datagram per message. Only the sender is measured.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#ifndef SOL_UDP
+#define SOL_UDP		17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT	103
+#endif
+
+/* Largest UDP payload that fits one IPv4 datagram */
+#define MAX_PAYLOAD	(65535 - 20 - 8)
+#define MAX_BATCH	64
+
+static int		size		= 1400;
+static int		nr_datagrams	= 1000000;
+static bool		use_clock;
+static int		clock_fd;
+
+static const struct option options[] = {
+	OPT_INTEGER('s', "size", &size,
+		    "Specify payload size of each datagram (default 1400)"),
+	OPT_INTEGER('n', "nr", &nr_datagrams,
+		    "Specify number of datagrams to send (default 1000000)"),
+	OPT_BOOLEAN('c', "clock", &use_clock,
+		    "Use CPU clock for measuring"),
+	OPT_END()
+};
+
+static const char * const bench_net_udp_gso_usage[] = {
+	"perf bench net udp-gso <options>",
+	NULL
+};
+
+static struct perf_event_attr clock_attr = {
+	.type		= PERF_TYPE_HARDWARE,
+	.config		= PERF_COUNT_HW_CPU_CYCLES
+};
+
+static void init_clock(void)
+{
+	clock_fd = sys_perf_event_open(&clock_attr, getpid(), -1, -1, 0);
+
+	if (clock_fd < 0 && errno == ENOSYS)
+		die("No CONFIG_PERF_EVENTS=y kernel support configured?\n");
+	else
+		BUG_ON(clock_fd < 0);
+}
+
+static u64 get_clock(void)
+{
+	int ret;
+	u64 clk;
+
+	ret = read(clock_fd, &clk, sizeof(u64));
+	BUG_ON(ret != sizeof(u64));
+
+	return clk;
+}
+
+static double timeval2double(struct timeval *ts)
+{
+	return (double)ts->tv_sec +
+		(double)ts->tv_usec / (double)1000000;
+}
+
+/* Datagrams per send: as many as fit one maximum sized UDP payload */
+static int batch;
+static char *buf;
+
+/* Read and throw away datagrams until killed */
+static void sink(int fd)
+{
+	char *rbuf = zalloc(size);
+
+	if (!rbuf)
+		exit(1);
+	for (;;)
+		if (read(fd, rbuf, size) < 0 && errno != EINTR)
+			exit(1);
+}
+
+static int connect_to(struct sockaddr_in *addr)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+	if (fd < 0 || connect(fd, (struct sockaddr *)addr, sizeof(*addr)) < 0)
+		die("cannot connect to the sink: %s\n", strerror(errno));
+	return fd;
+}
+
+static void send_gso(int fd)
+{
+	int left, n;
+
+	if (setsockopt(fd, SOL_UDP, UDP_SEGMENT, &size, sizeof(size)) < 0)
+		die("UDP_SEGMENT not supported: %s\n", strerror(errno));
+
+	for (left = nr_datagrams; left > 0; left -= n) {
+		n = min(left, batch);
+		if (send(fd, buf, n * size, 0) < 0)
+			die("send failed: %s\n", strerror(errno));
+	}
+}
+
+#ifdef __NR_sendmmsg
+struct bench_mmsghdr {
+	struct msghdr	msg_hdr;
+	unsigned int	msg_len;
+};
+
+static void send_mmsg(int fd)
+{
+	static struct bench_mmsghdr msgs[MAX_BATCH];
+	static struct iovec iov[MAX_BATCH];
+	int i, left, n, ret;
+
+	for (i = 0; i < batch; i++) {
+		iov[i].iov_base = buf + i * size;
+		iov[i].iov_len = size;
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	for (left = nr_datagrams; left > 0; left -= ret) {
+		n = min(left, batch);
+		ret = syscall(__NR_sendmmsg, fd, msgs, n, 0);
+		if (ret <= 0)
+			die("sendmmsg failed: %s\n", strerror(errno));
+	}
+}
+#else
+static void send_mmsg(int fd __used)
+{
+	die("sendmmsg() is not known on this architecture\n");
+}
+#endif
+
+typedef void (*send_t)(int);
+
+/* Returns cycles, or datagrams per second without --clock */
+static double do_send(send_t fn, struct sockaddr_in *addr)
+{
+	struct timeval tv_start, tv_end, tv_diff;
+	u64 clock_start = 0ULL, clock_end = 0ULL;
+	int fd = connect_to(addr);
+
+	if (use_clock)
+		clock_start = get_clock();
+	else
+		BUG_ON(gettimeofday(&tv_start, NULL));
+
+	fn(fd);
+
+	if (use_clock)
+		clock_end = get_clock();
+	else
+		BUG_ON(gettimeofday(&tv_end, NULL));
+
+	close(fd);
+
+	if (use_clock)
+		return (double)(clock_end - clock_start);
+
+	timersub(&tv_end, &tv_start, &tv_diff);
+	return (double)nr_datagrams / timeval2double(&tv_diff);
+}
+
+int bench_net_udp_gso(int argc, const char **argv,
+		      const char *prefix __used)
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	double result[2];
+	int rfd, wait_stat;
+	pid_t pid;
+
+	argc = parse_options(argc, argv, options,
+			     bench_net_udp_gso_usage, 0);
+
+	if (size <= 0 || size > MAX_PAYLOAD || nr_datagrams <= 0) {
+		fprintf(stderr, "Invalid size or number of datagrams\n");
+		return 1;
+	}
+	batch = min(MAX_PAYLOAD / size, MAX_BATCH);
+
+	buf = zalloc(batch * size);
+	if (!buf)
+		die("memory allocation failed\n");
+
+	if (use_clock)
+		init_clock();
+
+	rfd = socket(AF_INET, SOCK_DGRAM, 0);
+	BUG_ON(rfd < 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(rfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    getsockname(rfd, (struct sockaddr *)&addr, &addrlen) < 0)
+		die("cannot set up the loopback receiver: %s\n",
+		    strerror(errno));
+
+	pid = fork();
+	BUG_ON(pid < 0);
+	if (!pid)
+		sink(rfd);
+	close(rfd);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Sending %d datagrams of %d Bytes, %d per call ...\n\n",
+		       nr_datagrams, size, batch);
+
+	result[0] = do_send(send_gso, &addr);
+	result[1] = do_send(send_mmsg, &addr);
+
+	kill(pid, SIGTERM);
+	waitpid(pid, &wait_stat, 0);
+	free(buf);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		if (use_clock) {
+			printf(" %14lf Clock/Datagram (UDP_SEGMENT)\n",
+			       result[0] / nr_datagrams);
+			printf(" %14lf Clock/Datagram (sendmmsg)\n",
+			       result[1] / nr_datagrams);
+		} else {
+			printf(" %14lf Datagrams/Sec (UDP_SEGMENT)\n",
+			       result[0]);
+			printf(" %14lf Datagrams/Sec (sendmmsg)\n",
+			       result[1]);
+		}
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		if (use_clock)
+			printf("%lf %lf\n", result[0] / nr_datagrams,
+			       result[1] / nr_datagrams);
+		else
+			printf("%lf %lf\n", result[0], result[1]);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+
+	return 0;
+}
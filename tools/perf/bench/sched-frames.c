@@ -0,0 +1,260 @@
+/*
+ * sched-frames.c
+ *
+ * frames: Frame deadlines of a rendering-like load under cpufreq governors
+ *
+ * Every frame period the process wakes up and does a fixed amount of
+ * work, light for most frames and a burst every few frames, the way an
+ * application drawing at a fixed refresh rate does. The work is counted
+ * in loop iterations calibrated at full speed, so a governor that keeps
+ * the frequency too low, or raises it too late for a burst, makes frames
+ * take longer and miss their deadline. Reported are the missed frames and
+ * the frame times for each governor given with --governors, which are
+ * switched to in turn for all cpus (needs root), and the process CPU time.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define MAX_CPUS	64
+#define GOV_LEN		32
+/* Spin this long so the cpu is at full speed, then calibrate */
+#define CALIB_MSECS	500
+
+static int		fps		= 60;
+static int		nr_frames	= 600;
+static int		light		= 20;
+static int		heavy		= 70;
+static int		burst_every	= 10;
+static const char	*governors;
+
+static const struct option options[] = {
+	OPT_INTEGER('f', "fps", &fps,
+		    "Specify frames per second (default 60)"),
+	OPT_INTEGER('n', "nr", &nr_frames,
+		    "Specify number of frames per governor (default 600)"),
+	OPT_INTEGER('l', "light", &light,
+		    "Specify work of a light frame in % of the period "
+		    "at full speed (default 20)"),
+	OPT_INTEGER('H', "heavy", &heavy,
+		    "Specify work of a burst frame in % of the period "
+		    "at full speed (default 70)"),
+	OPT_INTEGER('b', "burst", &burst_every,
+		    "Specify every how many frames a burst comes (default 10)"),
+	OPT_STRING('g', "governors", &governors, "gov,gov,...",
+		   "Run once under each of these cpufreq governors"),
+	OPT_END()
+};
+
+static const char * const bench_sched_frames_usage[] = {
+	"perf bench sched frames <options>",
+	NULL
+};
+
+struct frame_result {
+	int		missed;
+	double		mean_usecs;
+	double		max_usecs;
+	double		cpu_secs;
+};
+
+static volatile u64 sink;
+
+static u64 now_usecs(void)
+{
+	struct timeval tv;
+
+	BUG_ON(gettimeofday(&tv, NULL));
+	return (u64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static double cpu_time(void)
+{
+	struct rusage ru;
+
+	BUG_ON(getrusage(RUSAGE_SELF, &ru));
+	return (double)ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+	       (double)ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static void work(u64 loops)
+{
+	u64 i, x = 0;
+
+	for (i = 0; i < loops; i++)
+		x += i ^ (x >> 3);
+	sink = x;
+}
+
+/* Loop iterations per usec with the cpu running flat out */
+static double calibrate(void)
+{
+	u64 start, t, loops = 0;
+
+	start = now_usecs();
+	while (now_usecs() < start + CALIB_MSECS * 1000 / 2)
+		work(10000);
+
+	t = now_usecs();
+	while (now_usecs() < t + CALIB_MSECS * 1000 / 2) {
+		work(10000);
+		loops += 10000;
+	}
+	return (double)loops / (now_usecs() - t);
+}
+
+static int sysfs_gov(int cpu, char *buf, const char *set)
+{
+	char path[128];
+	FILE *fp;
+	int ret = 0;
+
+	snprintf(path, sizeof(path),
+		 "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", cpu);
+	fp = fopen(path, set ? "w" : "r");
+	if (!fp)
+		return -1;
+	if (set)
+		ret = fputs(set, fp) < 0 ? -1 : 0;
+	else if (!fgets(buf, GOV_LEN, fp))
+		ret = -1;
+	else
+		buf[strcspn(buf, "\n")] = '\0';
+	if (fclose(fp))
+		ret = -1;
+	return ret;
+}
+
+static void set_governor(const char *gov, int nr_cpus)
+{
+	int cpu;
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (sysfs_gov(cpu, NULL, gov) < 0 && cpu == 0)
+			die("cannot switch to governor %s: %s\n",
+			    gov, strerror(errno));
+}
+
+static void run_frames(double loops_per_usec, struct frame_result *res)
+{
+	u64 period = 1000000 / fps, next, start, t, sum = 0;
+	double cpu_start;
+	int i;
+
+	memset(res, 0, sizeof(*res));
+	cpu_start = cpu_time();
+	next = now_usecs() + period;
+
+	for (i = 0; i < nr_frames; i++) {
+		int pct = i % burst_every ? light : heavy;
+
+		t = now_usecs();
+		if (t < next)
+			usleep(next - t);
+		start = next;
+		next += period;
+
+		work((u64)(loops_per_usec * period * pct / 100));
+
+		t = now_usecs() - start;
+		sum += t;
+		if (t > period)
+			res->missed++;
+		if (t > res->max_usecs)
+			res->max_usecs = t;
+		/* A late frame drops the slots it overran, like vsync does */
+		while (next < now_usecs())
+			next += period;
+	}
+
+	res->mean_usecs = (double)sum / nr_frames;
+	res->cpu_secs = cpu_time() - cpu_start;
+}
+
+static void print_result(const char *name, struct frame_result *res)
+{
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %s:\n", name);
+		printf(" %14d Frames missed\n", res->missed);
+		printf(" %14lf usecs/Frame (mean)\n", res->mean_usecs);
+		printf(" %14lf usecs/Frame (max)\n", res->max_usecs);
+		printf(" %14lf CPU secs\n", res->cpu_secs);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %d %lf %lf %lf\n", name, res->missed,
+		       res->mean_usecs, res->max_usecs, res->cpu_secs);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+}
+
+int bench_sched_frames(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	char saved[MAX_CPUS][GOV_LEN];
+	struct frame_result res;
+	double loops_per_usec;
+	int cpu, nr_cpus;
+	char *list, *gov, *tok;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_frames_usage, 0);
+
+	if (fps <= 0 || fps > 1000 || nr_frames <= 0 || burst_every <= 0 ||
+	    light < 0 || light > 100 || heavy < 0 || heavy > 100) {
+		fprintf(stderr, "Invalid frame rate, count or work\n");
+		return 1;
+	}
+
+	loops_per_usec = calibrate();
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d frames at %d fps, %d%% work, %d%% every %d frames ...\n\n",
+		       nr_frames, fps, light, heavy, burst_every);
+
+	if (!governors) {
+		if (sysfs_gov(0, saved[0], NULL) < 0)
+			strcpy(saved[0], "current");
+		run_frames(loops_per_usec, &res);
+		print_result(saved[0], &res);
+		return 0;
+	}
+
+	nr_cpus = min(sysconf(_SC_NPROCESSORS_CONF), (long)MAX_CPUS);
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (sysfs_gov(cpu, saved[cpu], NULL) < 0)
+			saved[cpu][0] = '\0';
+
+	list = strdup(governors);
+	if (!list)
+		die("memory allocation failed\n");
+
+	for (gov = strtok_r(list, ",", &tok); gov;
+	     gov = strtok_r(NULL, ",", &tok)) {
+		set_governor(gov, nr_cpus);
+		/* Let the new governor settle at idle */
+		usleep(100000);
+		run_frames(loops_per_usec, &res);
+		print_result(gov, &res);
+	}
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (saved[cpu][0])
+			sysfs_gov(cpu, NULL, saved[cpu]);
+	free(list);
+
+	return 0;
+}
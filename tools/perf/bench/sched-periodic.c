@@ -0,0 +1,163 @@
+/*
+ * sched-periodic.c
+ *
+ * periodic: How well the scheduler tracks the utilization of a task
+ *
+ * The process runs a fixed duty cycle, spinning for a part of every period
+ * and sleeping for the rest, and samples the per-entity load tracking
+ * averages the kernel keeps for it from /proc/self/sched at the end of
+ * every period. Reported is the utilization the duty cycle should give on
+ * the SCHED_POWER_SCALE (1024) scale next to what the scheduler tracked.
+ *
+ * Needs CONFIG_SCHED_DEBUG for /proc/<pid>/sched.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+
+#define UTIL_SCALE	1024
+/* Time for the geometric series to settle before sampling starts */
+#define WARMUP_MSECS	1000
+
+static int		period_ms	= 16;
+static int		duty		= 25;
+static int		nr_secs		= 3;
+
+static const struct option options[] = {
+	OPT_INTEGER('p', "period", &period_ms,
+		    "Specify period of the duty cycle in msecs (default 16)"),
+	OPT_INTEGER('d', "duty", &duty,
+		    "Specify busy part of each period in percent (default 25)"),
+	OPT_INTEGER('l', "length", &nr_secs,
+		    "Specify run time in seconds (default 3)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_periodic_usage[] = {
+	"perf bench sched periodic <options>",
+	NULL
+};
+
+struct pelt_sample {
+	u64		util;
+	u64		runnable_sum;
+	u64		running_sum;
+	u64		period;
+};
+
+static u64 now_usecs(void)
+{
+	struct timeval tv;
+
+	BUG_ON(gettimeofday(&tv, NULL));
+	return (u64)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/* Pull the se.avg.* fields out of /proc/self/sched */
+static void read_sample(struct pelt_sample *s)
+{
+	char line[256], name[128];
+	unsigned long long val;
+	FILE *fp;
+
+	memset(s, 0, sizeof(*s));
+	fp = fopen("/proc/self/sched", "r");
+	if (!fp)
+		die("cannot open /proc/self/sched (needs CONFIG_SCHED_DEBUG): %s\n",
+		    strerror(errno));
+
+	while (fgets(line, sizeof(line), fp)) {
+		if (sscanf(line, "%127s : %llu", name, &val) != 2)
+			continue;
+		if (!strcmp(name, "se.avg.util_avg_contrib"))
+			s->util = val;
+		else if (!strcmp(name, "se.avg.runnable_avg_sum"))
+			s->runnable_sum = val;
+		else if (!strcmp(name, "se.avg.running_avg_sum"))
+			s->running_sum = val;
+		else if (!strcmp(name, "se.avg.runnable_avg_period"))
+			s->period = val;
+	}
+	fclose(fp);
+
+	if (!s->period)
+		die("kernel does not export per-entity load tracking\n");
+}
+
+int bench_sched_periodic(int argc, const char **argv,
+			 const char *prefix __used)
+{
+	u64 period_us, busy_us, start, end, t, util_sum = 0;
+	u64 util_min = ~0ULL, util_max = 0, expected;
+	struct pelt_sample s;
+	int nr = 0;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_periodic_usage, 0);
+
+	if (period_ms <= 0 || duty < 0 || duty > 100 || nr_secs <= 0) {
+		fprintf(stderr, "Invalid period, duty cycle or run time\n");
+		return 1;
+	}
+
+	period_us = (u64)period_ms * 1000;
+	busy_us = period_us * duty / 100;
+	expected = (u64)UTIL_SCALE * duty / 100;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Running %d%% of every %d msecs for %d seconds ...\n\n",
+		       duty, period_ms, nr_secs);
+
+	start = now_usecs();
+	end = start + (u64)nr_secs * 1000000;
+
+	for (t = start; t < end; t += period_us) {
+		while (now_usecs() < t + busy_us)
+			;
+		if (t - start >= WARMUP_MSECS * 1000) {
+			read_sample(&s);
+			util_sum += s.util;
+			util_min = min(util_min, s.util);
+			util_max = max(util_max, s.util);
+			nr++;
+		}
+		if (now_usecs() < t + period_us)
+			usleep(t + period_us - now_usecs());
+	}
+
+	if (!nr)
+		die("run time too short, nothing sampled after warm-up\n");
+	read_sample(&s);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %14" PRIu64 " Expected utilization\n", expected);
+		printf(" %14lf Tracked utilization (mean)\n",
+		       (double)util_sum / nr);
+		printf(" %14" PRIu64 " Tracked utilization (min)\n", util_min);
+		printf(" %14" PRIu64 " Tracked utilization (max)\n", util_max);
+		printf(" %14lf Running/period\n",
+		       (double)s.running_sum / (s.period + 1));
+		printf(" %14lf Runnable/period\n",
+		       (double)s.runnable_sum / (s.period + 1));
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%" PRIu64 " %lf %" PRIu64 " %" PRIu64 "\n", expected,
+		       (double)util_sum / nr, util_min, util_max);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,238 @@
+/*
+ * sched-wakeup.c
+ *
+ * wakeup: Timer wakeup latency under a hackbench-like load
+ *
+ * Groups of writer and reader processes flood each other over socket
+ * pairs, keeping all cpus busy and the scheduler busy with wakeups, the
+ * way hackbench does. Meanwhile the process sleeps until an absolute
+ * time every interval and measures how late it got to run, the way
+ * cyclictest does. This is done once as a plain SCHED_NORMAL task and
+ * once with SCHED_LATENCY_SENSITIVE set, which needs CAP_SYS_NICE.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#ifndef SCHED_LATENCY_SENSITIVE
+#define SCHED_LATENCY_SENSITIVE	0x20000000
+#endif
+
+#define DATASIZE	100
+#define PAIRS_PER_GROUP	10
+/* Time for the load to spread over the cpus before measuring */
+#define SETTLE_MSECS	1000
+
+static int		nr_groups	= 4;
+static int		interval_us	= 1000;
+static int		nr_loops	= 5000;
+
+static const struct option options[] = {
+	OPT_INTEGER('g', "groups", &nr_groups,
+		    "Specify number of groups of 10 writer/reader pairs "
+		    "(default 4)"),
+	OPT_INTEGER('i', "interval", &interval_us,
+		    "Specify wakeup interval in usecs (default 1000)"),
+	OPT_INTEGER('l', "loops", &nr_loops,
+		    "Specify number of wakeups per run (default 5000)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_wakeup_usage[] = {
+	"perf bench sched wakeup <options>",
+	NULL
+};
+
+struct wakeup_result {
+	double		mean_usecs;
+	u64		p99_usecs;
+	u64		max_usecs;
+};
+
+static void writer(int fd)
+{
+	char buf[DATASIZE];
+
+	memset(buf, 0, sizeof(buf));
+	for (;;)
+		if (write(fd, buf, sizeof(buf)) < 0 && errno != EINTR)
+			exit(1);
+}
+
+static void reader(int fd)
+{
+	char buf[DATASIZE];
+
+	for (;;)
+		if (read(fd, buf, sizeof(buf)) < 0 && errno != EINTR)
+			exit(1);
+}
+
+static pid_t start_one(void (*fn)(int), int fd, int other_fd)
+{
+	pid_t pid = fork();
+
+	if (pid < 0)
+		die("fork failed: %s\n", strerror(errno));
+	if (!pid) {
+		close(other_fd);
+		fn(fd);
+		exit(0);
+	}
+	return pid;
+}
+
+static void start_load(pid_t *pids, int nr_pairs)
+{
+	int fds[2], i;
+
+	for (i = 0; i < nr_pairs; i++) {
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+			die("socketpair failed: %s\n", strerror(errno));
+		pids[2 * i] = start_one(writer, fds[0], fds[1]);
+		pids[2 * i + 1] = start_one(reader, fds[1], fds[0]);
+		close(fds[0]);
+		close(fds[1]);
+	}
+}
+
+static void stop_load(pid_t *pids, int nr_pairs)
+{
+	int i;
+
+	for (i = 0; i < 2 * nr_pairs; i++)
+		kill(pids[i], SIGKILL);
+	for (i = 0; i < 2 * nr_pairs; i++)
+		waitpid(pids[i], NULL, 0);
+}
+
+static int set_latency_sensitive(int on)
+{
+	struct sched_param param = { .sched_priority = 0 };
+
+	return sched_setscheduler(0, SCHED_OTHER |
+				  (on ? SCHED_LATENCY_SENSITIVE : 0), &param);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void measure(u64 *samples, struct wakeup_result *res)
+{
+	struct timespec next, now;
+	u64 sum = 0;
+	s64 lat;
+	int i;
+
+	BUG_ON(clock_gettime(CLOCK_MONOTONIC, &next));
+	for (i = 0; i < nr_loops; i++) {
+		next.tv_nsec += interval_us * 1000;
+		while (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+				       &next, NULL) == EINTR)
+			;
+		BUG_ON(clock_gettime(CLOCK_MONOTONIC, &now));
+
+		lat = (s64)(now.tv_sec - next.tv_sec) * 1000000 +
+		      (now.tv_nsec - next.tv_nsec) / 1000;
+		samples[i] = lat > 0 ? lat : 0;
+		sum += samples[i];
+	}
+
+	qsort(samples, nr_loops, sizeof(*samples), cmp_u64);
+	res->mean_usecs = (double)sum / nr_loops;
+	res->p99_usecs = samples[(u64)nr_loops * 99 / 100];
+	res->max_usecs = samples[nr_loops - 1];
+}
+
+static void print_result(const char *name, struct wakeup_result *res)
+{
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf(" %s:\n", name);
+		printf(" %14lf usecs late (mean)\n", res->mean_usecs);
+		printf(" %14" PRIu64 " usecs late (99th percentile)\n",
+		       res->p99_usecs);
+		printf(" %14" PRIu64 " usecs late (max)\n", res->max_usecs);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%s %lf %" PRIu64 " %" PRIu64 "\n", name,
+		       res->mean_usecs, res->p99_usecs, res->max_usecs);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+}
+
+int bench_sched_wakeup(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct wakeup_result res;
+	int nr_pairs;
+	u64 *samples;
+	pid_t *pids;
+
+	argc = parse_options(argc, argv, options,
+			     bench_sched_wakeup_usage, 0);
+
+	if (nr_groups <= 0 || interval_us <= 0 || nr_loops <= 0) {
+		fprintf(stderr, "Invalid number of groups, interval or loops\n");
+		return 1;
+	}
+
+	nr_pairs = nr_groups * PAIRS_PER_GROUP;
+	samples = malloc(nr_loops * sizeof(*samples));
+	pids = malloc(2 * nr_pairs * sizeof(*pids));
+	if (!samples || !pids)
+		die("memory allocation failed\n");
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %d wakeups every %d usecs, %d processes of load ...\n\n",
+		       nr_loops, interval_us, 2 * nr_pairs);
+
+	/* The load does not inherit whatever is set for the measurement */
+	set_latency_sensitive(0);
+	start_load(pids, nr_pairs);
+	usleep(SETTLE_MSECS * 1000);
+
+	measure(samples, &res);
+	print_result("normal", &res);
+
+	if (set_latency_sensitive(1) < 0) {
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf("\n# cannot set SCHED_LATENCY_SENSITIVE: %s\n",
+			       strerror(errno));
+	} else {
+		measure(samples, &res);
+		print_result("latency-sensitive", &res);
+		set_latency_sensitive(0);
+	}
+
+	stop_load(pids, nr_pairs);
+	free(pids);
+	free(samples);
+
+	return 0;
+}
@@ -13,6 +13,8 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  net   ... network transmit paths
+ *  fs    ... filesystem write paths
  *
  */
 
@@ -42,6 +44,15 @@ static struct bench_suite sched_suites[] = {
 	{ "pipe",
 	  "Flood of communication over pipe() between two processes",
 	  bench_sched_pipe      },
+	{ "periodic",
+	  "Utilization the scheduler tracks for a periodic task",
+	  bench_sched_periodic  },
+	{ "frames",
+	  "Frame deadlines of a bursty load under cpufreq governors",
+	  bench_sched_frames    },
+	{ "wakeup",
+	  "Timer wakeup latency under hackbench-like load",
+	  bench_sched_wakeup    },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -58,6 +69,38 @@ static struct bench_suite mem_suites[] = {
 	  NULL             }
 };
 
+static struct bench_suite net_suites[] = {
+	{ "sendfile",
+	  "Sending a file over TCP with sendfile() vs read() + write()",
+	  bench_net_sendfile },
+	{ "udp-gso",
+	  "Sending UDP datagrams with UDP_SEGMENT vs sendmmsg()",
+	  bench_net_udp_gso },
+	{ "connect",
+	  "TCP connection rate, stressing connection tracking",
+	  bench_net_connect },
+	{ "pktring",
+	  "Capturing on loopback with a TPACKET_V2 vs a TPACKET_V3 ring",
+	  bench_net_pktring },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL               }
+};
+
+static struct bench_suite fs_suites[] = {
+	{ "write",
+	  "Write latency of a flash filesystem with and without background gc",
+	  bench_fs_write },
+	{ "create",
+	  "Small-file creation rate with one and with many threads",
+	  bench_fs_create },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL           }
+};
+
 struct bench_subsys {
 	const char *name;
 	const char *summary;
@@ -71,6 +114,12 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "net",
+	  "network transmit paths",
+	  net_suites },
+	{ "fs",
+	  "filesystem write paths",
+	  fs_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },